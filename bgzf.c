@@ -0,0 +1,283 @@
+// ------------------------------------------------------------------
+//   bgzf.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// BGZF (the gzip variant used by bgzip, samtools and htslib) is a series of independent gzip members ("blocks"),
+// each with up to 64KB of uncompressed data, and each stating its own compressed size in a "BC" extra subfield.
+// This allows us to read the blocks of a VB without uncompressing them in the I/O thread, and uncompress them
+// in the compute threads.
+
+#ifdef __APPLE__
+#define off64_t __int64_t // needed for for conda mac - otherwise zlib.h throws compilation errors
+#endif
+#define Z_LARGE64
+#include <errno.h>
+#include "genozip.h"
+#include "bgzf.h"
+#include "buffer.h"
+#include "vblock.h"
+#include "file.h"
+#include "profiler.h"
+#include "zlib/zlib.h"
+
+#define BGZF_HEADER_FIXED_LEN 12 // gzip header up to and including XLEN
+#define BGZF_FOOTER_LEN       8  // CRC32 and ISIZE
+
+#define LE16(p) ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8))
+#define LE32(p) (LE16(p) | ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+// parses the first part of a gzip member header, returns the length of the extra field (XLEN), or -1 if this is not a BGZF block
+static int bgzf_parse_fixed_header (const uint8_t *h)
+{
+    if (h[0] != 31 || h[1] != 139 || h[2] != 8 /* deflate */ || !(h[3] & 4) /* FEXTRA */) return -1;
+
+    return LE16 (&h[10]);
+}
+
+// searches the extra field for the BC subfield, and returns BSIZE (the total block size minus 1), or -1 if there isn't one
+static int bgzf_get_bsize (const uint8_t *extra, unsigned xlen)
+{
+    for (unsigned i=0; i + 4 <= xlen; i += 4 + LE16 (&extra[i+2]))
+        if (extra[i] == 'B' && extra[i+1] == 'C' && LE16 (&extra[i+2]) == 2 && i + 6 <= xlen)
+            return LE16 (&extra[i+4]);
+
+    return -1;
+}
+
+// ZIP: check if a local .gz file is actually BGZF, based on its first block header
+bool bgzf_is_bgzf_file (const char *filename)
+{
+    FILE *fp = fopen (filename, "rb");
+    if (!fp) return false; // let the caller handle the error with the gz path
+
+    uint8_t h[BGZF_HEADER_FIXED_LEN + 256];
+    bool is_bgzf = false;
+
+    if (fread (h, BGZF_HEADER_FIXED_LEN, 1, fp) == 1) {
+        int xlen = bgzf_parse_fixed_header (h);
+
+        if (xlen >= 6 && xlen <= 256 && fread (&h[BGZF_HEADER_FIXED_LEN], xlen, 1, fp) == 1)
+            is_bgzf = (bgzf_get_bsize (&h[BGZF_HEADER_FIXED_LEN], xlen) >= 0);
+    }
+
+    FCLOSE (fp, filename);
+    return is_bgzf;
+}
+
+// ZIP I/O thread: reads one BGZF block, appending its deflate data to bgzf_data. returns false if EOF.
+// note: the empty block that terminates BGZF files is read like any other block, with txt_size=0
+bool bgzf_read_block (VBlock *vb, FILE *fp, Buffer *bgzf_data, BgzfBlock *block)
+{
+    uint8_t h[BGZF_HEADER_FIXED_LEN + 65535]; // XLEN is 16 bit
+
+    size_t bytes = fread (h, 1, BGZF_HEADER_FIXED_LEN, fp);
+    if (!bytes && feof (fp)) return false; // EOF at a block boundary - as expected
+
+    ASSERT (bytes == BGZF_HEADER_FIXED_LEN, "Error: failed to read BGZF block header from %s: %s", txt_name,
+            feof (fp) ? "file is truncated" : strerror (errno));
+
+    int xlen = bgzf_parse_fixed_header (h);
+    ASSERT (xlen >= 0, "Error: %s is not a valid BGZF file - expecting each gzip member to be a BGZF block", txt_name);
+
+    ASSERT (fread (&h[BGZF_HEADER_FIXED_LEN], xlen, 1, fp) == 1, "Error: failed to read BGZF block header from %s", txt_name);
+
+    int bsize = bgzf_get_bsize (&h[BGZF_HEADER_FIXED_LEN], xlen);
+    ASSERT (bsize >= 0, "Error: %s is not a valid BGZF file - block is missing its BC field", txt_name);
+
+    int remaining = bsize + 1 - BGZF_HEADER_FIXED_LEN - xlen; // deflate data and footer
+    ASSERT (remaining >= BGZF_FOOTER_LEN, "Error: invalid BGZF block in %s: BSIZE=%d", txt_name, bsize);
+
+    block->compressed_index = bgzf_data->len;
+    block->comp_size        = remaining - BGZF_FOOTER_LEN;
+    block->is_uncompressed  = false;
+
+    buf_alloc (vb, bgzf_data, bgzf_data->len + remaining, 2, "bgzf_data", vb->vblock_i);
+
+    ASSERT (fread (&bgzf_data->data[bgzf_data->len], remaining, 1, fp) == 1, "Error: failed to read BGZF block from %s: %s",
+            txt_name, feof (fp) ? "file is truncated" : strerror (errno));
+
+    const uint8_t *footer = (uint8_t *)&bgzf_data->data[bgzf_data->len + block->comp_size];
+    block->crc32    = LE32 (footer);
+    block->txt_size = LE32 (&footer[4]);
+
+    ASSERT (block->txt_size <= BGZF_MAX_BLOCK_SIZE, "Error: invalid BGZF block in %s: ISIZE=%u", txt_name, block->txt_size);
+
+    bgzf_data->len += block->comp_size; // we don't need the footer anymore - next block's data will overwrite it
+
+    txt_file->disk_so_far += BGZF_HEADER_FIXED_LEN + xlen + remaining;
+
+    return true;
+}
+
+// uncompresses one block into its place in txt_data. may be called from any thread.
+void bgzf_uncompress_one_block (const char *bgzf_data, BgzfBlock *block, char *txt_data)
+{
+    if (block->is_uncompressed) return;
+
+    z_stream strm = { .next_in   = (Bytef *)&bgzf_data[block->compressed_index],
+                      .avail_in  = block->comp_size,
+                      .next_out  = (Bytef *)&txt_data[block->txt_index],
+                      .avail_out = block->txt_size };
+
+    int ret = inflateInit2 (&strm, -15); // raw deflate - the gzip header and footer are handled by us
+    ASSERT (ret == Z_OK, "Error: inflateInit2 failed: %d", ret);
+
+    ret = inflate (&strm, Z_FINISH);
+    ASSERT (ret == Z_STREAM_END && strm.total_out == block->txt_size,
+            "Error: failed to uncompress BGZF block of %s: ret=%d uncompressed %u bytes, expecting %u",
+            txt_name, ret, (uint32_t)strm.total_out, block->txt_size);
+
+    inflateEnd (&strm);
+
+    ASSERT (crc32 (0, (Bytef *)&txt_data[block->txt_index], block->txt_size) == block->crc32,
+            "Error: CRC32 mismatch in BGZF block of %s - file is corrupted", txt_name);
+
+    block->is_uncompressed = true;
+}
+
+// ZIP compute thread: uncompress the blocks of the VB that were not already uncompressed by the I/O thread, into 
+// uncompressed - txt_data, or for BAM, the binary data that is yet to be converted to SAM text
+void bgzf_uncompress_vb (VBlock *vb, char *uncompressed)
+{
+    START_TIMER;
+
+    for (uint32_t block_i=0; block_i < vb->bgzf_blocks.len; block_i++)
+        bgzf_uncompress_one_block (vb->bgzf_data.data, ENT (BgzfBlock, vb->bgzf_blocks, block_i), uncompressed);
+
+    COPY_TIMER (vb->profile.bgzf_uncompress_vb);
+}
+
+//-----------------------------------------------------------------------------------------------------
+// BAM and BCF: binary records, that are converted to txt lines (SAM or VCF) by the compute threads.
+// BGZF blocks are not aligned to records, so the last record of a VB's data is typically incomplete - its 
+// beginning is "carried" to the next VB. The VBs split their data into records in the order they were read (vb->bgzf_seq)
+//-----------------------------------------------------------------------------------------------------
+
+#define BGZF_RECORDS_TYPE_NAME (txt_file->comp_alg == COMP_BAM ? "BAM" : "BCF")
+
+static pthread_mutex_t bgzf_carry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bgzf_carry_cond = PTHREAD_COND_INITIALIZER;
+static Buffer bgzf_carry = EMPTY_BUFFER;
+static uint32_t bgzf_vbs_split = 0;
+static bool bgzf_header_carry_pending = false; // I/O thread only: the records following the header are not assigned to a VB yet
+
+// ZIP I/O thread: reads and uncompresses BGZF blocks of the binary header, until the uncompressed header data is at least len bytes
+void bgzf_read_header_data (Buffer *hdr, uint64_t len)
+{
+    static Buffer bgzf_data = EMPTY_BUFFER;
+
+    while (hdr->len < len) {
+        BgzfBlock block;
+        bgzf_data.len = 0;
+        ASSERT (bgzf_read_block (evb, (FILE *)txt_file->file, &bgzf_data, &block),
+                "Error: %s is truncated - it ends within the %s header", txt_name, BGZF_RECORDS_TYPE_NAME);
+
+        block.txt_index = hdr->len;
+        buf_alloc (evb, hdr, hdr->len + block.txt_size, 2, "bgzf_header", 0);
+        bgzf_uncompress_one_block (bgzf_data.data, &block, hdr->data);
+        hdr->len += block.txt_size;
+    }
+}
+
+// ZIP I/O thread: called after the binary header is parsed - the remaining data is the beginning of the records
+void bgzf_set_header_carry (const Buffer *hdr, uint64_t records_start)
+{
+    // note: we allocate bgzf_carry here, in the I/O thread, for the largest possible carry - a VB's data - as evb buffers
+    // may not be reallocated by the compute threads (the main thread tests them for overflows)
+    buf_alloc (evb, &bgzf_carry, MAX (BGZF_RECORDS_PER_VB, BGZF_MAX_BLOCK_SIZE), 1, "bgzf_carry", 0);
+    bgzf_carry.len = hdr->len - records_start;
+    memcpy (bgzf_carry.data, &hdr->data[records_start], bgzf_carry.len);
+
+    bgzf_vbs_split = 0;
+    bgzf_header_carry_pending = (bgzf_carry.len > 0);
+}
+
+// ZIP I/O thread: returns true, once per file, if the data following the header in its last BGZF block is yet to be 
+// assigned to a VB. The first VB of the file gets it as carry, even if the file is small and it has no blocks of its own.
+bool bgzf_take_header_carry (void)
+{
+    bool pending = bgzf_header_carry_pending;
+    bgzf_header_carry_pending = false;
+    return pending;
+}
+
+// ZIP: called after all VBs of a file are processed
+void bgzf_records_finalize (void)
+{
+    ASSERT (!bgzf_carry.len, "Error: %s is truncated - its last %s record is incomplete", txt_name, BGZF_RECORDS_TYPE_NAME);
+}
+
+// ZIP compute thread: uncompress the BGZF blocks of the VB, and convert the binary records to txt lines. Each record
+// starts with rec_len_bytes bytes from which rec_len calculates its length
+void bgzf_records_to_txt (VBlock *vb, unsigned rec_len_bytes, BgzfRecordLenFunc rec_len, BgzfRecordToTxtFunc rec_to_txt)
+{
+    Buffer *recs = &vb->bgzf_records;
+
+    // uncompress our blocks - in parallel with other VBs
+    const BgzfBlock *last = LASTENT (BgzfBlock, vb->bgzf_blocks);
+    uint32_t data_len = last->txt_index + last->txt_size;
+
+    buf_alloc (vb, recs, MAX (data_len, 1), 1.1, "bgzf_records", vb->vblock_i);
+    recs->len = data_len;
+    bgzf_uncompress_vb (vb, recs->data);
+
+    START_TIMER;
+
+    // wait for our turn to receive the beginning of the record split between the previous VB and us
+    pthread_mutex_lock (&bgzf_carry_mutex);
+    while (bgzf_vbs_split != vb->bgzf_seq)
+        pthread_cond_wait (&bgzf_carry_cond, &bgzf_carry_mutex);
+
+    // the carry has zero or more complete records (only after the header) followed by the beginning of a split record, 
+    // which we complete from our data. we place all this after our data
+    uint32_t start = 0; // start of the first record that is entirely in our data
+    if (bgzf_carry.len) {
+        uint32_t partial = 0; // start of the split record in the carry
+        while (partial + rec_len_bytes <= bgzf_carry.len && partial + (uint64_t)rec_len ((uint8_t *)&bgzf_carry.data[partial]) <= bgzf_carry.len)
+            partial += rec_len ((uint8_t *)&bgzf_carry.data[partial]);
+
+        uint32_t partial_len = bgzf_carry.len - partial;
+        if (partial_len) {
+            ASSERT (partial_len + data_len >= rec_len_bytes, "Error: %s is truncated - its last %s record is incomplete", txt_name, BGZF_RECORDS_TYPE_NAME);
+
+            uint8_t len_bytes[rec_len_bytes]; // the length might be split too
+            for (unsigned i=0; i < rec_len_bytes; i++)
+                len_bytes[i] = (i < partial_len) ? bgzf_carry.data[partial + i] : recs->data[i - partial_len];
+
+            uint64_t len = rec_len (len_bytes);
+            ASSERT (len - partial_len <= data_len, "Error: a %s record in %s is larger than vblock. Please use a larger --vblock", 
+                    BGZF_RECORDS_TYPE_NAME, txt_name);
+            start = len - partial_len;
+        }
+
+        buf_alloc (vb, recs, data_len + bgzf_carry.len + start, 1, "bgzf_records", vb->vblock_i);
+        memcpy (&recs->data[data_len], bgzf_carry.data, bgzf_carry.len);
+        memcpy (&recs->data[data_len + bgzf_carry.len], recs->data, start);
+        recs->len = data_len + bgzf_carry.len + start;
+    }
+
+    // find the last complete record - the remainder is carried to the next VB
+    uint32_t end = start;
+    while (end + rec_len_bytes <= data_len && end + (uint64_t)rec_len ((uint8_t *)&recs->data[end]) <= data_len)
+        end += rec_len ((uint8_t *)&recs->data[end]);
+
+    ASSERT (data_len - end <= bgzf_carry.size, "Error in bgzf_records_to_txt: carry of %u bytes exceeds bgzf_carry.size=%u", 
+            data_len - end, (uint32_t)bgzf_carry.size);
+    bgzf_carry.len = data_len - end;
+    memcpy (bgzf_carry.data, &recs->data[end], bgzf_carry.len);
+
+    bgzf_vbs_split++;
+    pthread_cond_broadcast (&bgzf_carry_cond);
+    pthread_mutex_unlock (&bgzf_carry_mutex);
+
+    // convert the records to txt lines, in the order of the file
+    vb->txt_data.len = 0;
+    for (uint32_t i=data_len; i < recs->len; i += rec_len ((uint8_t *)&recs->data[i]))
+        rec_to_txt (vb, (uint8_t *)&recs->data[i]);
+
+    for (uint32_t i=start; i < end; i += rec_len ((uint8_t *)&recs->data[i]))
+        rec_to_txt (vb, (uint8_t *)&recs->data[i]);
+
+    COPY_TIMER (vb->profile.bgzf_records_to_txt);
+}
@@ -0,0 +1,43 @@
+// ------------------------------------------------------------------
+//   bgzf.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef BGZF_INCLUDED
+#define BGZF_INCLUDED
+
+#include <stdio.h>
+#include "genozip.h"
+
+#define BGZF_MAX_BLOCK_SIZE 65536 // maximum size of a BGZF block - both compressed and uncompressed
+
+// a BGZF block of txt_file read in ZIP. Each block is an independent gzip member of up to 64KB of uncompressed data,
+// so once the I/O thread has read the blocks of a VB, they can be uncompressed in any order and in any thread
+typedef struct {
+    uint32_t compressed_index; // index into vb->bgzf_data of the deflate data of this block
+    uint32_t comp_size;        // size of the deflate data (excluding gzip header and footer)
+    uint32_t txt_index;        // index into vb->txt_data (BAM: into the binary data) where the uncompressed data of this block goes
+    uint32_t txt_size;         // size of the uncompressed data (ISIZE in the gzip footer)
+    uint32_t crc32;            // crc32 of the uncompressed data (CRC32 in the gzip footer)
+    bool is_uncompressed;      // true if the block has already been uncompressed into txt_data
+} BgzfBlock;
+
+// BAM and BCF: the binary data read per VB - the txt generated from it is typically 2-3 times larger
+#define BGZF_RECORDS_PER_VB (global_max_memory_per_vb / 3) 
+
+typedef uint32_t (*BgzfRecordLenFunc) (const uint8_t *rec);           // length of a binary record, given its first bytes
+typedef void (*BgzfRecordToTxtFunc) (VBlockP vb, const uint8_t *rec); // appends the txt line of a binary record to vb->txt_data
+
+extern bool bgzf_is_bgzf_file (const char *filename);
+extern bool bgzf_read_block (VBlockP vb, FILE *fp, BufferP bgzf_data, BgzfBlock *block);
+extern void bgzf_uncompress_one_block (const char *bgzf_data, BgzfBlock *block, char *txt_data);
+extern void bgzf_uncompress_vb (VBlockP vb, char *uncompressed);
+
+// BAM and BCF
+extern void bgzf_read_header_data (BufferP hdr, uint64_t len);
+extern void bgzf_set_header_carry (ConstBufferP hdr, uint64_t records_start);
+extern bool bgzf_take_header_carry (void);
+extern void bgzf_records_to_txt (VBlockP vb, unsigned rec_len_bytes, BgzfRecordLenFunc rec_len, BgzfRecordToTxtFunc rec_to_txt);
+extern void bgzf_records_finalize (void);
+
+#endif
@@ -25,14 +25,12 @@
 
 static const unsigned overhead_size = 2*sizeof (uint64_t) + sizeof(uint16_t); // underflow, overflow and user counter
 
-static pthread_mutex_t overlay_mutex; // used to thread-protect overlay counters (note: not initializing here - different in different OSes)
 static pthread_mutex_t evb_buf_mutex; // used to thread-protect the buf_list of evb
 static uint64_t abandoned_mem_current = 0;
 static uint64_t abandoned_mem_high_watermark = 0;
 
 void buf_initialize()
 {
-    pthread_mutex_init (&overlay_mutex, NULL);
     pthread_mutex_init (&evb_buf_mutex, NULL);
 
     vb_external_vb_initialize();
@@ -41,12 +39,24 @@ void buf_initialize()
 static const char *bt_str (const Buffer *buf)
 {
     static const char *names[] = BUFTYPE_NAMES;
-    if (buf->type >= BUF_UNALLOCATED && buf->type <= BUF_OVERLAY) 
+    if (buf->type >= BUF_UNALLOCATED && buf->type <= BUF_MMAP) 
         return names[buf->type];
     else
         return "INVALID";
 }
 
+// overlay counter: the number of buffers (0 or 1 regular buffer + any number of overlays) using the memory, located after 
+// the overflow trap. It is updated atomically, as overlays are released by their VBs concurrently. Note: new overlays of 
+// a buffer are only created while the caller holds the lock that protects the regular buffer (eg zf_ctx->mutex) or the 
+// buffer is no longer modified, so that a new overlay cannot appear while the regular buffer is being realloced or freed.
+#define OVERLAY_COUNT(buf) ((uint16_t*)((buf)->data + (buf)->size + sizeof(uint64_t)))
+
+static inline void buf_add_abandoned_mem (int64_t size)
+{
+    uint64_t current = __atomic_add_fetch (&abandoned_mem_current, size, __ATOMIC_RELAXED);
+    if (current > abandoned_mem_high_watermark) abandoned_mem_high_watermark = current; // statistic - approximate is ok
+}
+
 // get string with buffer's metadata for debug message. this function is NOT thread-safe
 char *buf_display (const Buffer *buf)
 {
@@ -168,7 +178,7 @@ static bool buf_test_overflows_do (const VBlock *vb, bool primary)
                         buf_desc (buf), buf->vb->vblock_i, buf_i);
                 corruption = true;
             }
-            if (buf->type < BUF_UNALLOCATED || buf->type > BUF_OVERLAY) {
+            if (buf->type < BUF_UNALLOCATED || buf->type > BUF_MMAP) {
                 fprintf (stderr, "%sMemory corruption in vb_id=%d (thread vb_i=%d) buffer=%s (buf_i=%u): Corrupt Buffer structure OR invalid buffer pointer - invalid buf->type\n", 
                          nl[primary], vb ? vb->id : -999, vb->vblock_i, str_pointer (buf, s1), buf_i);
                 corruption = true;
@@ -242,11 +252,48 @@ static int buf_stats_sort_by_bytes(const void *a, const void *b)
     return ((MemStats*)a)->bytes < ((MemStats*)b)->bytes ? 1 : -1;
 }
 
+#define MAX_MEMORY_STATS 100
+
+// add the buffers of one VB to the memory stats
+static void buf_add_vb_to_stats (const VBlock *vb, MemStats *stats, unsigned *num_stats, unsigned *num_buffers)
+{
+    const Buffer *buf_list = &vb->buffer_list; // a buffer, which contains an array of pointers to buffers of a single vb/non-vb
+
+    for (unsigned buf_i=0; buf_i < buf_list->len; buf_i++) {
+
+        ASSERT (buf_list->memory, "Error: memory of buffer_list of vb_id=%d is not allocated", vb->id); // this should never happen
+
+        Buffer *buf = ((Buffer **)buf_list->data)[buf_i];
+        
+        if (!buf || !buf->memory) continue; // exclude destroyed, not-yet-allocated, overlay buffers and buffers that were src in buf_move
+
+        bool found = false;
+        for (unsigned st_i=0; st_i < *num_stats && !found; st_i++) {
+            MemStats *st = &stats[st_i];
+
+            if (!strcmp (st->name, buf->name)) {
+                st->buffers++;
+                st->bytes += buf->size + overhead_size;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            stats[*num_stats].name    = buf->name;
+            stats[*num_stats].bytes   = buf->size + overhead_size;
+            stats[*num_stats].buffers = 1;
+            (*num_stats)++;
+            ASSERT (*num_stats < MAX_MEMORY_STATS, "# memory stats exceeded %u, consider increasing MAX_MEMORY_STATS", MAX_MEMORY_STATS);
+        }
+
+        (*num_buffers)++;
+    }
+}
+
 void buf_display_memory_usage (bool memory_full, unsigned max_threads, unsigned used_threads)
 {
-    #define MAX_MEMORY_STATS 100
     static MemStats stats[MAX_MEMORY_STATS]; // must be pre-allocated, because buf_display_memory_usage is called when malloc fails, so it cannot malloc
-    unsigned num_stats = 0, num_buffers = 0;
+    unsigned num_stats = 0, num_buffers = 0, num_buffer_lists = 0;
 
     if (memory_full)
         fprintf (stderr, "\n\nError memory is full:\n");
@@ -257,39 +304,15 @@ void buf_display_memory_usage (bool memory_full, unsigned max_threads, unsigned
 
     for (int vb_i=-1; vb_i < (int)vb_pool->num_allocated_vbs; vb_i++) {
 
-        Buffer *buf_list = (vb_i == -1) ? &evb->buffer_list
-                                        : &vb_pool->vb[vb_i]->buffer_list; // a pointer to a buffer, which contains an array of pointers to buffers of a single vb/non-vb
-
-        if (!buf_list->len) continue; // no buffers allocated yet for this VB
-
-        for (unsigned buf_i=0; buf_i < buf_list->len; buf_i++) {
-    
-            ASSERT (buf_list->memory, "Error: memory of buffer_list of vb_i=%u is not allocated", vb_i); // this should never happen
-
-            Buffer *buf = ((Buffer **)buf_list->data)[buf_i];
-            
-            if (!buf || !buf->memory) continue; // exclude destroyed, not-yet-allocated, overlay buffers and buffers that were src in buf_move
-
-            bool found = false;
-            for (unsigned st_i=0; st_i < num_stats && !found; st_i++) {
-                MemStats *st = &stats[st_i];
-
-                if (!strcmp (st->name, buf->name)) {
-                    st->buffers++;
-                    st->bytes += buf->size + overhead_size;
-                    found = true;
-                }
-            }
+        VBlock *vb = (vb_i == -1) ? evb : vb_pool->vb[vb_i]; 
 
-            if (!found) {
-                stats[num_stats].name    = buf->name;
-                stats[num_stats].bytes   = buf->size + overhead_size;
-                stats[num_stats].buffers = 1;
-                num_stats++;
-                ASSERT (num_stats < MAX_MEMORY_STATS, "# memory stats exceeded %u, consider increasing MAX_MEMORY_STATS", MAX_MEMORY_STATS);
-            }
+        buf_add_vb_to_stats (vb, stats, &num_stats, &num_buffers);
+        num_buffer_lists++;
 
-            num_buffers++;
+        // shard VBs (--seg-shards) are owned by their VB rather than the pool
+        for (unsigned shard_i=0; shard_i < MAX_SEG_SHARDS && vb->seg_shards[shard_i]; shard_i++) {
+            buf_add_vb_to_stats (vb->seg_shards[shard_i], stats, &num_stats, &num_buffers);
+            num_buffer_lists++;
         }
     }
 
@@ -301,7 +324,7 @@ void buf_display_memory_usage (bool memory_full, unsigned max_threads, unsigned
 
     char str[30];
     str_size (total_bytes, str);
-    fprintf (stderr, "Total bytes: %s in %u buffers in %u buffer lists:\n", str, num_buffers, vb_pool->num_allocated_vbs);
+    fprintf (stderr, "Total bytes: %s in %u buffers in %u buffer lists:\n", str, num_buffers, num_buffer_lists);
     fprintf (stderr, "Compute threads: max_permitted=%u actually_used=%u\n", max_threads, used_threads);
 
     for (unsigned i=0; i < num_stats; i++) {
@@ -365,7 +388,7 @@ static void buf_init (Buffer *buf, uint64_t size, uint64_t old_size,
 
     *(uint64_t *)buf->memory        = UNDERFLOW_TRAP;        // underflow protection
     *(uint64_t *)(buf->data + size) = OVERFLOW_TRAP;         // overflow prortection (underflow protection was copied with realloc)
-    *(uint16_t *)(buf->data + size + sizeof (uint64_t)) = 1; // counter of buffers that use of this memory (0 or 1 main buffer + any number of overlays)
+    *OVERLAY_COUNT(buf) = 1;                                 // counter of buffers that use of this memory (0 or 1 main buffer + any number of overlays)
 }
 
 // allocates or enlarges buffer
@@ -382,6 +405,20 @@ uint64_t buf_alloc_do (VBlock *vb,
 
     if (!requested_size) return 0; // nothing to do
 
+    // case: buffer is overlaid on a memory-mapped file - it becomes a regular buffer, with a copy of the data
+    if (buf->type == BUF_MMAP) {
+        const char *mapped_data = buf->data;
+        uint64_t mapped_len     = buf->len;
+        if (!name) { name = buf->name; param = buf->param; }
+
+        buf_reset (buf);
+        buf_alloc_do (vb, buf, MAX (requested_size, mapped_len), grow_at_least_factor, func, code_line, name, param); // recursive call - simple alloc
+
+        memcpy (buf->data, mapped_data, mapped_len);
+        buf->len = mapped_len;
+        return buf->size;
+    }
+
     // sanity checks
     ASSERT (buf->type == BUF_REGULAR || buf->type == BUF_UNALLOCATED, "Error: cannot buf_alloc an overlayed buffer. details: %s", buf_desc (buf));
     ASSERT0 (vb, "Error in buf_alloc_do: null vb");
@@ -408,36 +445,36 @@ uint64_t buf_alloc_do (VBlock *vb,
 
         // special handling if we have an overlaying buffer
         if (buf->overlayable) {
-            pthread_mutex_lock (&overlay_mutex);
-            uint16_t *overlay_count = (uint16_t*)(buf->data + buf->size + sizeof(uint64_t));
-
-            char *old_data = buf->data;
-            uint32_t old_len = buf->len;
+            uint16_t *overlay_count = OVERLAY_COUNT(buf);
 
             // if there is currently an overlay buffer on top of our buffer - abandon the memory
             // (leave it to the overlay buffer(s) that will eventually free() it), and allocate fresh memory
-            if (*overlay_count > 1) {
+            if (__atomic_load_n (overlay_count, __ATOMIC_ACQUIRE) > 1) {
 
-                abandoned_mem_current += buf->size;
-                abandoned_mem_high_watermark = MAX (abandoned_mem_high_watermark, abandoned_mem_current);
+                char *old_memory = buf->memory;
+                char *old_data   = buf->data;
+                uint64_t old_len = buf->len;
 
-                (*overlay_count)--; // overlaying buffers are now on their own - no regular buffer
                 buf->memory = buf->data = NULL;
                 buf->size = buf->len = 0;
                 buf_alloc_do (vb, buf, new_size, 1, func, code_line, name, param); // recursive call - simple alloc
           
-                // copy old data
+                // copy old data - before releasing our reference to it
                 memcpy (buf->data, old_data, old_size);
                 buf->len = old_len;
+
+                // overlaying buffers are now on their own - no regular buffer. if they were all released in the mean time - we free the memory
+                if (__atomic_sub_fetch (overlay_count, 1, __ATOMIC_ACQ_REL)) 
+                    buf_add_abandoned_mem (old_size);
+                else
+                    buf_low_level_free (old_memory, func, code_line);
             }
             else {
-                // buffer is overlayable - but no current overlayers - regular realloc - however,
-                // still within mutex to prevent another thread from overlaying while we're at it
+                // buffer is overlayable - but no current overlayers - regular realloc 
                 buf->memory = (char *)buf_low_level_realloc (buf->memory, new_size + overhead_size, func, code_line);
                 buf_init (buf, new_size, old_size, func, code_line, name, param);
             }
             buf->overlayable = true; // renew this, as it was reset by buf_init
-            pthread_mutex_unlock (&overlay_mutex);
         }
 
         else { // non-overlayable buffer - regular realloc without mutex
@@ -492,22 +529,38 @@ void buf_overlay_do (VBlock *vb, Buffer *overlaid_buf, Buffer *regular_buf, cons
     overlaid_buf->param       = param;
 
     // full buffer overlay - copy len too and update overlay counter
-    pthread_mutex_lock (&overlay_mutex);
-
     overlaid_buf->size = regular_buf->size;
     overlaid_buf->len  = regular_buf->len;
     overlaid_buf->data = regular_buf->data;
-    uint16_t *overlay_count = (uint16_t*)(regular_buf->data + regular_buf->size + sizeof(uint64_t));
-    (*overlay_count)++; // counter of users of this memory
 
-    pthread_mutex_unlock (&overlay_mutex);
+    __atomic_add_fetch (OVERLAY_COUNT(regular_buf), 1, __ATOMIC_ACQ_REL); // counter of users of this memory
+}
+
+// overlay a buffer on part of a memory-mapped file (see file_mmap). The caller may extend len, as long as it stays within the file
+void buf_overlay_mmap_do (VBlock *vb, Buffer *buf, char *data, uint64_t len, const char *func, uint32_t code_line,
+                          const char *name, uint32_t param)
+{
+    // if this buffer was used by a previous VB as a regular buffer - return its memory, as it is not needed now
+    if (buf->type == BUF_REGULAR && buf->data == NULL && buf->memory) {
+        buf_low_level_free (buf->memory, func, code_line);
+        buf_reset (buf);
+    }
+
+    ASSERT (buf->type == BUF_UNALLOCATED, "Error: cannot buf_overlay_mmap to a buffer %s already in use", buf_desc (buf));
+
+    buf->type      = BUF_MMAP;
+    buf->data      = data;
+    buf->len       = len;
+    buf->size      = 0; // no memory of its own - any buf_alloc copies the data 
+    buf->name      = name;
+    buf->param     = param;
+    buf->func      = func;
+    buf->code_line = code_line;
 }
 
 // free buffer - without freeing memory. A future buf_alloc of this buffer will reuse the memory if possible.
 void buf_free_do (Buffer *buf, const char *func, uint32_t code_line) 
 {
-    uint16_t *overlay_count; // number of buffers (overlay and regular) sharing buf->memory
-
     switch (buf->type) {
 
         case BUF_UNALLOCATED:
@@ -516,21 +569,17 @@ void buf_free_do (Buffer *buf, const char *func, uint32_t code_line)
         case BUF_REGULAR: 
 
             if (buf->overlayable) {
+                uint16_t *overlay_count = OVERLAY_COUNT(buf);
 
-                pthread_mutex_lock (&overlay_mutex);
-                overlay_count = (uint16_t*)(buf->data + buf->size + sizeof(uint64_t));
-
-                if (*overlay_count > 1) { // current overlays exist - abandon memory - leave it to the overlaid buffer(s) which will free() this memory when they're done with it
-                    (*overlay_count)--;
-             
-                    abandoned_mem_current += buf->size;
-                    abandoned_mem_high_watermark = MAX (abandoned_mem_high_watermark, abandoned_mem_current);
-
+                // release our reference. if current overlays exist - abandon memory - leave it to the overlaid buffer(s) 
+                // which will free() this memory when they're done with it
+                if (__atomic_sub_fetch (overlay_count, 1, __ATOMIC_ACQ_REL)) { 
+                    buf_add_abandoned_mem (buf->size);
                     buf_reset (buf);
                 }
                 // if no overlay exists then we just keep .memory and reuse it in future allocations
-
-                pthread_mutex_unlock (&overlay_mutex);            
+                else
+                    *overlay_count = 1; // no other buffer can see this memory now
             }
             
             buf->data = NULL; 
@@ -542,23 +591,21 @@ void buf_free_do (Buffer *buf, const char *func, uint32_t code_line)
             break;
 
         case BUF_OVERLAY:
-            pthread_mutex_lock (&overlay_mutex);
-            overlay_count = (uint16_t*)(buf->data + buf->size + sizeof(uint64_t));
-            (*overlay_count)--;
-            pthread_mutex_unlock (&overlay_mutex);            
-
-            // we are the last user - we can free the memory now.
-            // do this outside of the mutex - free is a system call and can take some time.
-            // this is safe because if we ever observe *overlay_count==0, it means that no buffer has this memory,
-            // therefore there is no possibility it would be subsequently overlayed between the test and the free().
-            if (! (*overlay_count)) {
+            // if we are the last user - we can free the memory now.
+            // this is safe because if we ever observe the counter reach 0, it means that no buffer has this memory,
+            // therefore there is no possibility it would be subsequently overlayed.
+            if (!__atomic_sub_fetch (OVERLAY_COUNT(buf), 1, __ATOMIC_ACQ_REL)) {
                 buf_low_level_free (buf->data - sizeof(uint64_t), func, code_line); // the original buf->memory
-                abandoned_mem_current -= buf->size;
+                buf_add_abandoned_mem (-(int64_t)buf->size);
             }
     
             buf_reset (buf);
             break;
 
+        case BUF_MMAP:
+            buf_reset (buf); // the mapping is released when the file is closed
+            break;
+
         default:
             ABORT0 ("Error: invalid buf->type");
     }
@@ -599,12 +646,7 @@ void buf_destroy_do (Buffer *buf, const char *func, uint32_t code_line)
 
     if (buf->memory) {
     
-        uint16_t overlay_count = 1;
-        if (buf->overlayable) {
-            pthread_mutex_lock (&overlay_mutex);
-            overlay_count = (*(uint16_t*)(buf->data + buf->size + sizeof(uint64_t)));
-            pthread_mutex_unlock (&overlay_mutex);            
-        }
+        uint16_t overlay_count = buf->overlayable ? __atomic_load_n (OVERLAY_COUNT(buf), __ATOMIC_ACQUIRE) : 1;
 
         ASSERT (overlay_count==1, "Error: cannot destroy buffer %s because it is currently overlaid", buf->name);
 
@@ -13,8 +13,8 @@
 
 struct variant_block_; 
 
-typedef enum {BUF_UNALLOCATED=0, BUF_REGULAR, BUF_OVERLAY} BufferType; // BUF_UNALLOCATED must be 0
-#define BUFTYPE_NAMES { "UNALLOCATED", "REGULAR", "OVERLAY" }
+typedef enum {BUF_UNALLOCATED=0, BUF_REGULAR, BUF_OVERLAY, BUF_MMAP} BufferType; // BUF_UNALLOCATED must be 0
+#define BUFTYPE_NAMES { "UNALLOCATED", "REGULAR", "OVERLAY", "MMAP" }
 
 typedef struct Buffer {
     BufferType type;
@@ -84,6 +84,11 @@ extern void buf_overlay_do (VBlockP vb, Buffer *overlaid_buf, Buffer *regular_bu
 #define buf_overlay(vb, overlaid_buf, regular_buf, name, param) \
     buf_overlay_do(vb, overlaid_buf, regular_buf, __FUNCTION__, __LINE__, name, param) 
 
+// a buffer overlaid on a memory-mapped file. It has no memory of its own (size=0), so buf_alloc copies its data to a regular buffer
+extern void buf_overlay_mmap_do (VBlockP vb, Buffer *buf, char *data, uint64_t len, const char *func, uint32_t code_line, const char *name, uint32_t param);
+#define buf_overlay_mmap(vb, buf, data, len, name, param) \
+    buf_overlay_mmap_do((VBlockP)(vb), (buf), (data), (len), __FUNCTION__, __LINE__, (name), (param))
+
 extern void buf_free_do (Buffer *buf, const char *func, uint32_t code_line);
 #define buf_free(buf) buf_free_do (buf, __FUNCTION__, __LINE__);
 
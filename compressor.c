@@ -7,6 +7,9 @@
 #include "lzma/LzmaEnc.h"
 #include "lzma/LzmaDec.h"
 #include "lzma/7zTypes.h"
+#define ZSTD_STATIC_LINKING_ONLY // for ZSTD_customMem
+#include "zstd/zstd.h"
+#include "zstd/zstd_errors.h"
 #include "genozip.h"
 #include "compressor.h"
 #include "vblock.h"
@@ -16,6 +19,9 @@
 #include "zfile.h"
 #include "file.h"
 #include "strings.h"
+#include "sections.h"
+#include "rans.h"
+#include "qual.h"
 
 // -----------------------------------------------------
 // memory functions that serve the compression libraries
@@ -23,7 +29,7 @@
 
 // memory management for bzlib - tesing shows that compress allocates 4 times, and decompress 2 times. Allocations are the same set of sizes
 // every call to compress/decompress with the same parameters, independent on the contents or size of the compressed/decompressed data.
-static void *comp_alloc (VBlock *vb, int size, double grow_at_least_factor)
+static void *comp_alloc (VBlock *vb, uint64_t size, double grow_at_least_factor)
 {
     // get the next buffer - allocations are always in the same order in bzlib and lzma -
     // so subsequent VBs will allocate roughly the same amount of memory for each buffer
@@ -60,7 +66,7 @@ static void comp_free_all (VBlock *vb)
 
 static void *comp_bzalloc (void *vb_, int items, int size)
 {
-    return comp_alloc ((VBlock *)vb_, items * size, 1); // all bzlib buffers are constant in size between subsequent compressions
+    return comp_alloc ((VBlock *)vb_, (uint64_t)items * size, 1); // all bzlib buffers are constant in size between subsequent compressions
 }
 
 static void comp_bzfree (void *vb_, void *addr)
@@ -79,6 +85,16 @@ static void lzma_free (ISzAllocPtr alloc_stuff, void *addr)
     comp_free ((VBlock *)alloc_stuff->vb, addr);
 }
 
+static void *zstd_alloc (void *vb, size_t size)
+{
+    return comp_alloc ((VBlock *)vb, size, 1); // zstd allocates its context, and then a single workspace sized by level and data length
+}
+
+static void zstd_free (void *vb, void *addr)
+{
+    comp_free ((VBlock *)vb, addr);
+}
+
 // -----------------------------------------------------
 // bzlib stuff
 // -----------------------------------------------------
@@ -374,6 +390,291 @@ bool comp_compress_lzma (VBlock *vb,
     return success;
 }
 
+// -----------------------------------------------------
+// zstd stuff
+// -----------------------------------------------------
+
+// --zstd: section types for which the user selected zstd instead of bzlib / lzma, and the level for each
+static struct { bool selected; int level; } zstd_by_sec_type[NUM_SEC_TYPES] = {};
+
+// called for each --zstd option. argument is "<level>[:<section type>,...]" where section types are as in --show-headers 
+// (case insensitive, SEC_ prefix optional), eg "--zstd 19:dict --zstd 1:b250,local". with no section types, applies to all sections
+void comp_set_zstd (const char *arg)
+{
+    int level, len;
+    ASSERT (sscanf (arg, "%d%n", &level, &len) == 1 && level >= ZSTD_minCLevel() && level <= ZSTD_maxCLevel() && 
+            (!arg[len] || (arg[len] == ':' && arg[len+1])), 
+            "%s: invalid argument of --zstd: %s. Expecting a level of up to %d (negative levels are faster), optionally followed by : and a comma-separated list of section types, eg 3:b250,local",
+            global_cmd, arg, ZSTD_maxCLevel());
+
+    // case: no section types - all sections
+    if (!arg[len]) {
+        for (SectionType st=0; st < NUM_SEC_TYPES; st++) {
+            zstd_by_sec_type[st].selected = true;
+            zstd_by_sec_type[st].level    = level;
+        }
+        return;
+    }
+
+    for (const char *name = &arg[len+1]; *name; ) {
+        unsigned name_len = strcspn (name, ",");
+        
+        char upper[64];
+        ASSERT (name_len < sizeof (upper), "%s: invalid argument of --zstd: %s. Section type name too long", global_cmd, arg);
+
+        for (unsigned i=0; i < name_len; i++) 
+            upper[i] = IS_SLETTER (name[i]) ? FLIP_CASE (name[i]) : name[i];
+        upper[name_len] = 0;
+
+        SectionType st;
+        for (st=0; st < NUM_SEC_TYPES; st++)
+            if (!strcmp (st_name (st), upper) || !strcmp (st_name (st) + 4, upper)) break; // with or without the SEC_ prefix
+        
+        ASSERT (st < NUM_SEC_TYPES, "%s: invalid argument of --zstd: %s. Unrecognized section type \"%.*s\". See --show-headers for section types", 
+                global_cmd, arg, name_len, name);
+
+        zstd_by_sec_type[st].selected = true;
+        zstd_by_sec_type[st].level    = level;
+
+        name += name_len + (name[name_len] == ',');
+    }
+}
+
+// the level with which sections of this type are compressed when they are compressed with zstd
+int comp_get_zstd_level (SectionType st)
+{
+    return zstd_by_sec_type[st].selected ? zstd_by_sec_type[st].level : COMP_ZSTD_DEFAULT_LEVEL;
+}
+
+// feeds data to a zstd stream. returns false if the output buffer is full
+static bool comp_zstd_stream (ZSTD_CCtx *cctx, ZSTD_outBuffer *out, const char *data, uint32_t data_len, ZSTD_EndDirective mode)
+{
+    ZSTD_inBuffer in = { .src = data, .size = data_len, .pos = 0 };
+
+    while (1) {
+        size_t remaining = ZSTD_compressStream2 (cctx, out, &in, mode);
+        ASSERT (!ZSTD_isError (remaining), "Error: ZSTD_compressStream2 failed: %s", ZSTD_getErrorName (remaining));
+
+        if (mode == ZSTD_e_end ? !remaining : in.pos == in.size) return true;
+        if (out->pos == out->size) return false; 
+    }
+}
+
+// returns true if successful and false if data_compressed_len is too small (but only if soft_fail is true)
+bool comp_compress_zstd (VBlock *vb, 
+                         const char *uncompressed, uint32_t uncompressed_len, // option 1 - compress contiguous data
+                         CompGetLineCallback callback,                        // option 2 - compress data one line at a tim
+                         char *compressed, uint32_t *compressed_len /* in/out */, 
+                         bool soft_fail)
+{
+    START_TIMER;
+
+    ZSTD_CCtx *cctx = ZSTD_createCCtx_advanced ((ZSTD_customMem){ .customAlloc = zstd_alloc, .customFree = zstd_free, .opaque = vb });
+    ASSERT0 (cctx, "Error: ZSTD_createCCtx_advanced failed");
+
+    size_t ret = ZSTD_CCtx_setParameter (cctx, ZSTD_c_compressionLevel, vb->zstd_level);
+    ASSERT (!ZSTD_isError (ret), "Error: ZSTD_CCtx_setParameter failed: %s", ZSTD_getErrorName (ret));
+
+    // size the window and tables for the actual data, rather than the maximum for the level
+    ret = ZSTD_CCtx_setPledgedSrcSize (cctx, uncompressed_len); 
+    ASSERT (!ZSTD_isError (ret), "Error: ZSTD_CCtx_setPledgedSrcSize failed: %s", ZSTD_getErrorName (ret));
+
+    bool success = true;
+
+    // option 1 - compress contiguous data
+    if (uncompressed) {
+        ret = ZSTD_compress2 (cctx, compressed, *compressed_len, uncompressed, uncompressed_len);
+
+        if (soft_fail && ZSTD_getErrorCode (ret) == ZSTD_error_dstSize_tooSmall) 
+            success = false; // data_compressed_len too small
+        else {
+            ASSERT (!ZSTD_isError (ret), "Error: ZSTD_compress2 failed: %s", ZSTD_getErrorName (ret));
+            *compressed_len = ret;
+        }
+    }
+
+    // option 2 - compress data one line at a time
+    else if (callback) {
+        ZSTD_outBuffer out = { .dst = compressed, .size = *compressed_len, .pos = 0 };
+
+        for (unsigned line_i=0; line_i < vb->lines.len && success; line_i++) {
+            char *start1, *start2;
+            uint32_t len1, len2;        
+            callback (vb, line_i, &start1, &len1, &start2, &len2);
+
+            success = comp_zstd_stream (cctx, &out, start1, len1, ZSTD_e_continue) &&
+                      comp_zstd_stream (cctx, &out, start2, len2, ZSTD_e_continue);
+        }
+
+        success = success && comp_zstd_stream (cctx, &out, NULL, 0, ZSTD_e_end);
+        ASSERT0 (success || soft_fail, "Error in comp_compress_zstd: compressed_len too small");
+
+        *compressed_len = out.pos;
+    }
+    else 
+        ABORT0 ("Error in comp_compress_zstd: neither src_data nor callback is provided");
+
+    ZSTD_freeCCtx (cctx);
+
+    COPY_TIMER(vb->profile.compressor);
+
+    return success;
+}
+
+// -----------------------------------------------------
+// rANS stuff
+// -----------------------------------------------------
+
+// returns true if successful and false if data_compressed_len is too small (but only if soft_fail is true)
+bool comp_compress_rans (VBlock *vb, 
+                         const char *uncompressed, uint32_t uncompressed_len, // option 1 - compress contiguous data
+                         CompGetLineCallback callback,                        // option 2 - compress data one line at a tim
+                         char *compressed, uint32_t *compressed_len /* in/out */, 
+                         bool soft_fail)
+{
+    START_TIMER;
+
+    // option 2 - rANS encodes the data backwards, so we first copy it to a contiguous buffer
+    char *copy = NULL;
+    if (callback) {
+        copy = comp_alloc (vb, uncompressed_len, 1);
+        ASSERT0 (comp_copy_callback_data (vb, callback, copy, uncompressed_len) == uncompressed_len, 
+                 "Error in comp_compress_rans: callback provided less data than expected");
+        uncompressed = copy;
+    }
+    else ASSERT0 (uncompressed, "Error in comp_compress_rans: neither src_data nor callback is provided");
+
+    void *workspace = comp_alloc (vb, rans_compress_workspace_size (uncompressed_len), 1);
+
+    uint32_t len = rans_compress ((const uint8_t *)uncompressed, uncompressed_len, (uint8_t *)compressed, *compressed_len, workspace);
+    ASSERT0 (len || soft_fail, "Error in comp_compress_rans: compressed_len too small");
+
+    if (len) *compressed_len = len;
+
+    comp_free (vb, workspace);
+    comp_free (vb, copy);
+
+    COPY_TIMER(vb->profile.compressor);
+
+    return len > 0;
+}
+
+// -----------------------------------------------------
+// quality strings stuff
+// -----------------------------------------------------
+
+// returns true if successful and false if data_compressed_len is too small (but only if soft_fail is true)
+bool comp_compress_qual (VBlock *vb, 
+                         const char *uncompressed, uint32_t uncompressed_len, // option 1 - compress contiguous data
+                         CompGetLineCallback callback,                        // option 2 - compress data one line at a tim
+                         char *compressed, uint32_t *compressed_len /* in/out */, 
+                         bool soft_fail)
+{
+    START_TIMER;
+
+    ASSERT0 (uncompressed || callback, "Error in comp_compress_qual: neither src_data nor callback is provided");
+
+    void *workspace = comp_alloc (vb, qual_workspace_size(), 1);
+
+    // note: the codec needs the line structure, so with a callback, it gets the data one line at a time
+    uint32_t len = qual_compress (vb, (const uint8_t *)uncompressed, uncompressed_len, callback, (uint8_t *)compressed, *compressed_len, workspace);
+    ASSERT0 (len || soft_fail, "Error in comp_compress_qual: compressed_len too small");
+
+    if (len) *compressed_len = len;
+
+    comp_free (vb, workspace);
+
+    COPY_TIMER(vb->profile.compressor);
+
+    return len > 0;
+}
+
+// -----------------------------------------------------
+// codec selection (--codec-policy)
+// -----------------------------------------------------
+
+static enum { CODEC_POLICY_NONE, CODEC_POLICY_RATIO, CODEC_POLICY_SPEED } codec_policy = CODEC_POLICY_NONE;
+
+void comp_set_codec_policy (const char *arg)
+{
+    if      (!strcmp (arg, "ratio")) codec_policy = CODEC_POLICY_RATIO;
+    else if (!strcmp (arg, "speed")) codec_policy = CODEC_POLICY_SPEED;
+    else ABORT ("%s: invalid argument of --codec-policy: %s. Expecting ratio or speed", global_cmd, arg);
+}
+
+bool comp_has_codec_policy (void) { return codec_policy != CODEC_POLICY_NONE; }
+
+#define CODEC_TRIAL_LEN 100000         // we trial the codecs on the first (up to) this many bytes of the data
+#define CODEC_SPEED_SIZE_TOLERANCE 1.1 // --codec-policy=speed: a faster-decompressing codec wins if its output is at most 10% larger than the smallest
+
+// copies the data of the first lines, as provided by a callback, to a contiguous buffer. returns the number of bytes copied.
+uint32_t comp_copy_callback_data (VBlock *vb, CompGetLineCallback callback, char *dst, uint32_t max_len)
+{
+    uint32_t next = 0;
+    for (uint32_t line_i=0; line_i < vb->lines.len && next < max_len; line_i++) {
+        char *start1, *start2;
+        uint32_t len1, len2;        
+        callback (vb, line_i, &start1, &len1, &start2, &len2);
+
+        len1 = MIN (len1, max_len - next);
+        memcpy (&dst[next], start1, len1);
+        next += len1;
+
+        len2 = MIN (len2, max_len - next);
+        memcpy (&dst[next], start2, len2);
+        next += len2;
+    }
+
+    return next;
+}
+
+// returns the best codec for the data according to --codec-policy: ratio - the smallest output ; speed - the fastest to 
+// decompress whose output is not much larger than the smallest. the codecs are trialed on a sample of the data.
+CompressionAlg comp_get_best_alg (VBlock *vb, 
+                                  const char *data, uint32_t data_len, // option 1 - contiguous data
+                                  CompGetLineCallback callback)        // option 2 - data one line at a time
+{
+    // in order of decompression speed, fastest first
+    static const struct { CompressionAlg alg; Compressor compress; } codecs[] = 
+        { { COMP_PLN, comp_compress_none }, { COMP_ZSTD, comp_compress_zstd }, { COMP_RANS, comp_compress_rans }, 
+          { COMP_LZMA, comp_compress_lzma }, { COMP_BZ2, comp_compress_bzlib } };
+    #define NUM_TRIAL_CODECS (sizeof(codecs) / sizeof(codecs[0]))
+
+    // note: vb->compressed is not in use while compressing the ctx sections. it holds the sample (option 2) followed by the compressed output
+    Buffer *buf = &vb->compressed;
+    buf_alloc (vb, buf, 3 * CODEC_TRIAL_LEN + 1000, 1, "compressed", 0); // compressed output might be a bit larger than the sample
+    
+    uint32_t sample_len = MIN (data_len, CODEC_TRIAL_LEN);
+
+    // option 2 - copy the first lines to a contiguous sample
+    if (callback) {
+        sample_len = comp_copy_callback_data (vb, callback, buf->data, sample_len);
+        data       = buf->data;
+    }
+
+    char *compressed = &buf->data[callback ? sample_len : 0];
+    uint32_t comp_len[NUM_TRIAL_CODECS], min_comp_len = 0xffffffff;
+
+    vb->zstd_level = COMP_ZSTD_DEFAULT_LEVEL;
+
+    for (unsigned i=0; i < NUM_TRIAL_CODECS; i++) {
+        comp_len[i] = buf->size - (compressed - buf->data);
+        codecs[i].compress (vb, data, sample_len, NULL, compressed, &comp_len[i], false);
+        comp_free_all (vb);
+
+        min_comp_len = MIN (min_comp_len, comp_len[i]);
+    }
+
+    CompressionAlg best_alg = COMP_UNKNOWN;
+    for (unsigned i=0; i < NUM_TRIAL_CODECS && best_alg == COMP_UNKNOWN; i++) 
+        if (codec_policy == CODEC_POLICY_RATIO ? comp_len[i] == min_comp_len : comp_len[i] <= min_comp_len * CODEC_SPEED_SIZE_TOLERANCE)
+            best_alg = codecs[i].alg;
+
+    buf_free (buf);
+
+    return best_alg;
+}
+
 // -----------------------------------------------------
 // plain (no compression) stuff
 // -----------------------------------------------------
@@ -415,7 +716,61 @@ bool comp_error (VBlock *vb, const char *uncompressed, uint32_t uncompressed_len
     return false;
 }
 
-#define MIN_LEN_FOR_COMPRESSION 90 // less that this size, and compressed size is typically larger than uncompressed size
+static Compressor compressors[NUM_COMPRESSION_ALGS] = { 
+    comp_compress_none, comp_error, comp_compress_bzlib, comp_error, comp_error, comp_error, comp_error, comp_compress_lzma, comp_error,
+    comp_compress_zstd, comp_compress_rans, comp_compress_qual };
+
+// returns the codec with which a section is compressed, given the codec requested for it
+static CompressionAlg comp_get_effective_alg (VBlock *vb, SectionType st, CompressionAlg alg)
+{
+    // if the user requested --fast - we always use BZLIB, never LZMA
+    if (flag_fast && alg == COMP_LZMA) alg = COMP_BZ2;
+
+    // if the user requested --zstd for this section type, it overrides bzlib / lzma (but not deliberately uncompressed sections,
+    // nor quality strings, which have a dedicated codec)
+    if (zstd_by_sec_type[st].selected && alg != COMP_PLN && alg != COMP_QUAL) alg = COMP_ZSTD;
+
+    if (alg == COMP_ZSTD) // selected by --zstd or --codec-policy
+        vb->zstd_level = comp_get_zstd_level (st);
+
+    ASSERT (alg < NUM_COMPRESSION_ALGS, "Error in comp_get_effective_alg: unsupported section compressor=%u", alg);
+
+    return alg;
+}
+
+// compresses data, as comp_compress would compress a section of this type requested to be compressed with alg, to a 
+// scratch area. returns the compressed length. used to trial codecs.
+uint32_t comp_trial_compress (VBlock *vb, SectionType st, CompressionAlg alg, 
+                              const char *data, uint32_t data_len, // option 1 - contiguous data
+                              CompGetLineCallback callback,        // option 2 - data one line at a time
+                              char *compressed, uint32_t compressed_size)
+{
+    uint32_t compressed_len = compressed_size;
+    compressors[comp_get_effective_alg (vb, st, alg)] (vb, data, data_len, callback, compressed, &compressed_len, false);
+    comp_free_all (vb);
+
+    return compressed_len;
+}
+
+// compresses the data of a section with each of two codecs, and returns the one whose output is smaller - alg1 if they are equal
+CompressionAlg comp_get_smaller_alg (VBlock *vb, SectionType st, CompressionAlg alg1, CompressionAlg alg2,
+                                     const char *data, uint32_t data_len, // option 1 - contiguous data
+                                     CompGetLineCallback callback)        // option 2 - data one line at a time
+{
+    if (data_len < MIN_LEN_FOR_COMPRESSION) return alg1; // comp_compress won't compress it anyway
+
+    // note: vb->compressed is not in use while compressing the ctx sections
+    Buffer *buf = &vb->compressed;
+    uint32_t compressed_size = data_len + data_len / 2 + 1000; // more than the worst case of any codec
+    buf_alloc (vb, buf, compressed_size, 1, "compressed", 0);
+
+    uint32_t len1 = comp_trial_compress (vb, st, alg1, data, data_len, callback, buf->data, compressed_size);
+    uint32_t len2 = comp_trial_compress (vb, st, alg2, data, data_len, callback, buf->data, compressed_size);
+
+    buf_free (buf);
+
+    return len1 <= len2 ? alg1 : alg2;
+}
 
 // compresses data - either a conitguous block or one line at a time. If both are NULL that there is no data to compress.
 void comp_compress (VBlock *vb, Buffer *z_data, bool is_z_file_buf,
@@ -425,14 +780,7 @@ void comp_compress (VBlock *vb, Buffer *z_data, bool is_z_file_buf,
 { 
     ASSERT0 (!uncompressed_data || !callback, "Error in comp_compress: expecting either uncompressed_data or callback but not both");
 
-    // if the user requested --fast - we always use BZLIB, never LZMA
-    if (flag_fast && header->sec_compression_alg == COMP_LZMA)
-        header->sec_compression_alg = COMP_BZ2;
-
-    static Compressor compressors[NUM_COMPRESSION_ALGS] = { 
-        comp_compress_none, comp_error, comp_compress_bzlib, comp_error, comp_error, comp_error, comp_error, comp_compress_lzma, comp_error };
-
-    ASSERT (header->sec_compression_alg < NUM_COMPRESSION_ALGS, "Error in comp_compress: unsupported section compressor=%u", header->sec_compression_alg);
+    header->sec_compression_alg = comp_get_effective_alg (vb, header->section_type, header->sec_compression_alg);
 
     unsigned compressed_offset     = BGEN32 (header->compressed_offset);
     unsigned data_uncompressed_len = BGEN32 (header->data_uncompressed_len);
@@ -528,8 +876,9 @@ void comp_compress (VBlock *vb, Buffer *z_data, bool is_z_file_buf,
     else
         total_z_len = compressed_offset + data_compressed_len;
 
-    // add section to the list - except for genozip header which we already added in zfile_compress_genozip_header()
-    if (header->section_type != SEC_GENOZIP_HEADER)
+    // add section to the list - except for genozip header which we already added in zfile_compress_genozip_header(),
+    // and dictionaries that are added by zfile_append_dictionary_data() when appended to z_file->dict_data
+    if (header->section_type != SEC_GENOZIP_HEADER && header->section_type != SEC_DICT)
         sections_add_to_list (vb, header);
 
     z_data->len += total_z_len;
@@ -580,6 +929,27 @@ void comp_uncompress (VBlock *vb, CompressionAlg alg,
 
         break;
     }
+    case COMP_ZSTD: {
+        ZSTD_DCtx *dctx = ZSTD_createDCtx_advanced ((ZSTD_customMem){ .customAlloc = zstd_alloc, .customFree = zstd_free, .opaque = vb });
+        ASSERT0 (dctx, "Error: ZSTD_createDCtx_advanced failed");
+
+        size_t ret = ZSTD_decompressDCtx (dctx, uncompressed->data, uncompressed->len, compressed, compressed_len);
+        ASSERT (!ZSTD_isError (ret) && ret == uncompressed->len, "Error: ZSTD_decompressDCtx failed: %s (uncompressed %u bytes, expecting %u)", 
+                ZSTD_isError (ret) ? ZSTD_getErrorName (ret) : "OK", ZSTD_isError (ret) ? 0 : (unsigned)ret, (unsigned)uncompressed->len);
+
+        ZSTD_freeDCtx (dctx);
+        break;
+    }
+    case COMP_RANS: {
+        void *workspace = comp_alloc (vb, rans_uncompress_workspace_size(), 1);
+        rans_uncompress ((const uint8_t *)compressed, compressed_len, (uint8_t *)uncompressed->data, uncompressed->len, workspace);
+        break;
+    }
+    case COMP_QUAL: {
+        void *workspace = comp_alloc (vb, qual_workspace_size(), 1);
+        qual_uncompress ((const uint8_t *)compressed, compressed_len, (uint8_t *)uncompressed->data, uncompressed->len, workspace);
+        break;
+    }
     case COMP_PLN:
         memcpy (uncompressed->data, compressed, compressed_len);
         break;
@@ -32,6 +32,23 @@ typedef bool CompressorFunc (VBlockP vb,
                              bool soft_fail);
 typedef CompressorFunc (*Compressor);
 
-CompressorFunc comp_compress_bzlib, comp_compress_lzma, comp_compress_none;
+CompressorFunc comp_compress_bzlib, comp_compress_lzma, comp_compress_zstd, comp_compress_rans, comp_compress_qual, comp_compress_none;
+
+extern void comp_set_zstd (const char *arg);
+extern int comp_get_zstd_level (SectionType st);
+
+#define MIN_LEN_FOR_COMPRESSION 90 // less that this size, and compressed size is typically larger than uncompressed size
+
+// zstd level used when zstd is selected by --codec-policy. zstd decompression speed is the same for all levels, so we use the best ratio
+#define COMP_ZSTD_DEFAULT_LEVEL 19
+
+extern void comp_set_codec_policy (const char *arg);
+extern bool comp_has_codec_policy (void);
+extern CompressionAlg comp_get_best_alg (VBlockP vb, const char *data, uint32_t data_len, CompGetLineCallback callback);
+extern uint32_t comp_copy_callback_data (VBlockP vb, CompGetLineCallback callback, char *dst, uint32_t max_len);
+extern uint32_t comp_trial_compress (VBlockP vb, SectionType st, CompressionAlg alg, const char *data, uint32_t data_len, 
+                                     CompGetLineCallback callback, char *compressed, uint32_t compressed_size);
+extern CompressionAlg comp_get_smaller_alg (VBlockP vb, SectionType st, CompressionAlg alg1, CompressionAlg alg2,
+                                            const char *data, uint32_t data_len, CompGetLineCallback callback);
 
 #endif
\ No newline at end of file
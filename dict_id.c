@@ -233,15 +233,15 @@ Buffer *dict_id_create_aliases_buf (void)
 // PIZ I/O thread: read all dict_id aliaeses, if there are any
 void dict_id_read_aliases (void) 
 { 
-    // we just finished reading all the dictionaries, so the sl_dir_cursor should be pointing to our section (+1)
-    SectionListEntry *sl_ent = ENT (SectionListEntry, z_file->section_list_buf, z_file->sl_dir_cursor - 1);
-
-    if (sl_ent->section_type != SEC_DICT_ID_ALIASES) return;
+    // note: we look the section up rather than rely on sl_dir_cursor, as dictionary reading might stop before the 
+    // last dictionary (--regions) or not read them at all (DICTREAD_LAZY)
+    SectionListEntry *sl_ent = sections_get_offset_first_section_of_type (SEC_DICT_ID_ALIASES, true);
+    if (!sl_ent) return;
 
     static Buffer compressed_aliases = EMPTY_BUFFER;
 
     zfile_read_section (evb, 0, NO_SB_I, &dict_id_aliases_buf, "dict_id_aliases_buf", 
-                        sizeof(SectionHeader), SEC_DICT_ID_ALIASES, NULL);    
+                        sizeof(SectionHeader), SEC_DICT_ID_ALIASES, sl_ent);    
 
     SectionHeader *header = (SectionHeader *)dict_id_aliases_buf.data;
     zfile_uncompress_section (evb, header, &dict_id_aliases_buf, "dict_id_aliases_buf", SEC_DICT_ID_ALIASES);
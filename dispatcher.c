@@ -20,25 +20,60 @@
 #include "file.h"
 #include "profiler.h"
 
+// a unit of work - one VB to be computed. Tasks live in a reorder ring, in the order they were dispatched,
+// so that the I/O thread can collect them in order, regardless of the order in which workers complete them
 typedef struct {
-    pthread_t thread_id;
     VBlock *vb;
     void (*func)(VBlock *);
-} Thread;
-
+    bool is_done;                  // set by the worker when func returns. protected by pool_mutex
+} Task;
+
+// a part of the computation of a VB, that the compute thread of the VB hands to the pool (see dispatcher_run_subtasks)
+typedef struct SubTask {
+    void (*func)(void *);
+    void *arg;
+    bool is_done;                  // protected by pool_mutex
+    struct SubTask *next;          // next in the queue of unclaimed subtasks
+} SubTask;
+
+// a persistent compute thread with its own deque of tasks (indices into the task ring). a worker serves its own 
+// deque first, and if it is empty, it steals from the deques of the other workers
 typedef struct {
+    pthread_t thread_id;
+    unsigned worker_i;
+    struct DispatcherData *dd;
+
+    pthread_mutex_t deque_mutex;
+    unsigned *deque;               // circular array of task indices, of length max_vbs_in_flight
+    unsigned deque_first, deque_len;
+} Worker;
+
+typedef struct DispatcherData {
     unsigned max_vb_id_so_far; 
-    Buffer compute_threads_buf;
-    Thread *compute_threads;
     VBlock *next_vb; // next vb to be dispatched
     VBlock *processed_vb; // last vb for which caller got the processing results
 
     bool input_exhausted;
 
-    unsigned next_thread_to_dispatched;
-    unsigned next_thread_to_be_joined;
-
-    unsigned num_running_compute_threads;
+    // compute pool
+    Buffer tasks_buf;              // reorder ring of max_vbs_in_flight Task entries
+    Buffer workers_buf;            // max_threads Worker entries
+    Buffer deques_buf;             // memory for the workers' deques
+    pthread_mutex_t pool_mutex;    // protects num_queued_tasks, subtasks, shutdown and Task.is_done, SubTask.is_done
+    pthread_cond_t work_cond;      // signaled when a task or subtask is queued or on shutdown
+    pthread_cond_t done_cond;      // signaled when a task or subtask is done
+    unsigned num_queued_tasks;     // number of tasks in deques not yet claimed by a worker
+    SubTask *first_subtask, *last_subtask; // queue of subtasks not yet claimed by a worker or by the thread that queued them
+    bool shutdown;
+    unsigned num_workers;
+
+    unsigned next_task_to_dispatch; // monotonically increasing - the ring index is modulo max_vbs_in_flight
+    unsigned next_task_to_collect; 
+    unsigned next_worker_to_push;
+
+    unsigned num_vbs_in_flight;    // number of VBs dispatched and not yet collected - queued, being computed or done
+    unsigned max_vbs_in_flight;    // size of the reorder window. it is larger than the number of workers, so that workers 
+                                   // don't idle while the I/O thread waits for a slow VB that is ahead of them in the output order
     unsigned next_vb_i;
     unsigned max_threads;
     bool test_mode;
@@ -53,6 +88,8 @@ typedef struct {
     const char *filename;
 } DispatcherData;
 
+static DispatcherData *pool_dd = NULL; // the dispatcher whose workers are running, if any
+
 static TimeSpecType profiler_timer; // wallclock
 static bool ever_time_initialized = false;
 static TimeSpecType ever_time;
@@ -143,7 +180,7 @@ static void dispatcher_show_progress (Dispatcher dispatcher)
     // case: genozip of plain txt files (including if decompressed by an external compressor) 
     // - we go by the amount of txt content processed 
     if (command == ZIP && txt_file->disk_size && file_is_plain_or_ext_decompressor (txt_file)) { 
-        total = txt_file->txt_data_size_single; // if its a physical plain VCF file - this is the file size. if not - its an estimate done after the first VB
+        total = txt_file->txt_data_size_single; // if its a physical plain VCF file - this is the file size. if not - its an estimate done when reading the first VB
         sofar = z_file->txt_data_so_far_single;
     } 
     
@@ -214,6 +251,136 @@ static void dispatcher_show_progress (Dispatcher dispatcher)
     dd->last_seconds_so_far = seconds_so_far;
 }
 
+// returns the index of the oldest task in the deque of worker, or -1 if its empty
+static int dispatcher_pop_task (Worker *worker)
+{
+    int task_i = -1;
+
+    pthread_mutex_lock (&worker->deque_mutex);
+
+    if (worker->deque_len) {
+        task_i = worker->deque[worker->deque_first];
+        worker->deque_first = (worker->deque_first + 1) % worker->dd->max_vbs_in_flight;
+        worker->deque_len--;
+    }
+
+    pthread_mutex_unlock (&worker->deque_mutex);
+
+    return task_i;
+}
+
+static void dispatcher_push_task (Worker *worker, unsigned task_i)
+{
+    pthread_mutex_lock (&worker->deque_mutex);
+
+    ASSERT (worker->deque_len < worker->dd->max_vbs_in_flight, "Error in dispatcher_push_task: deque of worker %u is full", worker->worker_i);
+    worker->deque[(worker->deque_first + worker->deque_len) % worker->dd->max_vbs_in_flight] = task_i;
+    worker->deque_len++;
+
+    pthread_mutex_unlock (&worker->deque_mutex);
+}
+
+static void *dispatcher_worker_entry (void *worker_)
+{
+    Worker *worker = (Worker *)worker_;
+    DispatcherData *dd = worker->dd;
+    Worker *workers = (Worker *)dd->workers_buf.data;
+
+    while (1) {
+        // wait for a task to be queued, and claim it. after claiming, it is guaranteed that there is a task for us in one of the deques
+        pthread_mutex_lock (&dd->pool_mutex);
+        while (!dd->num_queued_tasks && !dd->first_subtask && !dd->shutdown) 
+            pthread_cond_wait (&dd->work_cond, &dd->pool_mutex);
+
+        if (dd->shutdown) {
+            pthread_mutex_unlock (&dd->pool_mutex);
+            return NULL;
+        }
+
+        // subtasks first - a compute thread is waiting for them
+        if (dd->first_subtask) {
+            SubTask *subtask = dd->first_subtask;
+            dd->first_subtask = subtask->next;
+            if (!dd->first_subtask) dd->last_subtask = NULL;
+            pthread_mutex_unlock (&dd->pool_mutex);
+
+            subtask->func (subtask->arg);
+
+            pthread_mutex_lock (&dd->pool_mutex);
+            subtask->is_done = true;
+            pthread_cond_broadcast (&dd->done_cond);
+            pthread_mutex_unlock (&dd->pool_mutex);
+            continue;
+        }
+
+        dd->num_queued_tasks--;
+        pthread_mutex_unlock (&dd->pool_mutex);
+
+        // our own deque first, then steal from the others. note: unlike the classic scheme in which thieves
+        // take from the opposite end, we always take the oldest task, because the output is written in VB order
+        int task_i = -1;
+        for (unsigned i=0; task_i < 0; i = (i+1) % dd->num_workers) 
+            task_i = dispatcher_pop_task (&workers[(worker->worker_i + i) % dd->num_workers]);
+
+        Task *task = ENT (Task, dd->tasks_buf, task_i);
+        task->func (task->vb);
+
+        pthread_mutex_lock (&dd->pool_mutex);
+        task->is_done = true;
+        pthread_cond_broadcast (&dd->done_cond);
+        pthread_mutex_unlock (&dd->pool_mutex);
+    }
+}
+
+// the worker threads persist for the lifetime of the dispatcher, and compute all its VBs
+static void dispatcher_create_workers (DispatcherData *dd)
+{
+    pthread_mutex_init (&dd->pool_mutex, NULL);
+    pthread_cond_init (&dd->work_cond, NULL);
+    pthread_cond_init (&dd->done_cond, NULL);
+
+    dd->num_workers = dd->max_threads;
+
+    buf_alloc (evb, &dd->workers_buf, sizeof(Worker) * dd->num_workers, 1, "workers_buf", 0);
+    buf_zero (&dd->workers_buf);
+
+    buf_alloc (evb, &dd->deques_buf, sizeof(unsigned) * dd->num_workers * dd->max_vbs_in_flight, 1, "deques_buf", 0);
+
+    for (unsigned i=0; i < dd->num_workers; i++) {
+        Worker *worker = ENT (Worker, dd->workers_buf, i);
+        worker->worker_i = i;
+        worker->dd       = dd;
+        worker->deque    = ENT (unsigned, dd->deques_buf, i * dd->max_vbs_in_flight);
+        pthread_mutex_init (&worker->deque_mutex, NULL);
+
+        unsigned err = pthread_create (&worker->thread_id, NULL, dispatcher_worker_entry, worker);
+        ASSERT (!err, "Error: failed to create compute thread %u, err=%u", i, err);
+    }
+
+    pool_dd = dd;
+}
+
+static void dispatcher_destroy_workers (DispatcherData *dd)
+{
+    pthread_mutex_lock (&dd->pool_mutex);
+    dd->shutdown = true;
+    pthread_cond_broadcast (&dd->work_cond);
+    pthread_mutex_unlock (&dd->pool_mutex);
+
+    for (unsigned i=0; i < dd->num_workers; i++) {
+        Worker *worker = ENT (Worker, dd->workers_buf, i);
+        pthread_join (worker->thread_id, NULL);
+        pthread_mutex_destroy (&worker->deque_mutex);
+    }
+
+    pthread_cond_destroy (&dd->done_cond);
+    pthread_cond_destroy (&dd->work_cond);
+    pthread_mutex_destroy (&dd->pool_mutex);
+
+    dd->num_workers = 0;
+    pool_dd = NULL;
+}
+
 Dispatcher dispatcher_init (unsigned max_threads, unsigned previous_vb_i,
                             bool test_mode, bool is_last_file, const char *filename)
 {
@@ -236,10 +403,15 @@ Dispatcher dispatcher_init (unsigned max_threads, unsigned previous_vb_i,
     dd->show_progress = !flag_quiet && !!isatty(2);
     dd->filename      = filename;
 
-    vb_create_pool (MAX (2,max_threads+1 /* one for evb */));
+    // with a single thread, the I/O thread computes each VB as it is dispatched
+    dd->max_vbs_in_flight = (max_threads > 1) ? MAX (global_max_vbs_in_flight, max_threads) : 1;
+
+    vb_create_pool (dd->max_vbs_in_flight + 1 /* one for the VB being read while the window is full */);
 
-    buf_alloc (evb, &dd->compute_threads_buf, sizeof(Thread) * MAX (1, max_threads), 1, "compute_threads_buf", 0);
-    dd->compute_threads = (Thread *)dd->compute_threads_buf.data;
+    buf_alloc (evb, &dd->tasks_buf, sizeof(Task) * dd->max_vbs_in_flight, 1, "tasks_buf", 0);
+    buf_zero (&dd->tasks_buf);
+
+    if (max_threads > 1) dispatcher_create_workers (dd);
 
     if (!flag_split) dispatcher_show_start (dd); // note: for flag_split, we print this in dispatcher_resume() 
 
@@ -281,7 +453,12 @@ void dispatcher_finish (Dispatcher *dispatcher, unsigned *last_vb_i)
     // must be before vb_cleanup_memory() 
     if (flag_show_memory) buf_display_memory_usage (false, dd->max_threads, dd->max_vb_id_so_far);    
 
-    buf_destroy (&dd->compute_threads_buf); // we need to destroy (not marely free) because we are about to free dd
+    if (dd->num_workers) dispatcher_destroy_workers (dd);
+
+    // we need to destroy (not marely free) because we are about to free dd
+    buf_destroy (&dd->tasks_buf); 
+    buf_destroy (&dd->workers_buf); 
+    buf_destroy (&dd->deques_buf); 
 
     // free memory allocations that assume subsequent files will have the same number of samples.
     // (we assume this if the files are being concatenated). don't bother freeing (=same time) if this is the last file
@@ -297,15 +474,6 @@ void dispatcher_finish (Dispatcher *dispatcher, unsigned *last_vb_i)
     *dispatcher = NULL;
 }
 
-static void *dispatcher_thread_entry (void *thread_)
-{
-    Thread *th = (Thread *)thread_;
-
-    th->func (th->vb);
-    
-    return NULL;
-}
-
 VBlock *dispatcher_generate_next_vb (Dispatcher dispatcher, uint32_t vb_i)
 {
     DispatcherData *dd = (DispatcherData *)dispatcher;
@@ -320,72 +488,156 @@ VBlock *dispatcher_generate_next_vb (Dispatcher dispatcher, uint32_t vb_i)
     return dd->next_vb;
 }
 
+// note: up to max_vbs_in_flight VBs may be queued or computing, more than there are workers. Some tasks wait for 
+// an earlier VB (BGZF carry-over and MD5, order of dictionary fragments) - such a task is never starved of a worker: 
+// tasks are pushed in VB order, and a worker serves its own deque oldest-first and steals only when it is empty, so
+// the oldest unclaimed task is always in the deque of a worker that is computing an older task, or is idle
 void dispatcher_compute (Dispatcher dispatcher, void (*func)(VBlockP))
 {
     DispatcherData *dd = (DispatcherData *)dispatcher;
-    Thread *th = &dd->compute_threads[dd->next_thread_to_dispatched];
+    unsigned task_i = dd->next_task_to_dispatch % dd->max_vbs_in_flight;
+    Task *task = ENT (Task, dd->tasks_buf, task_i);
 
-    th->vb = dd->next_vb;
-    th->func = func;
+    task->vb      = dd->next_vb;
+    task->func    = func;
+    task->is_done = false;
 
-    if (flag_show_threads) dispatcher_show_time ("Start compute", dd->next_thread_to_dispatched, th->vb->vblock_i);
+    if (flag_show_threads) dispatcher_show_time ("Start compute", task_i, task->vb->vblock_i);
 
-    if (dd->max_threads > 1) {
-        unsigned err = pthread_create(&th->thread_id, NULL, dispatcher_thread_entry, th);
-        ASSERT (!err, "Error: failed to create thread for next_vb_i=%u, err=%u", dd->next_vb->vblock_i, err);
+    if (dd->num_workers) {
+        dispatcher_push_task (ENT (Worker, dd->workers_buf, dd->next_worker_to_push), task_i);
+        dd->next_worker_to_push = (dd->next_worker_to_push + 1) % dd->num_workers;
 
-        dd->next_thread_to_dispatched = (dd->next_thread_to_dispatched + 1) % dd->max_threads;
+        pthread_mutex_lock (&dd->pool_mutex);
+        dd->num_queued_tasks++;
+        pthread_cond_signal (&dd->work_cond);
+        pthread_mutex_unlock (&dd->pool_mutex);
+    }
+    else {
+        func (dd->next_vb); // single thread
+        task->is_done = true;
     }
-    else func(dd->next_vb); // single thread
                     
+    dd->next_task_to_dispatch++;
     dd->next_vb = NULL;
-    dd->num_running_compute_threads++;
+    dd->num_vbs_in_flight++;
+}
+
+// called by a compute thread, or by the I/O thread, to run func on each of num_subtasks args (of size arg_size each), 
+// concurrently on the workers of the pool, returning after all are done. The first subtask is run by the calling thread. While waiting, the 
+// calling thread runs its own subtasks not yet claimed by a worker - so they complete even if all workers are busy.
+// Subtasks must not wait for other VBs.
+void dispatcher_run_subtasks (void (*func)(void *), void *args, unsigned arg_size, unsigned num_subtasks)
+{
+    DispatcherData *dd = pool_dd;
+
+    if (!dd || num_subtasks == 1) { // single thread
+        for (unsigned i=0; i < num_subtasks; i++) func ((char *)args + i * arg_size);
+        return;
+    }
+
+    ASSERT (num_subtasks <= MAX_SUBTASKS, "Error in dispatcher_run_subtasks: num_subtasks=%u exceeds %u", num_subtasks, MAX_SUBTASKS);
+    
+    SubTask subtasks[MAX_SUBTASKS];
+    for (unsigned i=1; i < num_subtasks; i++)
+        subtasks[i] = (SubTask){ .func = func, .arg = (char *)args + i * arg_size, 
+                                 .next = (i < num_subtasks-1) ? &subtasks[i+1] : NULL };
+
+    pthread_mutex_lock (&dd->pool_mutex);
+    if (dd->last_subtask) dd->last_subtask->next = &subtasks[1];
+    else                  dd->first_subtask      = &subtasks[1];
+    dd->last_subtask = &subtasks[num_subtasks-1];
+    pthread_cond_broadcast (&dd->work_cond);
+    pthread_mutex_unlock (&dd->pool_mutex);
+
+    func (args);
+
+    // run our subtasks not yet claimed by a worker - removing them from the queue
+    pthread_mutex_lock (&dd->pool_mutex);
+    for (unsigned i=1; i < num_subtasks; i++) {
+        SubTask *prev = NULL, *st = dd->first_subtask;
+        while (st && st != &subtasks[i]) { prev = st; st = st->next; }
+
+        if (!st) continue; // claimed by a worker
+
+        if (prev) prev->next = st->next;
+        else      dd->first_subtask = st->next;
+        if (dd->last_subtask == st) dd->last_subtask = prev;
+        pthread_mutex_unlock (&dd->pool_mutex);
+
+        func (st->arg);
+
+        pthread_mutex_lock (&dd->pool_mutex);
+        st->is_done = true;
+    }
+
+    // wait for the subtasks claimed by workers to complete
+    for (unsigned i=1; i < num_subtasks; i++) 
+        while (!subtasks[i].is_done)
+            pthread_cond_wait (&dd->done_cond, &dd->pool_mutex);
+
+    pthread_mutex_unlock (&dd->pool_mutex);
 }
 
 bool dispatcher_has_processed_vb (Dispatcher dispatcher, bool *is_final) 
 {
     DispatcherData *dd = (DispatcherData *)dispatcher;
 
-    if (!dd->num_running_compute_threads) return false; // no running compute threads 
+    if (!dd->num_vbs_in_flight) return false; // no VBs dispatched
 
-    Thread *th = &dd->compute_threads[dd->next_thread_to_be_joined];
+    Task *task = ENT (Task, dd->tasks_buf, dd->next_task_to_collect % dd->max_vbs_in_flight);
 
-    bool my_is_final = dd->input_exhausted && !dd->next_vb && dd->num_running_compute_threads == 1; // this is the last vb to be processed
+    bool my_is_final = dd->input_exhausted && !dd->next_vb && dd->num_vbs_in_flight == 1; // this is the last vb to be processed
 
     if (is_final) *is_final = my_is_final;
 
-    return my_is_final || (th->vb && th->vb->is_processed);
+    if (my_is_final) return true;
+
+    if (!dd->num_workers) return task->is_done;
+
+    pthread_mutex_lock (&dd->pool_mutex);
+    bool is_done = task->is_done;
+    pthread_mutex_unlock (&dd->pool_mutex);
+
+    return is_done;
 }
 
+// returns the processed VBs in the order they were dispatched, blocking until the next one is done
 VBlock *dispatcher_get_processed_vb (Dispatcher dispatcher, bool *is_final)
 {
     DispatcherData *dd = (DispatcherData *)dispatcher;
 
-    if (dd->max_threads > 1 && !dd->num_running_compute_threads) return NULL; // no running compute threads 
+    if (dd->max_threads > 1 && !dd->num_vbs_in_flight) return NULL; // no VBs dispatched
 
-    Thread *th = &dd->compute_threads[dd->next_thread_to_be_joined];
+    unsigned task_i = dd->next_task_to_collect % dd->max_vbs_in_flight;
+    Task *task = ENT (Task, dd->tasks_buf, task_i);
 
-    if (flag_show_threads) dispatcher_show_time ("Wait for thread", dd->next_thread_to_be_joined, th->vb->vblock_i);
+    if (flag_show_threads) dispatcher_show_time ("Wait for thread", task_i, task->vb->vblock_i);
 
-    if (dd->max_threads > 1) 
-        // wait for thread to complete (possibly it completed already)
-        pthread_join(th->thread_id, NULL);
+    if (dd->num_workers) {
+        // wait for the task to complete (possibly it completed already)
+        pthread_mutex_lock (&dd->pool_mutex);
+        while (!task->is_done) 
+            pthread_cond_wait (&dd->done_cond, &dd->pool_mutex);
+        pthread_mutex_unlock (&dd->pool_mutex);
+    }
 
-    if (flag_show_threads) dispatcher_show_time ("Join (end compute)", dd->next_thread_to_be_joined, th->vb->vblock_i);
+    if (flag_show_threads) dispatcher_show_time ("Join (end compute)", task_i, task->vb->vblock_i);
 
-    dd->processed_vb = th->vb;
+    dd->processed_vb = task->vb;
     
-    memset (th, 0, sizeof(Thread));
-    dd->num_running_compute_threads--;
-    dd->next_thread_to_be_joined = (dd->next_thread_to_be_joined + 1) % MAX (1, dd->max_threads);
+    memset (task, 0, sizeof(Task));
+    dd->num_vbs_in_flight--;
+    dd->next_task_to_collect++;
 
     return dd->processed_vb;
 }
 
-bool dispatcher_has_free_thread (Dispatcher dispatcher)
+// true if another VB can be dispatched - even if all workers are busy, in which case it waits in a deque
+bool dispatcher_has_free_slot (Dispatcher dispatcher)
 {
     DispatcherData *dd = (DispatcherData *)dispatcher;
-    return dd->num_running_compute_threads < MAX(1, dd->max_threads);
+    return dd->num_vbs_in_flight < dd->max_vbs_in_flight;
 }
 
 VBlock *dispatcher_get_next_vb (Dispatcher dispatcher)
@@ -441,7 +693,7 @@ bool dispatcher_is_done (Dispatcher dispatcher)
 {
     DispatcherData *dd = (DispatcherData *)dispatcher;
 
-    return dd->input_exhausted && !dd->next_vb && !dd->processed_vb && !dd->num_running_compute_threads;
+    return dd->input_exhausted && !dd->next_vb && !dd->processed_vb && !dd->num_vbs_in_flight;
 }
 
 bool dispatcher_is_input_exhausted (Dispatcher dispatcher)
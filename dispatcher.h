@@ -17,10 +17,13 @@ extern void dispatcher_resume (Dispatcher dispatcher);
 extern void dispatcher_finish (Dispatcher *dispatcher, unsigned *last_vb_i);
 
 extern void dispatcher_compute (Dispatcher dispatcher, void (*func)(VBlockP));
+
+#define MAX_SUBTASKS 16
+extern void dispatcher_run_subtasks (void (*func)(void *), void *args, unsigned arg_size, unsigned num_subtasks);
 extern VBlockP dispatcher_generate_next_vb (Dispatcher dispatcher, uint32_t vb_i);       
 extern bool dispatcher_has_processed_vb (Dispatcher dispatcher, bool *is_final);                                  
 extern VBlockP dispatcher_get_processed_vb (Dispatcher dispatcher, bool *is_final);
-extern bool dispatcher_has_free_thread (Dispatcher dispatcher);
+extern bool dispatcher_has_free_slot (Dispatcher dispatcher);
 extern VBlockP dispatcher_get_next_vb (Dispatcher dispatcher);
 extern void dispatcher_finalize_one_vb (Dispatcher dispatcher);
 extern void dispatcher_abandon_next_vb (Dispatcher dispatcher);
@@ -23,6 +23,7 @@ void fastq_seg_initialize (VBlockFAST *vb)
 
     vb->contexts[FASTQ_SEQ].flags  = CTX_FL_LOCAL_LZMA;
     vb->contexts[FASTQ_SEQ].ltype  = CTX_LT_SEQUENCE;
+    vb->contexts[FASTQ_QUAL].flags = CTX_FL_LOCAL_QUAL;
     vb->contexts[FASTQ_QUAL].ltype = CTX_LT_SEQUENCE;
 }
 
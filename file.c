@@ -6,6 +6,9 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #define Z_LARGE64
 #ifdef __APPLE__
@@ -21,6 +24,7 @@
 #include "compressor.h"
 #include "vblock.h"
 #include "strings.h"
+#include "bgzf.h"
 
 // globals
 File *z_file   = NULL;
@@ -291,6 +295,10 @@ bool file_open_txt (File *file)
                     FILE *url_fp = url_open (NULL, file->name);
                     file->file = gzdopen (fileno(url_fp), file->mode); // we're abandoning the FILE structure (and leaking it, if libc implementation dynamically allocates it) and working only with the fd
                 }
+                else if (bgzf_is_bgzf_file (file->name)) { // BGZF - we read the blocks ourselves, and the compute threads uncompress them
+                    file->comp_alg = COMP_BGZ;
+                    file->file = fopen (file->name, file->mode);
+                }
                 else
                     file->file = gzopen64 (file->name, file->mode); // for local files we decompress ourselves
             }
@@ -333,28 +341,16 @@ bool file_open_txt (File *file)
         case COMP_BAM: {
             bool bam = (file->comp_alg == COMP_BAM);
 
-            if (file->mode == READ) {
-                char reason[100];
-                sprintf (reason, "To compress a %s file", file_exts[file->type]);
-                input_decompressor = stream_create (0, global_max_memory_per_vb, DEFAULT_PIPE_SIZE, 0, 0, 
-                                                    file->is_remote ? file->name : NULL,         // url                                        
-                                                    reason, 
-                                                    bam ? "samtools" : "bcftools", // exec_name
-                                                    "view", 
-                                                    "--threads", "8", 
-                                                    bam ? "-OSAM" : "-Ov",
-                                                    file->is_remote ? SKIP_ARG : file->name,    // local file name 
-                                                    bam ? "-h" : "--no-version", // BAM: include header
-                                                                                 // BCF: do not append version and command line to the header
-                                                    NULL);
-                file->file = stream_from_stream_stdout (input_decompressor);
-            }
-            else { // write
+            // BAM and BCF are read natively - the BGZF blocks are read by the I/O thread and converted to SAM or VCF
+            // by the compute threads (see sam_bam.c and vcf_bcf.c)
+            if (file->mode == READ) 
+                file->file = file->is_remote ? url_open (NULL, file->name) : fopen (file->name, file->mode);
+
+            else // write
                 file_redirect_output_to_stream (file, 
                                                 bam ? "samtools" : "bcftools", 
                                                 "view", 
                                                 bam ? "-OBAM" : "-Ob");            
-            }
             break;
         }
 
@@ -410,6 +406,7 @@ static void file_initialize_z_file_data (File *file)
                   buf_add_to_buffer_list (evb, &file->buf);
     INIT (dict_data);
     INIT (ra_buf);
+    INIT (dict_index_buf);
     INIT (section_list_buf);
     INIT (section_list_dict_buf);
     INIT (unconsumed_txt);
@@ -417,6 +414,160 @@ static void file_initialize_z_file_data (File *file)
 }
 #undef INIT
 
+// PIZ: map a local z_file to memory. Sections are accessed by zfile_read_section in the order of the section list, and it 
+// requests the prefetch thread to read ahead the parts about to be used (file_prefetch), so we turn off the kernel's own 
+// readahead heuristics.
+// The mapping is private and writable, so that in-place modifications (copy-on-write) never reach the file.
+// If mapping fails, we silently fall back to reading the file with fread.
+static void file_mmap (File *file)
+{
+#ifndef _WIN32
+    if (!file->disk_size) return;
+
+    void *data = mmap (NULL, file->disk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno ((FILE *)file->file), 0);
+    if (data == MAP_FAILED) return;
+
+    madvise (data, file->disk_size, MADV_RANDOM);
+
+    file->mmap_data = data;
+    file->mmap_next = 0;
+#endif
+}
+
+#define PREFETCH_CHUNK (1 << 20) // the prefetch thread reads 1MB at a time, so that a new request can pre-empt the current one
+
+// PIZ: prefetch thread - reads the requested range of z_file ahead of the I/O thread and compute threads, so that they
+// (almost) never wait for the disk. With a mapped file, it advises the kernel to read each chunk, and then touches its 
+// pages, so that it waits for the disk, rather than the compute threads page-faulting. Otherwise, it reads with pread, 
+// which brings the data to the page cache, from which the I/O thread then reads it. 
+static void *file_prefetch_thread (void *file_)
+{
+    File *file = (File *)file_;
+    char *scratch = file->mmap_data ? NULL : malloc (PREFETCH_CHUNK);
+    uint64_t page_size = sysconf (_SC_PAGESIZE);
+    bool failed = false;
+
+    pthread_mutex_lock (&file->prefetch_mutex);
+
+    while (!file->prefetch_stop) {
+
+        if (file->prefetch_next >= file->prefetch_end) {
+            pthread_cond_wait (&file->prefetch_cond, &file->prefetch_mutex);
+            continue;
+        }
+
+        uint64_t start = file->prefetch_next;
+        uint64_t len   = MIN (PREFETCH_CHUNK, file->prefetch_end - start);
+        file->prefetch_next += len;
+
+        pthread_mutex_unlock (&file->prefetch_mutex);
+
+#ifndef _WIN32
+        if (file->mmap_data) {
+            uint64_t page_start = start & ~(page_size-1); // madvise requires a page-aligned address
+            madvise (file->mmap_data + page_start, len + (start - page_start), MADV_WILLNEED);
+
+            volatile char touch;
+            for (uint64_t i=page_start; i < start + len; i += page_size) 
+                touch = file->mmap_data[i];
+            (void)touch;
+        }
+        else 
+            failed = (pread (fileno ((FILE *)file->file), scratch, len, start) <= 0); 
+#endif
+        pthread_mutex_lock (&file->prefetch_mutex);
+
+        if (failed) break; // read error - we just stop prefetching, and leave it to the I/O thread to report
+    }
+
+    pthread_mutex_unlock (&file->prefetch_mutex);
+
+    if (scratch) FREE (scratch);
+    return NULL;
+}
+
+// PIZ: request the prefetch thread to read this range of z_file, replacing any previous request that is not yet
+// fulfilled. The prefetch thread is started on the first request.
+void file_prefetch (File *file, uint64_t offset, uint64_t len)
+{
+#ifndef _WIN32
+    if (file->is_remote || file->redirected || offset >= file->disk_size) return; // only local files can be read out of order
+
+    if (!file->prefetch_thread_running) {
+        pthread_mutex_init (&file->prefetch_mutex, NULL);
+        pthread_cond_init (&file->prefetch_cond, NULL);
+
+        file->prefetch_next = file->prefetch_end = 0;
+        file->prefetch_stop = false;
+
+        unsigned err = pthread_create (&file->prefetch_thread, NULL, file_prefetch_thread, file);
+        ASSERT (!err, "Error: failed to create prefetch thread: %s", strerror (err));
+
+        file->prefetch_thread_running = true;
+    }
+
+    uint64_t end = MIN (offset + len, (uint64_t)file->disk_size);
+
+    pthread_mutex_lock (&file->prefetch_mutex);
+
+    if (offset > file->prefetch_next || end < file->prefetch_next) // new range, eg after skipping VBs with --regions 
+        file->prefetch_next = offset;
+    
+    file->prefetch_end = end; // the range [offset, prefetch_next) is already prefetched
+
+    pthread_cond_signal (&file->prefetch_cond);
+    pthread_mutex_unlock (&file->prefetch_mutex);
+#endif
+}
+
+static void file_prefetch_stop (File *file)
+{
+    if (!file->prefetch_thread_running) return;
+
+    pthread_mutex_lock (&file->prefetch_mutex);
+    file->prefetch_stop = true;
+    pthread_cond_signal (&file->prefetch_cond);
+    pthread_mutex_unlock (&file->prefetch_mutex);
+
+    pthread_join (file->prefetch_thread, NULL);
+
+    pthread_mutex_destroy (&file->prefetch_mutex);
+    pthread_cond_destroy (&file->prefetch_cond);
+    file->prefetch_thread_running = false;
+}
+
+// PIZ: stop using the mapping and continue reading from the current position with fread - used for files that are not
+// read section-by-section (v1) and for encrypted files (which are decrypted in place, so each read must get a fresh copy)
+void file_unmap (File *file)
+{
+#ifndef _WIN32
+    if (!file->mmap_data) return;
+
+    file_prefetch_stop (file);
+    munmap (file->mmap_data, file->disk_size);
+    file->mmap_data = NULL;
+
+    file_seek (file, file->mmap_next, SEEK_SET, false);
+#endif
+}
+
+// PIZ: we're done with this range of a mapped z_file - drop it from our address space (the data remains in the page cache, 
+// but doesn't accumulate in our resident memory). Pages partially outside of the range are kept, as they may still be in use
+void file_advise_dontneed (File *file, uint64_t offset, uint64_t len)
+{
+#ifndef _WIN32
+    if (!file->mmap_data) return;
+
+    static uint64_t page_size = 0;
+    if (!page_size) page_size = sysconf (_SC_PAGESIZE);
+
+    uint64_t start = (offset + page_size - 1) & ~(page_size-1);
+    uint64_t end   = (offset + len) & ~(page_size-1);
+
+    if (end > start) madvise (file->mmap_data + start, end - start, MADV_DONTNEED);
+#endif
+}
+
 // returns true if successful
 static bool file_open_z (File *file)
 {
@@ -447,6 +598,10 @@ static bool file_open_z (File *file)
     if (file->mode == READ) 
         file->z_last_read = file->z_next_read = READ_BUFFER_SIZE;
 
+    // local genozip files are read by mapping them into memory - sections are then overlaid rather than copied
+    if (file->mode == READ && file->file && !file->is_remote) 
+        file_mmap (file);
+
     file_initialize_z_file_data (file);
 
     return file->file != 0;
@@ -550,9 +705,11 @@ void file_close (File **file_p,
     File *file = *file_p;
     *file_p = NULL;
 
+    file_prefetch_stop (file);
+
     if (file->file) {
 
-        if (file->mode == READ && (file->comp_alg == COMP_GZ || file->comp_alg == COMP_BGZ)) {
+        if (file->mode == READ && file->comp_alg == COMP_GZ) {
             int ret = gzclose_r((gzFile)file->file);
             ASSERTW (!ret, "%s: warning: failed to close file: %s", global_cmd, file_printname (file));
         }
@@ -569,6 +726,10 @@ void file_close (File **file_p,
             FCLOSE (file->file, file_printname (file));
     }
 
+#ifndef _WIN32
+    if (file->mmap_data) munmap (file->mmap_data, file->disk_size);
+#endif
+
     // free resources if we are NOT near the end of the execution. If we are at the end of the execution
     // it is faster to just let the process die
     if (cleanup_memory) {
@@ -582,6 +743,7 @@ void file_close (File **file_p,
 
         buf_destroy (&file->dict_data);
         buf_destroy (&file->ra_buf);
+        buf_destroy (&file->dict_index_buf);
         buf_destroy (&file->section_list_buf);
         buf_destroy (&file->section_list_dict_buf);
         buf_destroy (&file->v1_next_vcf_header);
@@ -607,6 +769,19 @@ size_t file_write (File *file, const void *data, unsigned len)
     return bytes_written;
 }
 
+// PIZ: read from the current position of z_file, into a caller-provided memory (rather than a Buffer, see zfile_read_from_disk)
+size_t file_read (File *file, void *data, unsigned len)
+{
+    if (file->mmap_data) {
+        len = MIN (len, file->disk_size - file->mmap_next);
+        memcpy (data, file->mmap_data + file->mmap_next, len);
+        file->mmap_next += len;
+        return len;
+    }
+
+    return fread (data, 1, len, (FILE *)file->file);
+}
+
 void file_remove (const char *filename, bool fail_quietly)
 {
     int ret = remove (filename); 
@@ -660,6 +835,20 @@ bool file_seek (File *file, int64_t offset,
 {
     ASSERT0 (file == z_file, "Error: file_seek only works for z_file");
 
+    // case: file is mapped to memory - we just move the read position
+    if (file->mmap_data) {
+        int64_t new_pos = offset + (whence == SEEK_CUR ? (int64_t)file->mmap_next : whence == SEEK_END ? file->disk_size : 0);
+        bool ok = (new_pos >= 0 && new_pos <= file->disk_size);
+        
+        if (soft_fail) 
+            ASSERTW (ok || flag_stdout, "Error while reading file %s: it is too small", file_printname (file))
+        else
+            ASSERT (ok, "Error: failed to seek to %"PRId64" in file %s", new_pos, file_printname (file));
+
+        if (ok) file->mmap_next = new_pos;
+        return ok;
+    }
+
     // check if we can just move the read buffers rather than seeking
     if (file->mode == READ && file->z_next_read != file->z_last_read && whence == SEEK_SET) {
 #ifdef __APPLE__
@@ -701,12 +890,18 @@ bool file_seek (File *file, int64_t offset,
 
 uint64_t file_tell (File *file)
 {
+    // BGZF blocks are read with fread, which also counts the bytes read (this also works when reading from a URL)
+    if (command == ZIP && file == txt_file && (file->comp_alg == COMP_BGZ || file_has_bgzf_records (file)))
+        return txt_file->disk_so_far; 
+
     if (command == ZIP && file == txt_file && file->comp_alg == COMP_GZ)
         return gzconsumed64 ((gzFile)txt_file->file); 
     
     if (command == ZIP && file == txt_file && file->comp_alg == COMP_BZ2)
         return BZ2_consumed ((BZFILE *)txt_file->file); 
 
+    if (file->mmap_data) return file->mmap_next;
+
 #ifdef __APPLE__
     return ftello ((FILE *)file->file);
 #else
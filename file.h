@@ -138,11 +138,14 @@ extern const char *file_exts[];
 
 // IMPORTANT: these values CANNOT BE CHANGED as they are part of the genozip file - 
 // they go in SectionHeader.sec_compression_alg and also SectionHeaderTxtHeader.compression_type
-#define NUM_COMPRESSION_ALGS 9
+#define NUM_COMPRESSION_ALGS 12
 typedef enum { COMP_UNKNOWN=-1, COMP_PLN=0 /* plain - no compression */, 
-               COMP_GZ=1, COMP_BZ2=2, COMP_BGZ=3, COMP_XZ=4, COMP_BCF=5, COMP_BAM=6, COMP_LZMA=7, COMP_ZIP=8 } CompressionAlg; 
+               COMP_GZ=1, COMP_BZ2=2, COMP_BGZ=3, COMP_XZ=4, COMP_BCF=5, COMP_BAM=6, COMP_LZMA=7, COMP_ZIP=8,
+               COMP_ZSTD=9 /* sections only - selected with --zstd */, 
+               COMP_RANS=10 /* sections only - selected with --rans */, 
+               COMP_QUAL=11 /* sections only - SAM and FASTQ quality strings */ } CompressionAlg; 
 #define COMPRESSED_FILE_VIEWER { "cat", "gunzip -d -c", "bzip2 -d -c", "gunzip -d -c", "xz -d -c", \
-                                 "bcftools -Ov --version", "samtools view -h -OSAM", "N/A", "unzip -p" }
+                                 "bcftools -Ov --version", "samtools view -h -OSAM", "N/A", "unzip -p", "N/A", "N/A", "N/A" }
 
 // txt file types and their corresponding genozip file types for each data type
 // first entry of each data type MUST be the default plain file
@@ -201,12 +204,15 @@ extern FileMode READ, WRITE; // this are pointers to static strings - so they ca
 // ---------------------------
 
 #define file_is_read_via_ext_decompressor(file) \
-  (file->comp_alg == COMP_XZ || file->comp_alg == COMP_ZIP || file->comp_alg == COMP_BCF || file->comp_alg == COMP_BAM)
+  (file->comp_alg == COMP_XZ || file->comp_alg == COMP_ZIP)
 
 #define file_is_read_via_int_decompressor(file) \
-  (file->comp_alg == COMP_GZ || file->comp_alg == COMP_BGZ || file->comp_alg == COMP_BZ2)
+  (file->comp_alg == COMP_GZ || file->comp_alg == COMP_BGZ || file->comp_alg == COMP_BZ2 || file->comp_alg == COMP_BAM || file->comp_alg == COMP_BCF)
 
-#define file_is_written_via_ext_compressor(file) (file->comp_alg == COMP_BCF || file->comp_alg == COMP_GZ)
+// BAM and BCF: BGZF-compressed binary records, converted to txt by the compute threads
+#define file_has_bgzf_records(file) (file->comp_alg == COMP_BAM || file->comp_alg == COMP_BCF)
+
+#define file_is_written_via_ext_compressor(file) (file->comp_alg == COMP_BCF || file->comp_alg == COMP_GZ || file->comp_alg == COMP_BAM)
 
 #define file_is_plain_or_ext_decompressor(file) (file->comp_alg == COMP_PLN || file_is_read_via_ext_decompressor(file))
 
@@ -261,6 +267,7 @@ typedef struct File {
     uint8_t dict_id_to_did_i_map[65536]; // map for quick look up of did_i from dict_id 
     MtfContext contexts[MAX_DICTS];     // a merge of dictionaries of all VBs
     Buffer ra_buf;                     // RAEntry records - in a format ready to write to disk (Big Endian etc)
+    Buffer dict_index_buf;             // DictIndexEntry records - ZIP: in a format ready to write to disk (Big Endian) ; PIZ: native endianity
     Buffer dict_data;                  // Dictionary data accumulated from all VBs and written near the end of the file
 
     // section list - used for READING and WRITING genozip files
@@ -277,6 +284,15 @@ typedef struct File {
     Buffer unconsumed_txt;         // excess data read from the txt file - moved to the next VB
     
     // Used for reading genozip files
+    char *mmap_data;                     // local z_file: the file mapped into memory, sections are overlaid rather than read. NULL if read with fread
+    uint64_t mmap_next;                  // the current read position in mmap_data (replaces the FILE position if the file is mapped)
+    
+    // PIZ: prefetch thread - reads the range [prefetch_next, prefetch_end) of a local z_file ahead of its use (see file_prefetch)
+    pthread_t prefetch_thread;
+    pthread_mutex_t prefetch_mutex;
+    pthread_cond_t prefetch_cond;
+    bool prefetch_thread_running, prefetch_stop;
+    uint64_t prefetch_next, prefetch_end;
     uint32_t z_next_read, z_last_read;     // indices into read_buffer for z_file
     char read_buffer[];                  // only allocated for mode=READ files   
 } File;
@@ -292,6 +308,10 @@ extern void file_close (FileP *file_p, bool cleanup_memory /* optional */);
 extern size_t file_write (FileP file, const void *data, unsigned len);
 extern bool file_seek (File *file, int64_t offset, int whence, bool soft_fail); // SEEK_SET, SEEK_CUR or SEEK_END
 extern uint64_t file_tell (File *file);
+extern size_t file_read (FileP file, void *data, unsigned len);
+extern void file_prefetch (FileP file, uint64_t offset, uint64_t len);
+extern void file_advise_dontneed (FileP file, uint64_t offset, uint64_t len);
+extern void file_unmap (FileP file);
 extern uint64_t file_get_size (const char *filename);
 extern void file_set_input_type (const char *type_str);
 extern void file_set_input_size (const char *size_str);
@@ -38,6 +38,9 @@
 #include "license.h"
 #include "vcf.h"
 #include "dict_id.h"
+#include "seg.h"
+#include "random_access.h"
+#include "compressor.h"
 
 // globals - set it main() and never change
 const char *global_cmd = NULL; 
@@ -45,13 +48,14 @@ ExeType exe_type;
 int command = -1;  // must be static or global to initialize list_options 
 
 uint32_t global_max_threads = DEFAULT_MAX_THREADS; 
+uint32_t global_max_vbs_in_flight = 0; // number of vblocks dispatched to compute threads and not yet written - at least global_max_threads
 uint32_t global_max_memory_per_vb = 0; // ZIP only: used for reading text file data
 
 // the flags - representing command line options - available globally
 int flag_quiet=0, flag_force=0, flag_concat=0, flag_md5=0, flag_split=0, flag_optimize=0, flag_bgzip=0, flag_bam=0, flag_bcf=0,
     flag_show_alleles=0, flag_show_time=0, flag_show_memory=0, flag_show_dict=0, flag_show_gt_nodes=0, flag_multiple_files=0,
     flag_show_b250=0, flag_show_sections=0, flag_show_headers=0, flag_show_index=0, flag_show_gheader=0, flag_show_threads=0,
-    flag_stdout=0, flag_replace=0, flag_test=0, flag_regions=0, flag_samples=0, flag_fast=0,
+    flag_stdout=0, flag_replace=0, flag_test=0, flag_regions=0, flag_samples=0, flag_fast=0, flag_rans=0,
     flag_drop_genotypes=0, flag_no_header=0, flag_header_only=0, flag_header_one=0, flag_noisy=0,
     flag_show_vblocks=0, flag_gtshark=0, flag_sblock=0, flag_vblock=0, flag_gt_only=0, flag_fasta_sequential=0,
     flag_debug_memory=0, flag_debug_progress=0, flag_show_hash, flag_register=0, flag_debug_no_singletons=0,
@@ -68,6 +72,7 @@ DictIdType dict_id_show_one_b250 = { 0 },  // argument of --show-b250-one
            dict_id_dump_one_b250 = { 0 };  // argument of --dump-b250-one
 
 static char *threads_str  = NULL;
+static char *in_flight_str = NULL;
 
 void exit_on_error(void) 
 {
@@ -535,11 +540,17 @@ int main (int argc, char **argv)
         #define _9Z {"optimize-ZM",   no_argument,       &flag_optimize_ZM,  1 }
         #define _gt {"gtshark",       no_argument,       &flag_gtshark,      1 } 
         #define _th {"threads",       required_argument, 0, '@'                }
+        #define _if {"vblocks-in-flight", required_argument, 0, 'w'            }
         #define _O  {"split",         no_argument,       &flag_split,        1 }
         #define _o  {"output",        required_argument, 0, 'o'                }
         #define _p  {"password",      required_argument, 0, 'p'                }
         #define _B  {"vblock",        required_argument, 0, 'B'                }
         #define _S  {"sblock",        required_argument, 0, 'S'                }
+        #define _sS {"seg-shards",    required_argument, 0, '4'                }
+        #define _sP {"seek-points",   required_argument, 0, '6'                }
+        #define _zs {"zstd",          required_argument, 0, '7'                }
+        #define _cp {"codec-policy",  required_argument, 0, '8'                }
+        #define _rA {"rans",          no_argument,       &flag_rans,         1 }
         #define _r  {"regions",       required_argument, 0, 'r'                }
         #define _tg {"targets",       required_argument, 0, 't'                }
         #define _s  {"samples",       required_argument, 0, 's'                }
@@ -577,9 +588,9 @@ int main (int argc, char **argv)
         #define _00 {0, 0, 0, 0                                                }
 
         typedef const struct option Option;
-        static Option genozip_lo[]    = { _i, _I, _c, _d, _f, _h, _l, _L1, _L2, _q, _Q, _t, _DL, _V,               _m, _th, _O, _o, _p,                                          _ss, _sd, _sT, _d1, _d2, _sg, _s2, _s5, _s6, _s7, _s8, _sa, _st, _sm, _sh, _si, _sr, _sv, _B, _S, _dm, _dp, _dh,_ds, _9, _99, _9s, _9P, _9G, _9g, _9V, _9Q, _9f, _9Z, _gt, _fa,          _rg, _00 };
-        static Option genounzip_lo[]  = {         _c,     _f, _h,     _L1, _L2, _q, _Q, _t, _DL, _V, _z, _zb, _zc, _m, _th, _O, _o, _p,                                               _sd, _sT, _d1, _d2,      _s2, _s5, _s6,                _st, _sm, _sh, _si, _sr,              _dm, _dp,                                                                                 _00 };
-        static Option genocat_lo[]    = {                 _f, _h,     _L1, _L2, _q, _Q,          _V,                   _th,     _o, _p, _r, _tg, _s, _G, _1, _H0, _H1, _Gt, _GT,      _sd, _sT, _d1, _d2,      _s2, _s5, _s6,                _st, _sm, _sh, _si, _sr,              _dm, _dp,                                                                   _fs, _g,      _00 };
+        static Option genozip_lo[]    = { _i, _I, _c, _d, _f, _h, _l, _L1, _L2, _q, _Q, _t, _DL, _V,               _m, _th, _if, _O, _o, _p,                                          _ss, _sd, _sT, _d1, _d2, _sg, _s2, _s5, _s6, _s7, _s8, _sa, _st, _sm, _sh, _si, _sr, _sv, _B, _S, _sS, _sP, _zs, _cp, _rA, _dm, _dp, _dh,_ds, _9, _99, _9s, _9P, _9G, _9g, _9V, _9Q, _9f, _9Z, _gt, _fa,          _rg, _00 };
+        static Option genounzip_lo[]  = {         _c,     _f, _h,     _L1, _L2, _q, _Q, _t, _DL, _V, _z, _zb, _zc, _m, _th, _if, _O, _o, _p,                                               _sd, _sT, _d1, _d2,      _s2, _s5, _s6,                _st, _sm, _sh, _si, _sr,              _dm, _dp,                                                                                 _00 };
+        static Option genocat_lo[]    = {                 _f, _h,     _L1, _L2, _q, _Q,          _V,                   _th, _if,     _o, _p, _r, _tg, _s, _G, _1, _H0, _H1, _Gt, _GT,      _sd, _sT, _d1, _d2,      _s2, _s5, _s6,                _st, _sm, _sh, _si, _sr,              _dm, _dp,                                                                   _fs, _g,      _00 };
         static Option genols_lo[]     = {                 _f, _h,     _L1, _L2, _q,              _V,                                _p,                                                                                                      _st, _sm,                             _dm,                                                                                      _00 };
         static Option *long_options[] = { genozip_lo, genounzip_lo, genols_lo, genocat_lo }; // same order as ExeType
 
@@ -627,6 +638,7 @@ int main (int argc, char **argv)
             case 'H' : flag_no_header     = 1      ; break;
             case '1' : flag_header_one    = 1      ; break;
             case '@' : threads_str  = optarg       ; break;
+            case 'w' : in_flight_str = optarg      ; break;
             case 'o' : out_filename = optarg       ; break;
             case 'g' : flag_grep    = optarg       ; break;
             case '2' : dict_id_show_one_b250 = dict_id_make (optarg, strlen (optarg)); break;
@@ -638,6 +650,10 @@ int main (int argc, char **argv)
             case 'S' : vcf_zip_set_global_samples_per_block (optarg); 
                        flag_sblock = true;
                        break;
+            case '4' : seg_set_num_shards (optarg) ; break;
+            case '6' : random_access_set_seek_points (optarg) ; break;
+            case '7' : comp_set_zstd (optarg) ; break;
+            case '8' : comp_set_codec_policy (optarg) ; break;
             case 'p' : crypt_set_password (optarg) ; break;
 
             case 0   : // a long option - already handled; except for 'o' and '@'
@@ -756,6 +772,16 @@ int main (int argc, char **argv)
         ASSERT (ret == 1 && global_max_threads >= 1, "%s: %s requires an integer value of at least 1", global_cmd, OT("threads", "@"));
     }
     else global_max_threads = arch_get_num_cores();
+
+    // by default, allow a couple of vblocks in flight beyond the number of threads, so that compute threads can continue 
+    // with the following vblocks while a slow vblock holds up the output. each vblock in flight costs a full vblock of 
+    // memory, so we keep the default window small - a user with memory to spare may widen it with --vblocks-in-flight
+    if (in_flight_str) {
+        int ret = sscanf (in_flight_str, "%u", &global_max_vbs_in_flight);
+        ASSERT (ret == 1 && global_max_vbs_in_flight >= 1, "%s: --vblocks-in-flight requires an integer value of at least 1", global_cmd);
+        global_max_vbs_in_flight = MAX (global_max_vbs_in_flight, global_max_threads);
+    }
+    else global_max_vbs_in_flight = global_max_threads + 2;
     
     // take action, depending on the command selected
     if (command == VERSION) { main_print_version();   return 0; }
@@ -62,6 +62,7 @@ typedef const struct Buffer *ConstBufferP;
 typedef struct Structured *StructuredP;
 typedef const struct Structured *ConstStructuredP;
 typedef struct MtfContext *MtfContextP;
+typedef const struct MtfContext *ConstMtfContextP;
 typedef struct MtfNode *MtfNodeP;
 typedef const struct MtfNode *ConstMtfNodeP;
 typedef struct SectionHeader *SectionHeaderP;
@@ -80,7 +81,7 @@ typedef union DictIdType {
 #pragma pack(pop)
 
 // global parameters - set before any thread is created, and never change
-extern uint32_t global_max_threads, global_max_memory_per_vb;
+extern uint32_t global_max_threads, global_max_vbs_in_flight, global_max_memory_per_vb;
 extern const char *global_cmd;            // set once in main()
 extern ExeType exe_type;
 
@@ -99,7 +100,7 @@ extern int flag_force, flag_quiet, flag_concat, flag_md5, flag_split, flag_show_
            flag_samples, flag_drop_genotypes, flag_no_header, flag_header_only, flag_show_threads,
            flag_show_vblocks, flag_optimize, flag_gtshark, flag_sblock, flag_vblock, flag_gt_only,
            flag_header_one, flag_fast, flag_multiple_files, flag_fasta_sequential, flag_register,
-           flag_debug_progress, flag_show_hash, flag_debug_memory, flag_debug_no_singletons,
+           flag_debug_progress, flag_show_hash, flag_debug_memory, flag_debug_no_singletons, flag_rans,
 
            flag_optimize_sort, flag_optimize_PL, flag_optimize_GL, flag_optimize_GP, flag_optimize_VQSLOD, 
            flag_optimize_QUAL, flag_optimize_Vf, flag_optimize_ZM;
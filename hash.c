@@ -12,53 +12,175 @@
 #include "hash.h"
 #include "strings.h"
 #include "dict_id.h"
+#if defined __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Hash tables are open-addressing tables of a power-of-2 size. Slots are organized in groups of 16, and each slot has a 
+// control byte: HASH_CTRL_EMPTY if the slot is unoccupied, or a 7-bit tag taken from the hash value of the snip if it is
+// occupied. A lookup probes groups, starting from the group determined by the hash value, comparing the tag to all 16 
+// control bytes of a group at once, and comparing snips only in slots whose tag matches. Since entries are never
+// removed, a lookup ends at the first group that has an unoccupied slot, and a new entry is placed in that slot.
+// The table's memory is the control bytes of all slots, followed by the slots. Buffer.len is the number of occupied slots.
+#define HASH_GROUP_SIZE  16
+#define HASH_CTRL_EMPTY  0x80
+#define HASH_MIN_SIZE    256           // number of slots
+#define HASH_MAX_SIZE    0x80000000UL  // MAX_WORDS_IN_CTX entries fit in a table that is at most 7/8 full
+#define HASH_MAX_INITIAL_SIZE (1 << 26)
+#define HASH_IS_FULL(len,size) ((uint64_t)(len) + 1 > (uint64_t)(size) / 8 * 7)
+
+#define HASH_CTRL(buf)                ((uint8_t *)(buf).data)
+#define HASH_SLOT(type, buf, size, i) ENT (type, (buf), (size) / sizeof (type) + (i)) // slots follow the control bytes
 
-#define NO_NEXT 0xffffffff
 typedef struct {        
-    int32_t node_index;       // index into MtfContext.ol_mtf (if < ol_mtf.len) or MtfContext.mtf or NIL
-    uint32_t next;            // linked list - index into MtfContext.global/local_hash or NIL
-                              //               local_hash indeces started at LOCAL_HASH_OFFSET
+    int32_t node_index;       // index into MtfContext.ol_mtf (if < ol_mtf.len) or MtfContext.mtf
 } LocalHashEnt;
 
-#pragma pack(push, hash, 4)
 typedef struct {        
-    int32_t node_index;       // index into MtfContext.mtf or NIL
-    uint32_t next;            // linked list - index into MtfContext.global/local_hash or NIL
+    int32_t node_index;       // index into MtfContext.mtf, or negative-2 for a singleton in MtfContext.ol_mtf
     int32_t merge_num;        // the merge_num in which the "node_index" field was set. when this global hash is overlayed 
                               // to a vb_ctx, that vb_ctx is permitted use the node_index value if this merge_num is <= vb_ctx->merge_num,
-                              // otherwise, it should treat it as NIL.
+                              // otherwise, it should treat it as not found.
 } GlobalHashEnt;
-#pragma pack (pop)
 
-// get the size of the hash table - a primary number between roughly 0.5K and 8M that is close to size, or a bit bigger
+typedef struct {
+    uint32_t group_i, group_mask, step;
+    uint8_t tag;
+} HashProbe;
+
+static inline uint64_t hash_do (const char *snip, unsigned snip_len);
+
+// get the size of the hash table - a power of 2 that is at least size (within the permitted range)
 static uint32_t hash_next_size_up (uint64_t size)
 {
-    // primary numbers just beneath the powers of 2^0.5 (and 2^0.25 for the larger numbers)
-    // minimum ~64K to prevent horrible miscalculations in edge cases that result in dramatic slow down
-    static uint32_t hash_sizes[] = { /* 509, 719, 1021, 1447, 2039, 2887, 4039, 5791, 8191, 11579, 16381, 23167, 32749, 46337,*/ 65521, 92681, 131071, 
-                                     185363, 262139, 370723, 524287, 741431, 1048573, 1482907, 2097143, 2965819, 4194301, 5931641, 8388593, 
-                                     11863279, 16777213, 19951579, 23726561, 28215799, 33554393, 39903161, 47453111, 56431601, 67108859 };
-    #define NUM_HASH_SIZES (sizeof(hash_sizes) / sizeof(hash_sizes[0]))
+    uint64_t hash_size = HASH_MIN_SIZE;
+    while (hash_size < size && hash_size < HASH_MAX_INITIAL_SIZE) hash_size <<= 1;
+
+    return (uint32_t)hash_size;
+}
+
+// allocate a table with all slots unoccupied. note: if an overlayable buffer is currently overlaid, buf_alloc
+// allocates fresh memory, and the overlaying VBs continue to use the old table
+static void hash_alloc_table (VBlock *vb, Buffer *hash, uint32_t hash_size, unsigned sizeof_ent, const char *name, uint32_t param)
+{
+    buf_alloc (vb, hash, (uint64_t)hash_size * (1 + sizeof_ent), 1, name, param);
+    memset (hash->data, HASH_CTRL_EMPTY, hash_size); 
+    hash->len = 0;
+}
+
+static inline HashProbe hash_probe_start (uint64_t hash, uint32_t hash_size)
+{
+    uint32_t group_mask = hash_size / HASH_GROUP_SIZE - 1;
+    return (HashProbe){ .group_i = (uint32_t)(hash >> 7) & group_mask, .group_mask = group_mask, .tag = hash & 0x7f };
+}
 
-    for (int i=0; i < NUM_HASH_SIZES; i++)
-        if (size < (uint64_t)hash_sizes[i]) return hash_sizes[i];
+// triangular probing - visits all groups, as the number of groups is a power of 2
+static inline void hash_probe_next (HashProbe *probe)
+{
+    probe->group_i = (probe->group_i + ++probe->step) & probe->group_mask;
+}
 
-    return hash_sizes[NUM_HASH_SIZES-1]; // the maximal size
+// get bitmaps of the slots in the group whose control byte matches the tag, and of the unoccupied slots. 
+// note: control bytes of the global hash may be set concurrently by a merging thread (see hash_set_ctrl)
+static inline void hash_probe_group (const Buffer *hash, const HashProbe *probe, uint32_t *match, uint32_t *empty)
+{
+    const uint8_t *ctrl = &HASH_CTRL(*hash)[probe->group_i * HASH_GROUP_SIZE];
+
+#if defined __SSE2__
+    __m128i group = _mm_loadu_si128 ((const __m128i *)ctrl);
+    __atomic_thread_fence (__ATOMIC_ACQUIRE); // slots are read after their control bytes
+
+    *match = _mm_movemask_epi8 (_mm_cmpeq_epi8 (group, _mm_set1_epi8 (probe->tag)));
+    *empty = _mm_movemask_epi8 (group); // only HASH_CTRL_EMPTY has the high bit set
+#else
+    *match = *empty = 0;
+    for (unsigned i=0; i < HASH_GROUP_SIZE; i++) {
+        uint8_t c = __atomic_load_n (&ctrl[i], __ATOMIC_ACQUIRE);
+        if (c == probe->tag) *match |= 1 << i;
+        else if (c == HASH_CTRL_EMPTY) *empty |= 1 << i;
+    }
+#endif
 }
 
-// this is called when the first VB is merging - after its mtf and dict have been moved to zf_ctx.
-// Now we need to populate hash. 
+// thread safety: VB threads might be segmenting right now, and have the global hash overlayed and accessing it. We make
+// sure the slot is fully set before atomically setting its control byte, which makes it visible
+static inline void hash_set_ctrl (Buffer *hash, uint32_t slot_i, uint8_t tag)
+{
+    __atomic_store_n (&HASH_CTRL(*hash)[slot_i], tag, __ATOMIC_RELEASE);
+}
+
+// add an entry that is known not to be in the table, without growing the table
+static void hash_add_global_ent (MtfContext *zf_ctx, const char *snip, unsigned snip_len, int32_t node_index)
+{
+    for (HashProbe probe = hash_probe_start (hash_do (snip, snip_len), zf_ctx->global_hash_size); ; hash_probe_next (&probe)) {
+        uint32_t match, empty;
+        hash_probe_group (&zf_ctx->global_hash, &probe, &match, &empty);
+
+        if (empty) {
+            uint32_t slot_i = probe.group_i * HASH_GROUP_SIZE + __builtin_ctz (empty);
+            *HASH_SLOT (GlobalHashEnt, zf_ctx->global_hash, zf_ctx->global_hash_size, slot_i) = (GlobalHashEnt){ .node_index = node_index }; // merge_num=0
+            hash_set_ctrl (&zf_ctx->global_hash, slot_i, probe.tag);
+            zf_ctx->global_hash.len++;
+            return;
+        }
+    }
+}
+
+// populate the global hash from the nodes of zf_ctx - regular nodes and singletons. This is called when the global hash is 
+// allocated, and when it grows. Only VBs that clone after this will use this table, so all entries may be visible to them (merge_num=0)
 static void hash_populate_from_mtf (MtfContext *zf_ctx)
 {
-    uint32_t len = zf_ctx->mtf.len;
-    zf_ctx->mtf.len = 0; // hash_get_entry_for_merge will increment it back to its original value
+    const char *snip;
+    uint32_t snip_len;
+
+    for (int32_t i=0; i < zf_ctx->mtf.len; i++) {
+        mtf_node_zf (zf_ctx, i, &snip, &snip_len);
+        hash_add_global_ent (zf_ctx, snip, snip_len, i);
+    }
+
+    for (int32_t i=0; i < zf_ctx->ol_mtf.len; i++) {
+        mtf_node_zf (zf_ctx, -i - 2, &snip, &snip_len);
+        hash_add_global_ent (zf_ctx, snip, snip_len, -i - 2);
+    }
+}
+
+static void hash_grow_global (MtfContext *zf_ctx)
+{
+    ASSERT (zf_ctx->global_hash_size < HASH_MAX_SIZE, "Error: global hash table of %s is full", zf_ctx->name);
+    
+    zf_ctx->global_hash_size *= 2;
+    hash_alloc_table (evb, &zf_ctx->global_hash, zf_ctx->global_hash_size, sizeof (GlobalHashEnt), "z_file->contexts->global_hash", zf_ctx->did_i);
+    buf_set_overlayable (&zf_ctx->global_hash);
 
-    for (uint32_t i=0; i < len; i++) {
-        MtfNode *node = ENT (MtfNode, zf_ctx->mtf, i);
-        //bool is_singleton_in_vb = (count == 1 && (vb_ctx->ltype == CTX_LT_TEXT) && !(vb_ctx->flags & CTX_FL_NO_STONS)); // is singleton in this VB
+    hash_populate_from_mtf (zf_ctx);
+}
 
-        const char *snip = ENT (const char, zf_ctx->dict, node->char_index);
-        hash_get_entry_for_merge (zf_ctx, snip, node->snip_len, false /* is_singleton_in_vb */, NULL /* the snip is not in the hash for sure */); 
+// grow the local hash and populate it from the new nodes of this VB 
+static void hash_grow_local (VBlock *segging_vb, MtfContext *vb_ctx)
+{
+    ASSERT (vb_ctx->local_hash_size < HASH_MAX_SIZE, "Error: local hash table of %s is full", vb_ctx->name);
+
+    vb_ctx->local_hash_size *= 2;
+    hash_alloc_table (segging_vb, &vb_ctx->local_hash, vb_ctx->local_hash_size, sizeof (LocalHashEnt), "contexts->local_hash", vb_ctx->did_i);
+
+    for (uint32_t i=0; i < vb_ctx->mtf.len; i++) {
+        const char *snip;
+        uint32_t snip_len;
+        int32_t node_index = vb_ctx->ol_mtf.len + i;
+        mtf_node_vb (vb_ctx, node_index, &snip, &snip_len);
+
+        for (HashProbe probe = hash_probe_start (hash_do (snip, snip_len), vb_ctx->local_hash_size); ; hash_probe_next (&probe)) {
+            uint32_t match, empty;
+            hash_probe_group (&vb_ctx->local_hash, &probe, &match, &empty);
+
+            if (empty) {
+                uint32_t slot_i = probe.group_i * HASH_GROUP_SIZE + __builtin_ctz (empty);
+                HASH_SLOT (LocalHashEnt, vb_ctx->local_hash, vb_ctx->local_hash_size, slot_i)->node_index = node_index;
+                HASH_CTRL (vb_ctx->local_hash)[slot_i] = probe.tag;
+                vb_ctx->local_hash.len++;
+                break;
+            }
+        }
     }
 }
 
@@ -68,12 +190,12 @@ static void hash_populate_from_mtf (MtfContext *zf_ctx)
 // 2. If not - use either num_lines for the size, or the smallest size for dicts that are typically small
 void hash_alloc_local (VBlock *segging_vb, MtfContext *vb_ctx)
 {
-    vb_ctx->local_hash_prime = 0; // initialize
+    vb_ctx->local_hash_size = 0; // initialize
 
     // if known from previously merged vb - use those values
     if (vb_ctx->num_new_entries_prev_merged_vb)
-        // 3X the expected number of entries to reduce spill-over
-        vb_ctx->local_hash_prime = hash_next_size_up (vb_ctx->num_new_entries_prev_merged_vb * 3);
+        // 2X the expected number of entries, so the table is at most half full
+        vb_ctx->local_hash_size = hash_next_size_up (vb_ctx->num_new_entries_prev_merged_vb * 2);
 
     else switch (segging_vb->data_type) {
     
@@ -90,7 +212,7 @@ void hash_alloc_local (VBlock *segging_vb, MtfContext *vb_ctx)
             vb_ctx->dict_id.num == dict_id_INFO_AN ||
             vb_ctx->dict_id.num == dict_id_INFO_DP)
             
-            vb_ctx->local_hash_prime = hash_next_size_up(1);
+            vb_ctx->local_hash_size = hash_next_size_up(1);
 
         // typically big - use large hash table
         else 
@@ -98,7 +220,7 @@ void hash_alloc_local (VBlock *segging_vb, MtfContext *vb_ctx)
             vb_ctx->dict_id.num == dict_id_FORMAT_GL   ||
             vb_ctx->dict_id.num == dict_id_FORMAT_PL)
 
-            vb_ctx->local_hash_prime = hash_next_size_up((uint32_t)segging_vb->lines.len);
+            vb_ctx->local_hash_size = hash_next_size_up((uint32_t)segging_vb->lines.len);
         break;
 
     case DT_SAM:
@@ -147,7 +269,7 @@ void hash_alloc_local (VBlock *segging_vb, MtfContext *vb_ctx)
             
             vb_ctx->dict_id.num == dict_id_OPTION_STRAND)
             
-            vb_ctx->local_hash_prime = hash_next_size_up(500);
+            vb_ctx->local_hash_size = hash_next_size_up(500);
 
         // typically smallish - use hash table ~ 2000
         else 
@@ -155,21 +277,21 @@ void hash_alloc_local (VBlock *segging_vb, MtfContext *vb_ctx)
             vb_ctx->dict_id.num == dict_id_OPTION_RNAME  ||
             vb_ctx->dict_id.num == dict_id_OPTION_CC)
 
-            vb_ctx->local_hash_prime = hash_next_size_up(2000);
+            vb_ctx->local_hash_size = hash_next_size_up(2000);
 
         // typically medium - use hash table ~ 50000
         else 
         if (vb_ctx->dict_id.num == dict_id_fields[SAM_CIGAR]  ||
             vb_ctx->dict_id.num == dict_id_OPTION_MC)
 
-            vb_ctx->local_hash_prime = hash_next_size_up(50000);
+            vb_ctx->local_hash_size = hash_next_size_up(50000);
         break;
 
     case DT_FASTQ:
         if (vb_ctx->dict_id.num == dict_id_fields[FASTQ_DESC]    ||
             vb_ctx->dict_id.num == dict_id_fields[FASTQ_E1L])
             
-            vb_ctx->local_hash_prime = hash_next_size_up(500);
+            vb_ctx->local_hash_size = hash_next_size_up(500);
         break;
 
     case DT_FASTA:
@@ -177,7 +299,7 @@ void hash_alloc_local (VBlock *segging_vb, MtfContext *vb_ctx)
             vb_ctx->dict_id.num == dict_id_fields[FASTA_LINEMETA] ||
             vb_ctx->dict_id.num == dict_id_fields[FASTA_EOL])
             
-            vb_ctx->local_hash_prime = hash_next_size_up(500);
+            vb_ctx->local_hash_size = hash_next_size_up(500);
         break;
 
     case DT_GFF3:
@@ -191,14 +313,14 @@ void hash_alloc_local (VBlock *segging_vb, MtfContext *vb_ctx)
             vb_ctx->dict_id.num == dict_id_fields[GFF3_ATTRS] ||
             vb_ctx->dict_id.num == dict_id_fields[GFF3_EOL])
             
-            vb_ctx->local_hash_prime = hash_next_size_up(500);
+            vb_ctx->local_hash_size = hash_next_size_up(500);
         break;
 
     case DT_ME23:
         if (vb_ctx->dict_id.num == dict_id_fields[ME23_CHROM] ||
             vb_ctx->dict_id.num == dict_id_fields[ME23_EOL])
             
-            vb_ctx->local_hash_prime = hash_next_size_up(500);
+            vb_ctx->local_hash_size = hash_next_size_up(500);
         break;
 
 
@@ -206,16 +328,13 @@ void hash_alloc_local (VBlock *segging_vb, MtfContext *vb_ctx)
     }
 
     // default: it could be big - start with num_lines / 10 (this is an estimated num_lines that is likely inflated)
-    if (!vb_ctx->local_hash_prime) 
-        vb_ctx->local_hash_prime = hash_next_size_up ((uint32_t)segging_vb->lines.len / 10);
+    if (!vb_ctx->local_hash_size) 
+        vb_ctx->local_hash_size = hash_next_size_up ((uint32_t)segging_vb->lines.len / 10);
 
     // note: we can't be too generous with the initial allocation because this memory is usually physically allocated
-    // to ALL VB structures before any of them merges. Better start smaller for vb_i=1 and let it extend if needed
-    buf_alloc (segging_vb, &vb_ctx->local_hash, (vb_ctx->local_hash_prime * 1.2) * sizeof (LocalHashEnt) /* room for expansion */, 1, 
-               "contexts->local_hash", vb_ctx->did_i);
-    vb_ctx->local_hash.len = vb_ctx->local_hash_prime;
-    memset (vb_ctx->local_hash.data, 0xff, vb_ctx->local_hash_prime * sizeof (LocalHashEnt)); // initialize core table
-//printf ("Seg vb_i=%u: local hash: dict=%.8s size=%u\n", segging_vb->vblock_i, vb_ctx->name, vb_ctx->local_hash_prime); 
+    // to ALL VB structures before any of them merges. Better start smaller for vb_i=1 and let it grow if needed
+    hash_alloc_table (segging_vb, &vb_ctx->local_hash, vb_ctx->local_hash_size, sizeof (LocalHashEnt), "contexts->local_hash", vb_ctx->did_i);
+//printf ("Seg vb_i=%u: local hash: dict=%.8s size=%u\n", segging_vb->vblock_i, vb_ctx->name, vb_ctx->local_hash_size); 
 }
 
 // ZIP merge: allocating the global cache for a dictionary, when merging the first VB that encountered it
@@ -224,13 +343,13 @@ void hash_alloc_local (VBlock *segging_vb, MtfContext *vb_ctx)
 // to extrapolate the expected growth
 // it is very important to get this as accurate as possible: merge is our bottleneck for core-count scalability
 // as the merge is protected by a per-dictionary mutex. if the global hash table size is too small, search time
-// goes up (because of the need to traverse linked lists) during the bottleneck time. Coversely, if the hash
+// goes up (because of the need to grow the table, and longer probe sequences) during the bottleneck time. Coversely, if the hash
 // table size is too big, it both consumes a lot memory, as well as slows down the search time as the dictionary
 // is less likely to fit into the CPU memory caches
 void hash_alloc_global (VBlock *merging_vb, MtfContext *zf_ctx, const MtfContext *first_merging_vb_ctx)
 {
     // note on txt_data_size_single: if its a physical plain txt file - this is the file size. 
-    // if not - its an estimate done after the first VB by txtfile_estimate_txt_data_size
+    // if not - its an estimate made by txtfile_estimate_txt_data_size before the first VB is dispatched
     double effective_num_vbs=0, estimated_num_vbs = MAX (1, (double)txt_file->txt_data_size_single / (double)merging_vb->txt_data.len);
     double estimated_num_lines = estimated_num_vbs * (double)merging_vb->lines.len;
 
@@ -319,7 +438,7 @@ void hash_alloc_global (VBlock *merging_vb, MtfContext *zf_ctx, const MtfContext
     // at a low rate throughout. We add words at 10% of what we viewed in n3 - for the entire file
     if (n3_lines) estimated_entries += n3_density * estimated_num_lines * 0.10;
 
-    zf_ctx->global_hash_prime = hash_next_size_up (estimated_entries * 5);
+    zf_ctx->global_hash_size = hash_next_size_up (estimated_entries * 2); // at most half full, if the estimate is correct
 
     if (flag_show_hash) {
         char s1[30], s2[30];
@@ -334,35 +453,27 @@ void hash_alloc_global (VBlock *merging_vb, MtfContext *zf_ctx, const MtfContext
                  "n2_n3_lines=%s vb_ctx->mtf.len=%u est_entries=%d hashsize=%s\n", 
                  first_merging_vb_ctx->name, (int)n1, (int)n2, (int)n3, n2n3_density_ratio, gp, (unsigned)effective_num_vbs, 
                  str_uint_commas ((uint64_t)n2_n3_lines, s2), (uint32_t)first_merging_vb_ctx->mtf.len, (int)estimated_entries, 
-                 str_uint_commas (zf_ctx->global_hash_prime, s1)); 
+                 str_uint_commas (zf_ctx->global_hash_size, s1)); 
     }
 
-    buf_alloc (evb, &zf_ctx->global_hash, sizeof(GlobalHashEnt) * zf_ctx->global_hash_prime * 1.5, 1,  // 1.5 - leave some room for extensions
-               "z_file->contexts->global_hash", zf_ctx->did_i);
+    hash_alloc_table (evb, &zf_ctx->global_hash, zf_ctx->global_hash_size, sizeof (GlobalHashEnt), "z_file->contexts->global_hash", zf_ctx->did_i);
     buf_set_overlayable (&zf_ctx->global_hash);
 
-    zf_ctx->global_hash.len = zf_ctx->global_hash_prime; // global_hash.len can get longer over time as extension links are added
-
-    // we set all entries to {NO_NEXT, NIL, NIL} == {0xffffffff x 3} (note: GlobalHashEnt is packed)
-    memset (zf_ctx->global_hash.data, 0xff, sizeof(GlobalHashEnt) * zf_ctx->global_hash.len);
-
     hash_populate_from_mtf (zf_ctx);
 }
 
-// tested hash table sizes up to 5M. turns out smaller tables (up to a point) are faster, despite having longer
-// average linked lists. probably bc the CPU can store the entire hash and mtf arrays in L1 or L2
-// memory cache during segmentation
-static inline uint32_t hash_do (uint32_t hash_len, const char *snip, unsigned snip_len)
+// spread the snip throughout the 64bit word, and then mix the bits so that both the group bits and the 
+// tag bits are about-evenly distributed
+static inline uint64_t hash_do (const char *snip, unsigned snip_len)
 {
-    if (!hash_len) return NO_NEXT; // hash table does not exist
-    
-    // spread the snip throughout the 64bit word before taking a mod - to ensure about-even distribution 
-    // across the hash table
     uint64_t result=0;
     for (unsigned i=0; i < snip_len; i++) 
         result = ((result << 23) | (result >> 41)) ^ (uint64_t)((uint8_t)snip[i]);
 
-    return (uint32_t)(result % hash_len);
+    result ^= result >> 33;
+    result *= 0xff51afd7ed558ccdULL;
+    result ^= result >> 33;
+    return result;
 }
 
 // creates a node in the hash table, unless the snip is already there. 
@@ -371,37 +482,20 @@ static inline uint32_t hash_do (uint32_t hash_len, const char *snip, unsigned sn
 int32_t hash_get_entry_for_merge (MtfContext *zf_ctx, const char *snip, unsigned snip_len, bool is_singleton_in_vb,
                                   MtfNode **old_node)        // out - node if node is found, NULL if not
 {
-    GlobalHashEnt g_head, *g_hashent = &g_head;
-    g_hashent->next = hash_do (zf_ctx->global_hash_prime, snip, snip_len); // entry in hash table determined by hash function on snip
-    int32_t hashent_i = NO_NEXT; // squash compiler warning (note: global hash table is always allocated in the first merge)
-    bool singleton_encountered = false;
-
-    while (g_hashent->next != NO_NEXT) {
-
-        ASSERT (g_hashent->next < zf_ctx->global_hash.len, "Error in hash_get_entry_for_merge: g_hashent->next=%d out of range, hash.len=%"PRIu64,  
-                g_hashent->next, zf_ctx->global_hash.len);
+    if (HASH_IS_FULL (zf_ctx->global_hash.len, zf_ctx->global_hash_size))
+        hash_grow_global (zf_ctx);
 
-        hashent_i = g_hashent->next;
-        g_hashent = ENT(GlobalHashEnt, zf_ctx->global_hash, hashent_i);
+    bool singleton_encountered = false;
 
-        // case: snip is not in core hash table and also no other snip occupies the slot (node_index==NIL happens only in the core table)
-        if (g_hashent->node_index == NIL) { // unoccupied space in core hash table
-            // thread safety: VB threads with merge_num < ours, might be segmenting right now, and have this global hash overlayed 
-            // and accessing it. we make sure that the setting of g_hashent->merge_num is atomic and the other threads will at all times either
-            // see NIL or merge_num - both of which indicate the this entry is effectively NIL as they have an older merge_num
+    for (HashProbe probe = hash_probe_start (hash_do (snip, snip_len), zf_ctx->global_hash_size); ; hash_probe_next (&probe)) {
+        uint32_t match, empty;
+        hash_probe_group (&zf_ctx->global_hash, &probe, &match, &empty);
 
-            g_hashent->next = NO_NEXT;
-            g_hashent->node_index = is_singleton_in_vb ? (-zf_ctx->ol_mtf.len++ - 2) : zf_ctx->mtf.len++; // -2 because: 0 is mapped to -2, 1 to -3 etc (as 0 is ambiguius and -1 is NIL)
-            __atomic_store_n (&g_hashent->merge_num, zf_ctx->merge_num, __ATOMIC_RELAXED); // stamp our merge_num as the ones that set the node_index
-            if (old_node) *old_node = NULL; // no old node
-            if (is_singleton_in_vb) zf_ctx->num_singletons++;
-            return g_hashent->node_index;
-        }
+        for (; match && old_node; match &= match - 1) { // if old_node=NULL, caller is telling us it is not in MTF for sure
+            GlobalHashEnt *g_hashent = HASH_SLOT (GlobalHashEnt, zf_ctx->global_hash, zf_ctx->global_hash_size, probe.group_i * HASH_GROUP_SIZE + __builtin_ctz (match));
 
-        if (old_node) {  // if node=NULL, caller is telling us it is not in MTF for sure
             const char *snip_in_dict;
             uint32_t snip_len_in_dict;
-
             *old_node = mtf_node_zf (zf_ctx, g_hashent->node_index, &snip_in_dict, &snip_len_in_dict);
         
             // case: snip is in the hash table 
@@ -417,38 +511,31 @@ int32_t hash_get_entry_for_merge (MtfContext *zf_ctx, const char *snip, unsigned
                 return g_hashent->node_index;
             }
         }
-    }
 
-    // case: not found in hash table, and we are required to provide a new hash entry on the linked list
-    buf_alloc (evb, &zf_ctx->global_hash, sizeof (GlobalHashEnt) * (1 + zf_ctx->global_hash.len), 2, 
-               "z_file->contexts->global_hash", zf_ctx->did_i);
+        if (!empty) continue; // group is full - continue to the next group
 
-    g_hashent = ENT (GlobalHashEnt, zf_ctx->global_hash, hashent_i); // might have changed after realloc
+        // case: not found in hash table - we add a new entry in the first unoccupied slot of this group
+        uint32_t slot_i = probe.group_i * HASH_GROUP_SIZE + __builtin_ctz (empty);
+        GlobalHashEnt *new_hashent = HASH_SLOT (GlobalHashEnt, zf_ctx->global_hash, zf_ctx->global_hash_size, slot_i);
 
-    // thread safetey:  VB threads with merge_num < ours, might be segmenting right now, and have this global hash overlayed 
-    // and accessing it. We make sure to first prepare the new entry including the merge_num which will prohibit old
-    // VBs from using it, before we atomically set the "next"
-    uint32_t next = zf_ctx->global_hash.len++;
-    GlobalHashEnt *new_hashent = ENT (GlobalHashEnt, zf_ctx->global_hash, next);
-    new_hashent->merge_num     = zf_ctx->merge_num; // stamp our merge_num as the ones that set the node_index
-    
-    // we enter the node as a singleton (=in ol_mtf) if this was a singleton in this VB but not in any previous VB 
-    // (the second occurange in the file isn't a singleton anymore)
-    bool is_singleton_global   = (is_singleton_in_vb && !singleton_encountered);
-    new_hashent->node_index    = is_singleton_global ? (-zf_ctx->ol_mtf.len++ - 2) : zf_ctx->mtf.len++; // -2 because: 0 is mapped to -2, 1 to -3 etc (as 0 is ambiguius and -1 is NIL)
-    new_hashent->next          = NO_NEXT;
-    
-    // now, with the new g_hashent set, we can atomically update the "next"
-    __atomic_store_n (&g_hashent->next, next, __ATOMIC_RELAXED);
+        // we enter the node as a singleton (=in ol_mtf) if this was a singleton in this VB but not in any previous VB 
+        // (the second occurange in the file isn't a singleton anymore)
+        bool is_singleton_global = (is_singleton_in_vb && !singleton_encountered);
+        new_hashent->node_index  = is_singleton_global ? (-zf_ctx->ol_mtf.len++ - 2) : zf_ctx->mtf.len++; // -2 because: 0 is mapped to -2, 1 to -3 etc (as 0 is ambiguius and -1 is NIL)
+        new_hashent->merge_num   = zf_ctx->merge_num; // stamp our merge_num as the ones that set the node_index
 
-    if (is_singleton_global) 
-        zf_ctx->num_singletons++; // we encoutered this snip for the first time ever in this file - count it as a singleton
+        hash_set_ctrl (&zf_ctx->global_hash, slot_i, probe.tag);
+        zf_ctx->global_hash.len++;
 
-    if (singleton_encountered)  // a snip that was previously counted as a singleton is encountered for the second time. it is therefore a failed singleton
-        zf_ctx->num_failed_singletons++;
+        if (is_singleton_global) 
+            zf_ctx->num_singletons++; // we encoutered this snip for the first time ever in this file - count it as a singleton
 
-    if (old_node) *old_node = NULL; // we don't have an old node
-    return new_hashent->node_index;
+        if (singleton_encountered)  // a snip that was previously counted as a singleton is encountered for the second time. it is therefore a failed singleton
+            zf_ctx->num_failed_singletons++;
+
+        if (old_node) *old_node = NULL; // we don't have an old node
+        return new_hashent->node_index;
+    }
 }
 
 // gets the node_index if the snip is already in the hash table, or puts a new one in the hash table in not
@@ -460,42 +547,32 @@ int32_t hash_get_entry_for_seg (VBlock *segging_vb, MtfContext *vb_ctx,
                                 int32_t node_index_if_new,
                                 MtfNode **node)        // out - node if node is found, NULL if not
 {
-    // first, search for the snip in the global table
-    GlobalHashEnt g_head, *g_hashent = &g_head;
-    g_hashent->next = hash_do (vb_ctx->global_hash_prime, snip, snip_len); // entry in hash table determined by hash function on snip
+    uint64_t hash = hash_do (snip, snip_len);
 
-    for (unsigned depth=0; ; depth++) {
-        
-        // four cases for "next":
-        // 1. NO_NEXT - the linked list is terminated and we have not found our snip
-        // 2. next points to a valid index with our overlaid global_cache - we follow it
-        // two cases where another thread sets next during merge with a higher merge number. two case:
-        // 3. "next" is within the length cloned by us - we will follow it, but arrive at a node 
-        //    which its merge_num prohibits us from consuming
-        // 4. "next" falls outside the length cloned by us - entries added to hash, but without reallocing
-        //    after we cloned. in this case, we will detected that "next" is out of range.
-        uint32_t next = __atomic_load_n (&g_hashent->next, __ATOMIC_RELAXED);
-        
-        if (next == NO_NEXT || /* case 1 */ next >= vb_ctx->global_hash.len) // case 4
-            break;
+    // first, search for the snip in the global table as it was when we cloned: merging VBs may add entries concurrently,
+    // but with a merge_num higher than ours, and if the table grows, it grows into new memory that we don't overlay
+    if (vb_ctx->global_hash_size)
+        for (HashProbe probe = hash_probe_start (hash, vb_ctx->global_hash_size); ; hash_probe_next (&probe)) {
+            uint32_t match, empty;
+            hash_probe_group (&vb_ctx->global_hash, &probe, &match, &empty);
 
-        g_hashent = ENT(GlobalHashEnt, vb_ctx->global_hash, next);
-                
-        // case: snip is not in core hash table (at least it wasn't there when we cloned and set our maximum merge_num we accept)
-        uint32_t merge_num = __atomic_load_n (&g_hashent->merge_num, __ATOMIC_RELAXED);
-        if (g_hashent->node_index == NIL || merge_num > vb_ctx->merge_num) break; // case 3
+            for (; match; match &= match - 1) {
+                const GlobalHashEnt *g_hashent = HASH_SLOT (GlobalHashEnt, vb_ctx->global_hash, vb_ctx->global_hash_size, probe.group_i * HASH_GROUP_SIZE + __builtin_ctz (match));
 
-        // we skip singletons and continue searching
-        if (g_hashent->node_index < 0) continue;
+                // we skip singletons and entries added by merges after we cloned, and continue searching
+                if (g_hashent->node_index < 0 || __atomic_load_n (&g_hashent->merge_num, __ATOMIC_RELAXED) > vb_ctx->merge_num) continue;
 
-        const char *snip_in_dict;
-        uint32_t snip_len_in_dict;
-        *node = mtf_node_vb (vb_ctx, g_hashent->node_index, &snip_in_dict, &snip_len_in_dict);
+                const char *snip_in_dict;
+                uint32_t snip_len_in_dict;
+                *node = mtf_node_vb (vb_ctx, g_hashent->node_index, &snip_in_dict, &snip_len_in_dict);
 
-        // case: snip is in the global hash table - we're done
-        if (snip_len == snip_len_in_dict && !memcmp (snip, snip_in_dict, snip_len)) 
-            return g_hashent->node_index; // case 2
-    }
+                // case: snip is in the global hash table - we're done
+                if (snip_len == snip_len_in_dict && !memcmp (snip, snip_in_dict, snip_len)) 
+                    return g_hashent->node_index; 
+            }
+
+            if (empty) break; // the snip is not in the global table
+        }
 
     // snip was not found in the global hash table (as it was at the time we cloned), we now search
     // in our local hash table - and if not found there - we will add it
@@ -504,26 +581,16 @@ int32_t hash_get_entry_for_seg (VBlock *segging_vb, MtfContext *vb_ctx,
     if (!buf_is_allocated (&vb_ctx->local_hash)) 
         hash_alloc_local (segging_vb, vb_ctx);
 
-    LocalHashEnt l_head, *l_hashent = &l_head;
-    l_hashent->next = hash_do (vb_ctx->local_hash_prime, snip, snip_len); // entry in hash table determined by hash function on snip
-    int32_t l_hashent_i = NO_NEXT; // initialize to squash compiler warning
+    else if (HASH_IS_FULL (vb_ctx->local_hash.len, vb_ctx->local_hash_size))
+        hash_grow_local (segging_vb, vb_ctx);
 
-    while (l_hashent->next != NO_NEXT) {
+    for (HashProbe probe = hash_probe_start (hash, vb_ctx->local_hash_size); ; hash_probe_next (&probe)) {
+        uint32_t match, empty;
+        hash_probe_group (&vb_ctx->local_hash, &probe, &match, &empty);
 
-        ASSERT (l_hashent->next < vb_ctx->local_hash.len, 
-                "Error: l_hashent->next=%d out of range, local_hash.len=%u", l_hashent->next, (uint32_t)vb_ctx->local_hash.len);
-        l_hashent_i = l_hashent->next;
-        l_hashent = ENT (LocalHashEnt, vb_ctx->local_hash, l_hashent_i);
-
-        // case: snip is not in hash table and also no other snip occupies the slot (node_index==NIL happens only in the core table)
-        if (l_hashent->node_index == NIL) { // unoccupied space in core hash table
-            l_hashent->next = NO_NEXT;
-            l_hashent->node_index = node_index_if_new;
-            if (node) *node = NULL;
-            return NIL;
-        }
+        for (; match && node; match &= match - 1) { // if the caller doesn't provide "node", he is telling us that with certainly the snip is not in the hash table
+            const LocalHashEnt *l_hashent = HASH_SLOT (LocalHashEnt, vb_ctx->local_hash, vb_ctx->local_hash_size, probe.group_i * HASH_GROUP_SIZE + __builtin_ctz (match));
 
-        if (node) { // if the caller doesn't provide "node", he is telling us that with certainly the snip is not in the hash table
             const char *snip_in_dict;
             uint32_t snip_len_in_dict;
             *node = mtf_node_vb (vb_ctx, l_hashent->node_index, &snip_in_dict, &snip_len_in_dict);
@@ -532,19 +599,16 @@ int32_t hash_get_entry_for_seg (VBlock *segging_vb, MtfContext *vb_ctx,
             if (snip_len == snip_len_in_dict && !memcmp (snip, snip_in_dict, snip_len)) 
                 return l_hashent->node_index;
         }
-    }
-
-    // case: not found in hash table, and we are required to provide a new hash entry on the linked list
-    buf_alloc (segging_vb, &vb_ctx->local_hash, sizeof (LocalHashEnt) * (1 + vb_ctx->local_hash.len), // realloc if needed
-                1.5, "contexts->local_hash", vb_ctx->did_i);
 
-    l_hashent = ENT (LocalHashEnt, vb_ctx->local_hash, l_hashent_i);  // might have changed after realloc
-    l_hashent->next = vb_ctx->local_hash.len++;
+        if (!empty) continue; // group is full - continue to the next group
 
-    LocalHashEnt *new_l_hashent = ENT (LocalHashEnt, vb_ctx->local_hash, l_hashent->next);
-    new_l_hashent->next = NO_NEXT;
-    new_l_hashent->node_index = node_index_if_new;
+        // case: not found in hash table - we add a new entry in the first unoccupied slot of this group
+        uint32_t slot_i = probe.group_i * HASH_GROUP_SIZE + __builtin_ctz (empty);
+        HASH_SLOT (LocalHashEnt, vb_ctx->local_hash, vb_ctx->local_hash_size, slot_i)->node_index = node_index_if_new;
+        HASH_CTRL (vb_ctx->local_hash)[slot_i] = probe.tag;
+        vb_ctx->local_hash.len++;
 
-    if (node) *node = NULL;
-    return NIL;
+        if (node) *node = NULL;
+        return NIL;
+    }
 }
@@ -61,7 +61,11 @@ void me23_piz_reconstruct_vb (VBlock *vb)
 {
     for (uint32_t vb_line_i=0; vb_line_i < vb->lines.len; vb_line_i++) {
 
+        // --regions: skip segments of the VB that include no region, if the file has seek points
+        if (vb->seek_points.len && !random_access_seek_to_included_line (vb, &vb_line_i)) break;
+
         uint32_t txt_data_start = vb->txt_data.len;
+        vb->dont_show_curr_line = false; // might become true due --regions
         vb->line_i = vb->first_line + vb_line_i;
 
         piz_reconstruct_from_ctx (vb, ME23_ID,    '\t');
@@ -31,11 +31,14 @@ unzip:
 #include "vblock.h"
 #include "move_to_front.h"
 #include "zfile.h"
+#include "sections.h"
 #include "endianness.h"
 #include "file.h"
 #include "hash.h"
 #include "seg.h"
 #include "dict_id.h"
+#include "random_access.h"
+#include "dispatcher.h"
 
 const char ctx_lt_to_sam_map[NUM_CTX_LT] = "\0cCsSiI\0\0f\0\0" ;
 const int ctx_lt_sizeof_one[NUM_CTX_LT]  = { 1, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 1 };
@@ -45,8 +48,8 @@ const int64_t ctx_lt_max[NUM_CTX_LT]     = { 0, 127, 255, 16383, 32767, 21474836
 
 #define INITIAL_NUM_NODES 10000
 
-static pthread_mutex_t wait_for_vb_1_mutex;
 static pthread_mutex_t compress_dictionary_data_mutex;
+static pthread_cond_t dict_frag_appended_cond; // signaled (with compress_dictionary_data_mutex) when a dictionary fragment is appended to z_file->dict_data
 
 static inline void mtf_lock_do (VBlock *vb, pthread_mutex_t *mutex, const char *func, uint32_t code_line, const char *name, uint32_t param)
 {
@@ -63,13 +66,6 @@ static inline void mtf_unlock_do (VBlock *vb, pthread_mutex_t *mutex, const char
 }
 #define mtf_unlock(vb, mutex, name, param) mtf_unlock_do (vb, mutex, __FUNCTION__, __LINE__, name, param)
 
-void mtf_vb_1_lock (VBlockP vb)
-{
-    ASSERT0 (vb->vblock_i == 1, "Error: Only vb_i=1 can call mtf_vb_1_lock");
-
-    mtf_lock (vb, &wait_for_vb_1_mutex, "wait_for_vb_1_mutex", 1);
-}
-
 // ZIP: add a snip to the dictionary the first time it is encountered in the VCF file.
 // the dictionary will be written to GENOZIP and used to reconstruct the MTF during decompression
 typedef enum { DICT_VB, DICT_ZF, DICT_ZF_SINGLTON } DictType;
@@ -356,7 +352,7 @@ void mtf_clone_ctx (VBlock *vb)
             // entries that are up to this merge_num
             buf_overlay (vb, &vb_ctx->global_hash, &zf_ctx->global_hash, "contexts->global_hash", did_i);
             vb_ctx->merge_num = zf_ctx->merge_num;
-            vb_ctx->global_hash_prime = zf_ctx->global_hash_prime; // can never change
+            vb_ctx->global_hash_size = zf_ctx->global_hash_size; // size of the table we overlay - if it grows, it moves to new memory
             vb_ctx->num_new_entries_prev_merged_vb = zf_ctx->num_new_entries_prev_merged_vb;
         }
 
@@ -377,6 +373,100 @@ void mtf_clone_ctx (VBlock *vb)
     COPY_TIMER (vb->profile.mtf_clone_ctx)
 }
 
+// ZIP: initialize the contexts of a seg shard (a VB that segs a line range of vb) to the state of vb's contexts before seg. 
+// the shard borrows vb's overlays of the global dictionaries and hash tables, they are returned by mtf_merge_in_shard_ctx
+void mtf_clone_ctx_to_shard (VBlock *shard, const VBlock *vb)
+{
+    for (unsigned did_i=0; did_i < vb->num_dict_ids; did_i++) {
+        const MtfContext *vb_ctx = &vb->contexts[did_i];
+        MtfContext *sh_ctx = &shard->contexts[did_i];
+
+        ASSERT (!vb_ctx->mtf.len, "Error in mtf_clone_ctx_to_shard: ctx %s already has %u nodes before seg", vb_ctx->name, (uint32_t)vb_ctx->mtf.len);
+
+        sh_ctx->ol_dict     = vb_ctx->ol_dict;     // borrowed
+        sh_ctx->ol_mtf      = vb_ctx->ol_mtf;      // borrowed
+        sh_ctx->global_hash = vb_ctx->global_hash; // borrowed
+
+        sh_ctx->merge_num         = vb_ctx->merge_num;
+        sh_ctx->global_hash_size = vb_ctx->global_hash_size;
+        sh_ctx->num_new_entries_prev_merged_vb = vb_ctx->num_new_entries_prev_merged_vb;
+        sh_ctx->did_i             = did_i;
+        sh_ctx->dict_id           = vb_ctx->dict_id;
+        sh_ctx->flags             = vb_ctx->flags;
+        sh_ctx->ltype             = vb_ctx->ltype;
+        memcpy ((char*)sh_ctx->name, vb_ctx->name, sizeof (sh_ctx->name));
+
+        mtf_init_iterator (sh_ctx);
+    }
+
+    shard->num_dict_ids = vb->num_dict_ids;
+    memcpy (shard->dict_id_to_did_i_map, vb->dict_id_to_did_i_map, sizeof (vb->dict_id_to_did_i_map));
+}
+
+// ZIP: merge the contexts of a seg shard into vb's contexts, with the same result as if vb had segged the shard's lines itself 
+// after the lines of the previous shards: the shard's new snips are evaluated in vb in the order of their first appearance
+// in the shard, so they get the same node indices that a single-threaded seg would have given them, and mtf_i is remapped.
+// num_dict_ids_at_hint[i] is non-zero if the (i+1)/3 hash hint was taken in this shard, and then it is the number of contexts
+// the shard had at that point
+void mtf_merge_in_shard_ctx (VBlock *vb, VBlock *shard, const unsigned *num_dict_ids_at_hint)
+{
+    for (unsigned did_i=0; did_i < shard->num_dict_ids; did_i++) {
+        MtfContext *sh_ctx = &shard->contexts[did_i];
+        MtfContext *vb_ctx = mtf_get_ctx (vb, sh_ctx->dict_id); // creates contexts in the order the shard created them
+
+        if (!vb_ctx->ltype) vb_ctx->ltype = sh_ctx->ltype;
+        vb_ctx->flags |= sh_ctx->flags;
+
+        // the new nodes of the shard are mapped to nodes of vb. we use the shard's b250 as the map, as it is not used in a shard
+        uint32_t ol_len = sh_ctx->ol_mtf.len, new_len = sh_ctx->mtf.len;
+        buf_alloc (shard, &sh_ctx->b250, new_len * sizeof (uint32_t), 1, "contexts->b250", did_i);
+        ARRAY (uint32_t, node_map, sh_ctx->b250);
+
+        for (uint32_t i=0; i <= new_len; i++) {
+            
+            // set the hash hints at exactly the point in the node sequence where a single-threaded seg would have set them
+            if (did_i < num_dict_ids_at_hint[0] && i == sh_ctx->mtf_len_at_1_3 && !vb_ctx->global_hash_size) 
+                vb_ctx->mtf_len_at_1_3 = vb_ctx->mtf.len;
+
+            if (did_i < num_dict_ids_at_hint[1] && i == sh_ctx->mtf_len_at_2_3 && !vb_ctx->global_hash_size) 
+                vb_ctx->mtf_len_at_2_3 = vb_ctx->mtf.len;
+
+            if (i == new_len) break;
+
+            const char *snip;
+            uint32_t snip_len;
+            MtfNode *sh_node = mtf_node_vb (sh_ctx, ol_len + i, &snip, &snip_len);
+
+            node_map[i] = mtf_evaluate_snip_seg (vb, vb_ctx, snip, snip_len, NULL);
+            mtf_node_vb (vb_ctx, node_map[i], NULL, NULL)->count += sh_node->count - 1; // evaluate already counted one
+        }
+
+        // append mtf_i, with the shard's new nodes remapped (nodes in ol_mtf and special values are the same in vb and the shard)
+        buf_alloc (vb, &vb_ctx->mtf_i, (vb_ctx->mtf_i.len + sh_ctx->mtf_i.len) * sizeof (uint32_t), CTX_GROWTH, "contexts->mtf_i", vb_ctx->did_i);
+        ARRAY (const uint32_t, sh_mtf_i, sh_ctx->mtf_i);
+        for (uint32_t i=0; i < sh_ctx->mtf_i.len; i++) {
+            uint32_t node_index = sh_mtf_i[i];
+            NEXTENT (uint32_t, vb_ctx->mtf_i) = (node_index >= ol_len && node_index - ol_len < new_len) ? node_map[node_index - ol_len] : node_index;
+        }
+
+        // append local. note: some contexts only count their length in local, while the data remains in txt_data
+        if (buf_is_allocated (&sh_ctx->local) && sh_ctx->local.len) {
+            unsigned width = ctx_lt_sizeof_one[sh_ctx->ltype];
+            buf_alloc (vb, &vb_ctx->local, (vb_ctx->local.len + sh_ctx->local.len) * width, CTX_GROWTH, "contexts->local", vb_ctx->did_i);
+            memcpy (&vb_ctx->local.data[vb_ctx->local.len * width], sh_ctx->local.data, sh_ctx->local.len * width);
+        }
+        vb_ctx->local.len += sh_ctx->local.len;
+
+        vb_ctx->txt_len        += sh_ctx->txt_len;
+        vb_ctx->num_singletons += sh_ctx->num_singletons;
+
+        // return the borrowed buffers, so that releasing the shard doesn't free them
+        memset (&sh_ctx->ol_dict, 0, sizeof (Buffer));
+        memset (&sh_ctx->ol_mtf, 0, sizeof (Buffer));
+        memset (&sh_ctx->global_hash, 0, sizeof (Buffer));
+    }
+}
+
 void mtf_initialize_for_zip (void)
 {
     if (z_file->dicts_mutex_initialized) return;
@@ -384,11 +474,11 @@ void mtf_initialize_for_zip (void)
     unsigned ret = pthread_mutex_init (&z_file->dicts_mutex, NULL);
     ASSERT0 (!ret, "pthread_mutex_init failed for z_file->dicts_mutex");
 
-    ret = pthread_mutex_init (&wait_for_vb_1_mutex, NULL);
-    ASSERT0 (!ret, "pthread_mutex_init failed for wait_for_vb_1_mutex");
-
     ret = pthread_mutex_init (&compress_dictionary_data_mutex, NULL);
     ASSERT0 (!ret, "pthread_mutex_init failed for compress_dictionary_data_mutex");
+
+    ret = pthread_cond_init (&dict_frag_appended_cond, NULL);
+    ASSERT0 (!ret, "pthread_cond_init failed for dict_frag_appended_cond");
 }
 
 // find the z_file context that corresponds to dict_id. It could be possibly a different did_i
@@ -430,6 +520,7 @@ static MtfContext *mtf_add_new_zf_ctx (VBlock *merging_vb, const MtfContext *vb_
     zf_ctx->dict_id           = vb_ctx->dict_id;
     zf_ctx->flags             = vb_ctx->flags;
     zf_ctx->ltype        = vb_ctx->ltype;
+    zf_ctx->b250_comp_alg     = zf_ctx->local_comp_alg = COMP_UNKNOWN;
     memcpy ((char*)zf_ctx->name, vb_ctx->name, sizeof(zf_ctx->name));
 
     // only when the new entry is finalized, do we increment num_dict_ids, atmoically , this is because
@@ -443,7 +534,8 @@ finish:
 
 // ZIP only: this is called towards the end of compressing one vb - merging its dictionaries into the z_file 
 // each dictionary is protected by its own mutex, and there is one z_file mutex protecting num_dicts.
-// we are careful never to hold two muteces at the same time to avoid deadlocks
+// we are careful never to hold two muteces at the same time to avoid deadlocks. zf_ctx->mutex is held only while
+// evaluating the new snips - the dictionary fragment is compressed after releasing it, and appended to z_file->dict_data in order
 static void mtf_merge_in_vb_ctx_one_dict_id (VBlock *merging_vb, unsigned did_i)
 {
     MtfContext *vb_ctx = &merging_vb->contexts[did_i];
@@ -465,6 +557,10 @@ static void mtf_merge_in_vb_ctx_one_dict_id (VBlock *merging_vb, unsigned did_i)
     zf_ctx->num_new_entries_prev_merged_vb = vb_ctx->mtf.len; // number of new words in this dict from this VB
     zf_ctx->num_singletons += vb_ctx->num_singletons; // add singletons created by seg (i.e. SNIP_LOOKUP_* in b250, and snip in local)
 
+    const char *start_dict = NULL;
+    unsigned added_chars=0, added_words=0;
+    uint32_t dict_frag_i=0;
+
     if (!buf_is_allocated (&vb_ctx->dict)) goto finish; // nothing yet for this dict_id
 
     uint32_t start_dict_len = zf_ctx->dict.len;
@@ -494,7 +590,7 @@ static void mtf_merge_in_vb_ctx_one_dict_id (VBlock *merging_vb, unsigned did_i)
         // encode in base250 - to be used by vcf_zip_generate_genotype_one_section() and zip_generate_b250_section()
         for (unsigned i=0; i < zf_ctx->mtf.len; i++) {
             MtfNode *zf_node = &((MtfNode *)zf_ctx->mtf.data)[i];
-            zf_node->word_index = base250_encode (zf_node->word_index.n); // note that vb overlays this. also, vb_1 has been sorted so word_index != node_index
+            zf_node->word_index = base250_encode (zf_node->word_index.n); // note that vb overlays this
 
             ASSERT (zf_node->word_index.n < zf_ctx->mtf.len, // sanity check
                     "Error: word_index=%u out of bound - mtf.len=%u, in dictionary %s", 
@@ -509,62 +605,80 @@ static void mtf_merge_in_vb_ctx_one_dict_id (VBlock *merging_vb, unsigned did_i)
             
             MtfNode *zf_node;
             bool is_new;
+            uint64_t local_len = vb_ctx->local.len;
+
             // use evb and not vb because zf_context is z_file (which belongs to evb)
             int32_t zf_node_index = 
                 mtf_evaluate_snip_merge (merging_vb, zf_ctx, vb_ctx, &vb_ctx->dict.data[vb_node->char_index], 
                                          vb_node->snip_len, vb_node->count, &zf_node, &is_new);
 
+            // case: the snip is a singleton, moved to local - update the local offsets of the seek points (--seek-points)
+            if (vb_ctx->local.len > local_len && merging_vb->seek_points.len)
+                random_access_seek_points_add_singleton (merging_vb, vb_ctx, i, vb_ctx->local.len - local_len);
+
             ASSERT (zf_node_index >= 0 && zf_node_index < zf_ctx->mtf.len, "Error: zf_node_index=%d out of range - len=%i", zf_node_index, (uint32_t)vb_ctx->mtf.len);
 
             // set word_index to be indexing the global dict - to be used by vcf_zip_generate_genotype_one_section() and zip_generate_b250_section()
             if (is_new)
                 vb_node->word_index = zf_node->word_index = base250_encode (zf_node_index);
             else 
-                // a previous VB already already calculated the word index for this node. if it was done by vb_i=1,
-                // then it is also re-sorted and the word_index is no longer the same as the node_index
+                // a previous VB already calculated the word index for this node (it is the same as the node_index)
                 vb_node->word_index = zf_node->word_index;
         }
     }
 
-    // we now compress the dictionaries directly from z_file. note: we must continue to hold
-    // the mutex during compression, lest another thread re-alloc the dictionary.
-    const char *start_dict = &zf_ctx->dict.data[start_dict_len]; // we take the pointer AFTER the evaluate, since dict can be reallocted
-    unsigned added_chars   = zf_ctx->dict.len - start_dict_len;
-    unsigned added_words   = zf_ctx->mtf.len  - start_mtf_len;
+    // we take the pointer AFTER the evaluate, since dict can be reallocted
+    start_dict  = &zf_ctx->dict.data[start_dict_len]; 
+    added_chars = zf_ctx->dict.len - start_dict_len;
+    added_words = zf_ctx->mtf.len  - start_mtf_len;
 
-    // compress incremental part of dictionary added by this vb. note: dispatcher calls this function in the correct order of VBs.
+    // copy the incremental part of dictionary added by this vb, so we can compress it after releasing the mutex - 
+    // zf_ctx->dict might be realloced by another VB as soon as we release it
     if (added_chars) {
         // special optimization for the GL dictionary (it is ineffective with --optimize-GL that already optimizes GL)
         if (zf_ctx->dict_id.num == dict_id_FORMAT_GL && !flag_optimize_GL) 
             start_dict = gl_optimize_dictionary (merging_vb, &zf_ctx->dict, ENT (MtfNode, zf_ctx->mtf, start_mtf_len), start_dict_len, added_words);
+        else {
+            buf_copy (merging_vb, &merging_vb->dict_frag, &zf_ctx->dict, 1, start_dict_len, added_chars, "dict_frag", did_i);
+            start_dict = merging_vb->dict_frag.data;
+        }
 
-        // we need to protect z_file->dict_data while we're writing to it. this ensures a single writer
-        // to this data. we also need this mutex embedded in the zf_ctx->mutex, so that fragments of
-        // a dictionary are written in the order they are created. 
-        {   START_TIMER; 
-            mtf_lock (merging_vb, &compress_dictionary_data_mutex, "compress_dictionary_data_mutex", merging_vb->vblock_i);
-            COPY_TIMER (merging_vb->profile.lock_mutex_compress_dict);
-        }  
-        zfile_compress_dictionary_data (merging_vb, zf_ctx, added_words, start_dict, added_chars);
-        mtf_unlock (merging_vb, &compress_dictionary_data_mutex, "compress_dictionary_data_mutex", merging_vb->vblock_i);
+        // fragments of a dictionary must be written in the order they are created, as PIZ appends them to the dictionary
+        // in the order they appear in the file, so that word indices match
+        dict_frag_i = zf_ctx->num_dict_frags++;
     }
 
 finish:
     COPY_TIMER (merging_vb->profile.mtf_merge_in_vb_ctx_one_dict_id)
     mtf_unlock (merging_vb, &zf_ctx->mutex, "zf_ctx->mutex", zf_ctx->did_i);
+
+    if (!added_chars) return;
+
+    // compress in parallel with other VBs merging into this and other zf_ctxs
+    SectionHeaderDictionary header;
+    zfile_compress_dictionary_data (merging_vb, zf_ctx, added_words, start_dict, added_chars, (SectionHeaderP)&header);
+
+    // wait for our turn, and append the compressed fragment to z_file->dict_data. compress_dictionary_data_mutex
+    // ensures a single writer to z_file->dict_data
+    {   START_TIMER; 
+        mtf_lock (merging_vb, &compress_dictionary_data_mutex, "compress_dictionary_data_mutex", merging_vb->vblock_i);
+        while (zf_ctx->next_dict_frag != dict_frag_i)
+            pthread_cond_wait (&dict_frag_appended_cond, &compress_dictionary_data_mutex);
+        COPY_TIMER (merging_vb->profile.lock_mutex_compress_dict);
+    }  
+
+    zfile_append_dictionary_data (merging_vb, zf_ctx, (SectionHeaderP)&header, added_words, start_dict, added_chars);
+
+    zf_ctx->next_dict_frag++;
+    pthread_cond_broadcast (&dict_frag_appended_cond);
+    mtf_unlock (merging_vb, &compress_dictionary_data_mutex, "compress_dictionary_data_mutex", merging_vb->vblock_i);
 }
 
 // ZIP only: merge new words added in this vb into the z_file.contexts, and compresses dictionaries.
 void mtf_merge_in_vb_ctx (VBlock *merging_vb)
 {
-    // vb_i=1 goes first, as it has the sorted dictionaries, other vbs can go in
-    // arbitrary order. at the end of this function, vb_i releases the mutex it locked along time ago,
-    // while the other vbs wait for vb_1 by attempting to lock the mutex
-    if (merging_vb->vblock_i != 1) {
-        mtf_lock (merging_vb, &wait_for_vb_1_mutex, "wait_for_vb_1_mutex", merging_vb->vblock_i);
-        mtf_unlock (merging_vb, &wait_for_vb_1_mutex, "wait_for_vb_1_mutex", merging_vb->vblock_i);
-    }
-    
+    // VBs merge in arbitrary order - there is no need for vb_i=1 to go first, as new words are merged in the order
+    // of their first appearance in the VB regardless of the VB they come from.
     mtf_verify_field_ctxs (merging_vb); // this was useful in the past to catch nasty thread issues
 
     // merge all contexts
@@ -576,9 +690,6 @@ void mtf_merge_in_vb_ctx (VBlock *merging_vb)
     // vb_i=2 started, z_file is empty, created 10 contexts
     // vb_i=1 completes, merges 20 contexts to z_file, which has 20 contexts after
     // vb_i=2 completes, merges 10 contexts, of which 5 (for example) are shared with vb_i=1. Now z_file has 25 contexts after.
-
-    if (merging_vb->vblock_i == 1)  
-        mtf_unlock (merging_vb, &wait_for_vb_1_mutex, "wait_for_vb_1_mutex", 1);
 }
 
 static void mtf_initialize_ctx (MtfContext *ctx, DataType dt, uint8_t did_i, DictIdType dict_id, uint8_t *dict_id_to_did_i_map)
@@ -726,14 +837,24 @@ void mtf_initialize_primary_field_ctxs (MtfContext *contexts /* an array */,
     }
 }
 
-// PIZ only: this is called by the I/O thread after reading a dictionary section 
-void mtf_integrate_dictionary_fragment (VBlock *vb, char *section_data)
-{    
-    START_TIMER;
+// PIZ: make room in zf_ctx->dict and zf_ctx->word_list for fragments. Called by the I/O thread only.
+// If there is no room - old memory is abandoned (so that VBs that are overlaying it continue to work uninterrupted) and 
+// a new memory is allocated, where the old dict is joined by the new fragment
+static void mtf_prepare_for_dictionary_fragment (MtfContext *zf_ctx, uint64_t fragment_len, uint64_t num_snips, SectionType st)
+{
+    buf_alloc (evb, &zf_ctx->dict, zf_ctx->dict.len + fragment_len, CTX_GROWTH, "z_file->contexts->dict", st);
+    buf_set_overlayable (&zf_ctx->dict);
 
-    // thread safety note: this function is called only from the piz dispatcher thread,
-    // so no thread safety issues with this static buffer.
-    static Buffer fragment = EMPTY_BUFFER;
+    buf_alloc (evb, &zf_ctx->word_list, (zf_ctx->word_list.len + num_snips) * sizeof (MtfWord), CTX_GROWTH, 
+               "z_file->contexts->word_list", zf_ctx->did_i);
+    buf_set_overlayable (&zf_ctx->word_list);
+}
+
+// PIZ: uncompress a dictionary fragment and append it to zf_ctx, which already has room for it (see mtf_prepare_for_dictionary_fragment).
+// Thread-safe, as long as each thread integrates fragments of different contexts, and uses its own vb and fragment buffer
+static void mtf_integrate_dictionary_fragment_do (VBlock *vb, MtfContext *zf_ctx, char *section_data, Buffer *fragment)
+{
+    START_TIMER;
 
     // thread-safety note: while the dispatcher thread is integrating new dictionary fragments,
     // compute threads might be using these dictionaries. This is ok, bc the dispatcher thread makes
@@ -743,40 +864,23 @@ void mtf_integrate_dictionary_fragment (VBlock *vb, char *section_data)
     // by compute threads, but its change is assumed to be atomic, so that no weird things will happen
     SectionHeaderDictionary *header = (SectionHeaderDictionary *)section_data;
 
-    ASSERT (section_type_is_dictionary(header->h.section_type),
-            "Error in mtf_integrate_dictionary_fragment: header->h.section_type=%s is not a dictionary section", st_name(header->h.section_type));
-
     uint32_t num_snips = BGEN32 (header->num_snips);
 
-    zfile_uncompress_section (vb, section_data, &fragment, "fragment", header->h.section_type);
+    zfile_uncompress_section (vb, section_data, fragment, "fragment", header->h.section_type);
 
     // special treatment if this is GL - de-optimize
     if (header->dict_id.num == dict_id_FORMAT_GL)
-        gl_deoptimize (fragment.data, fragment.len);
+        gl_deoptimize (fragment->data, fragment->len);
 
-    // in piz, the same did_i is used for z_file and vb contexts, meaning that in vbs there could be
-    // a non-contiguous array of contexts (some are missing if not used by this vb)
-
-    MtfContext *zf_ctx = mtf_get_ctx_do (z_file->contexts, z_file->data_type, z_file->dict_id_to_did_i_map, &z_file->num_dict_ids, header->dict_id);
-    
-    // append fragment to dict. If there is no room - old memory is abandoned (so that VBs that are overlaying
-    // it continue to work uninterrupted) and a new memory is allocated, where the old dict is joined by the new fragment
+    // append fragment to dict
     unsigned dict_old_len = zf_ctx->dict.len;
-    buf_alloc (evb, &zf_ctx->dict, zf_ctx->dict.len + fragment.len, CTX_GROWTH, "z_file->contexts->dict", header->h.section_type);
-    buf_set_overlayable (&zf_ctx->dict);
-
-    memcpy (AFTERENT (char, zf_ctx->dict), fragment.data, fragment.len);
-    zf_ctx->dict.len += fragment.len;
-
-    // extend word list memory - and calculate the new words. If there is no room - old memory is abandoned 
-    // (so that VBs that are overlaying it continue to work uninterrupted) and a new memory is allocated
-    buf_alloc (evb, &zf_ctx->word_list, (zf_ctx->word_list.len + num_snips) * sizeof (MtfWord), CTX_GROWTH, 
-               "z_file->contexts->word_list", zf_ctx->did_i);
-    buf_set_overlayable (&zf_ctx->word_list);
+    memcpy (AFTERENT (char, zf_ctx->dict), fragment->data, fragment->len);
+    zf_ctx->dict.len += fragment->len;
 
+    // calculate the new words
     bool is_ref_alt = (!is_v5_or_above && z_file->data_type == DT_VCF && header->dict_id.num == dict_id_fields[VCF_REFALT]);
 
-    char *start = fragment.data;
+    char *start = fragment->data;
     char sep = PIZ_SNIP_SEP; // local variable that can be optimized to a cpu register
     
     for (unsigned snip_i=0; snip_i < num_snips; snip_i++) {
@@ -792,16 +896,164 @@ void mtf_integrate_dictionary_fragment (VBlock *vb, char *section_data)
         }
 
         word->snip_len   = c - start;
-        word->char_index = dict_old_len + (start - fragment.data);
+        word->char_index = dict_old_len + (start - fragment->data);
 
         start = c+1; // skip over the PIZ_SNIP_SEP
     }
 
-    buf_free (&fragment);
+    buf_free (fragment);
 
     COPY_TIMER(vb->profile.mtf_integrate_dictionary_fragment);
 }
 
+// PIZ only: this is called by the I/O thread after reading a dictionary section 
+void mtf_integrate_dictionary_fragment (VBlock *vb, char *section_data)
+{    
+    // thread safety note: this function is called only from the piz dispatcher thread,
+    // so no thread safety issues with this static buffer.
+    static Buffer fragment = EMPTY_BUFFER;
+
+    SectionHeaderDictionary *header = (SectionHeaderDictionary *)section_data;
+
+    ASSERT (section_type_is_dictionary(header->h.section_type),
+            "Error in mtf_integrate_dictionary_fragment: header->h.section_type=%s is not a dictionary section", st_name(header->h.section_type));
+
+    // in piz, the same did_i is used for z_file and vb contexts, meaning that in vbs there could be
+    // a non-contiguous array of contexts (some are missing if not used by this vb)
+    MtfContext *zf_ctx = mtf_get_ctx_do (z_file->contexts, z_file->data_type, z_file->dict_id_to_did_i_map, &z_file->num_dict_ids, header->dict_id);
+
+    mtf_prepare_for_dictionary_fragment (zf_ctx, BGEN32 (header->h.data_uncompressed_len), BGEN32 (header->num_snips), header->h.section_type);
+
+    mtf_integrate_dictionary_fragment_do (vb, zf_ctx, section_data, &fragment);
+}
+
+// PIZ: all fragments of one context, which are integrated by one subtask, in order
+typedef struct {
+    uint32_t first_frag, num_frags;
+    uint64_t uncompressed_len; // for scheduling the largest contexts first
+} DictFragGroup;
+
+typedef struct {
+    const Buffer *z_data;
+    const uint64_t *frags;      // did_i (high 32 bits) and offset of section header in z_data (low 32 bits) of fragments, grouped by context
+    const DictFragGroup *groups;
+    uint32_t num_groups;
+    uint32_t next_group;        // next group to be integrated by any subtask - updated atomically
+} DictIntegration;
+
+typedef struct {
+    DictIntegration *di;
+    VBlockP vb;                 // a VB from the pool - for the uncompression's memory and timers
+} DictIntegrationSubtask;
+
+static void mtf_integrate_dictionary_groups (void *subtask_)
+{
+    DictIntegrationSubtask *subtask = (DictIntegrationSubtask *)subtask_;
+    DictIntegration *di = subtask->di;
+
+    uint32_t group_i;
+    while ((group_i = __atomic_fetch_add (&di->next_group, 1, __ATOMIC_RELAXED)) < di->num_groups) {
+        const DictFragGroup *group = &di->groups[group_i];
+
+        for (uint32_t i=0; i < group->num_frags; i++) {
+            uint64_t frag = di->frags[group->first_frag + i];
+            
+            mtf_integrate_dictionary_fragment_do (subtask->vb, &z_file->contexts[frag >> 32], &di->z_data->data[(uint32_t)frag], 
+                                                  &subtask->vb->dict_frag);
+        }
+    }
+}
+
+static int mtf_sort_frags_by_did_i (const void *a, const void *b)
+{
+    uint64_t ka = *(uint64_t *)a, kb = *(uint64_t *)b; // did_i in the high 32 bits, the offset (i.e. file order) in the low
+    return ka < kb ? -1 : ka > kb;
+}
+
+static int mtf_sort_groups_by_size (const void *a, const void *b)
+{
+    uint64_t la = ((DictFragGroup *)a)->uncompressed_len, lb = ((DictFragGroup *)b)->uncompressed_len;
+    return la > lb ? -1 : la < lb; // descending
+}
+
+// PIZ only: called by the I/O thread after reading dictionary sections into z_data. frag_offsets is an array of uint32_t - the 
+// offsets of the sections within z_data, in the order of the file. If no VBs are in flight, fragments of different contexts
+// are integrated concurrently, as subtasks on the dispatcher's workers, each using a VB of the pool, while the fragments of 
+// each context are integrated in order. If VBs are in flight (lazy dictionaries), the pool's VBs might all be in use, so we 
+// integrate the fragments one at a time.
+void mtf_integrate_dictionary_fragments (const Buffer *z_data, const Buffer *frag_offsets, bool vbs_in_flight)
+{
+    static Buffer frags_buf = EMPTY_BUFFER, groups_buf = EMPTY_BUFFER;
+
+    if (vbs_in_flight || global_max_threads == 1) {
+        for (uint32_t i=0; i < frag_offsets->len; i++) 
+            mtf_integrate_dictionary_fragment (evb, &z_data->data[*ENT (uint32_t, *frag_offsets, i)]);
+        return;
+    }
+
+    // create the contexts, in the order of the file (as mtf_integrate_dictionary_fragment would), and make room for the
+    // fragments in their dict and word_list, so that the subtasks don't need to allocate evb memory
+    buf_alloc (evb, &frags_buf, frag_offsets->len * sizeof (uint64_t), 1, "frags_buf", 0);
+    ARRAY (uint64_t, frags, frags_buf);
+    
+    uint64_t dict_len[MAX_DICTS] = {}, num_snips[MAX_DICTS] = {};
+    SectionType st[MAX_DICTS];
+
+    for (uint32_t i=0; i < frag_offsets->len; i++) {
+        uint32_t offset = *ENT (uint32_t, *frag_offsets, i);
+        SectionHeaderDictionary *header = (SectionHeaderDictionary *)&z_data->data[offset];
+
+        ASSERT (section_type_is_dictionary(header->h.section_type),
+                "Error in mtf_integrate_dictionary_fragments: header->h.section_type=%s is not a dictionary section", st_name(header->h.section_type));
+
+        MtfContext *zf_ctx = mtf_get_ctx_do (z_file->contexts, z_file->data_type, z_file->dict_id_to_did_i_map, &z_file->num_dict_ids, header->dict_id);
+        
+        dict_len[zf_ctx->did_i]  += BGEN32 (header->h.data_uncompressed_len);
+        num_snips[zf_ctx->did_i] += BGEN32 (header->num_snips);
+        st[zf_ctx->did_i]         = header->h.section_type;
+
+        frags[i] = ((uint64_t)zf_ctx->did_i << 32) | offset;
+    }
+
+    for (unsigned did_i=0; did_i < z_file->num_dict_ids; did_i++)
+        if (dict_len[did_i] || num_snips[did_i])
+            mtf_prepare_for_dictionary_fragment (&z_file->contexts[did_i], dict_len[did_i], num_snips[did_i], st[did_i]);
+
+    // group the fragments by context, retaining the file order within each context
+    qsort (frags, frag_offsets->len, sizeof (uint64_t), mtf_sort_frags_by_did_i);
+
+    buf_alloc (evb, &groups_buf, frag_offsets->len * sizeof (DictFragGroup), 1, "groups_buf", 0);
+    groups_buf.len = 0;
+
+    for (uint32_t i=0; i < frag_offsets->len; i++) {
+        if (!i || (frags[i] >> 32) != (frags[i-1] >> 32)) 
+            NEXTENT (DictFragGroup, groups_buf) = (DictFragGroup){ .first_frag = i };
+
+        DictFragGroup *group = LASTENT (DictFragGroup, groups_buf);
+        group->num_frags++;
+        group->uncompressed_len += BGEN32 (((SectionHeader *)&z_data->data[(uint32_t)frags[i]])->data_uncompressed_len);
+    }
+
+    // the largest contexts first, so that a large context integrated last doesn't leave the other subtasks idle
+    qsort (groups_buf.data, groups_buf.len, sizeof (DictFragGroup), mtf_sort_groups_by_size);
+
+    DictIntegration di = { .z_data = z_data, .frags = frags, .groups = FIRSTENT (DictFragGroup, groups_buf), 
+                           .num_groups = groups_buf.len };
+
+    // no VBs are in flight, so the pool has at least global_max_threads free VBs
+    unsigned num_subtasks = MIN (MIN (global_max_threads, MAX_SUBTASKS), groups_buf.len);
+    DictIntegrationSubtask subtasks[MAX_SUBTASKS];
+    for (unsigned i=0; i < num_subtasks; i++) 
+        subtasks[i] = (DictIntegrationSubtask){ .di = &di, .vb = vb_get_vb (0) };
+
+    dispatcher_run_subtasks (mtf_integrate_dictionary_groups, subtasks, sizeof (DictIntegrationSubtask), num_subtasks);
+
+    for (unsigned i=0; i < num_subtasks; i++) {
+        if (flag_show_time) profiler_add (&evb->profile, &subtasks[i].vb->profile);
+        vb_release_vb (subtasks[i].vb);
+    }
+}
+
 // PIZ only: this is called by the I/O thread after it integrated all the dictionary fragment read from disk for one VB.
 // Here we hand over the integrated dictionaries to the VB - in preparation for the Compute Thread to use them.
 // We overlay the z_file's dictionaries and word lists to the vb. these data remain unchanged - neither
@@ -847,54 +1099,6 @@ MtfNode *mtf_get_node_by_word_index (MtfContext *ctx, uint32_t word_index)
     return NULL; // never reaches here
 }
 
-static Buffer *sorter_cmp_mtf = NULL; // for use by sorter_cmp - used only in vblock_i=1, so no thread safety issues
-static int sorter_cmp(const void *a, const void *b)  
-{ 
-    return ENT (MtfNode, *sorter_cmp_mtf, *(uint32_t *)b)->count -
-           ENT (MtfNode, *sorter_cmp_mtf, *(uint32_t *)a)->count;
-}
-
-void mtf_sort_dictionaries_vb_1(VBlock *vb)
-{
-    // thread safety note: no issues here, as this is run only by the compute thread of vblock_i=1
-    for (unsigned did_i=0; did_i < vb->num_dict_ids; did_i++) {
-
-        MtfContext *ctx = &vb->contexts[did_i];
-
-        // prepare sorter array containing indeces into ctx->mtf. We are going to sort it rather than sort mtf directly
-        // as the b250 data contains node indeces into ctx->mtf.
-        static Buffer sorter = EMPTY_BUFFER;
-        buf_alloc (vb, &sorter, ctx->mtf.len * sizeof (int32_t), CTX_GROWTH, "sorter", ctx->did_i);
-        for (uint32_t i=0; i < ctx->mtf.len; i++)
-            NEXTENT (uint32_t, sorter) = i;
-
-        // sort in ascending order of mtf->count
-        sorter_cmp_mtf = &ctx->mtf; // communicate the ctx to sorter_cmp via a global var
-        qsort (sorter.data, ctx->mtf.len, sizeof (uint32_t), sorter_cmp);
-
-        // rebuild dictionary is the sorted order, and update char and word indices in mtf
-        static Buffer old_dict = EMPTY_BUFFER;
-        buf_move (vb, &old_dict, vb, &ctx->dict);
-
-        buf_alloc (vb, &ctx->dict, old_dict.len, CTX_GROWTH, "contexts->dict", did_i);
-        ctx->dict.len = old_dict.len;
-
-        char *next = ctx->dict.data;
-        for (unsigned i=0; i < ctx->mtf.len; i++) {
-            uint32_t node_index = *ENT (uint32_t, sorter, i);
-            MtfNode *node = ENT (MtfNode, ctx->mtf, node_index);
-            memcpy (next, &old_dict.data[node->char_index], node->snip_len + 1 /* +1 for SNIP_SEP */);
-            node->char_index   = next - ctx->dict.data;
-            node->word_index.n = i;
-
-            next += node->snip_len + 1;
-        }
-
-        buf_free (&sorter);
-        buf_destroy (&old_dict);
-    }
-}
-
 // for safety, verify that field ctxs are what they say they are. we had bugs in the past where they got mixed up due to
 // delicate thread logic.
 void mtf_verify_field_ctxs_do (VBlock *vb, const char *func, uint32_t code_line)
@@ -940,11 +1144,12 @@ void mtf_free_context (MtfContext *ctx)
     ctx->dict_id.num = 0;
     ctx->iterator.next_b250 = NULL;
     ctx->iterator.prev_word_index =0;
-    ctx->local_hash_prime = 0;
-    ctx->global_hash_prime = 0;
+    ctx->local_hash_size = 0;
+    ctx->global_hash_size = 0;
     ctx->merge_num = 0;
+    ctx->num_dict_frags = ctx->next_dict_frag = 0;
     ctx->mtf_len_at_1_3 = ctx->mtf_len_at_2_3 = 0;
-    ctx->txt_len = ctx->next_local = ctx->num_singletons = ctx->num_failed_singletons = 0;
+    ctx->txt_len = ctx->next_local = ctx->num_singletons = ctx->num_failed_singletons = ctx->num_words_used = 0;
     ctx->last_delta = ctx->last_value = 0;
     ctx->last_line_i = 0;
     memset ((char*)ctx->name, 0, sizeof(ctx->name));
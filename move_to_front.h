@@ -111,6 +111,7 @@ extern const int64_t ctx_lt_min[NUM_CTX_LT], ctx_lt_max[NUM_CTX_LT];
 #define CTX_FL_LOCAL_LZMA  0x02 // compress local with lzma
 #define CTX_FL_STORE_VALUE 0x04 // the values of this ctx are uint32_t, and are a basis for a delta calculation (by this field or another one)
 #define CTX_FL_STRUCTURED  0x08 // snips usually contain Structured
+#define CTX_FL_LOCAL_QUAL  0x10 // compress local with the quality strings codec
 #define CTX_FL_POS         0x03 // A POS field that stores a delta vs. a different field
 #define CTX_FL_POS_BASE    0x07 // A POS field that is the base for delta calculations (with itself and/or other fields)
 #define CTX_FL_ID          0x03 // An ID field that is split between a numeric component in local and a textual component in b250
@@ -140,13 +141,13 @@ typedef struct MtfContext {
     
     // hash stuff 
     Buffer local_hash;         // hash table for entries added by this VB that are not yet in the global (until merge_number)
-                               // obtained by hash function hash(snip) and the rest of linked to them by linked list
-    uint32_t local_hash_prime; // prime number - size of the core (without extensions) has table 
+                               // an open-addressing table - see hash.c
+    uint32_t local_hash_size;  // number of slots in local_hash - a power of 2
     int32_t num_new_entries_prev_merged_vb; // zf_ctx: updated in every merge - how many new words happened in this VB
                                // vb_ctx: copied from zf_ctx during clone, and used to initialize the size of local_hash
                                //         0 means no VB merged yet with this. if a previous vb had 0 new words, it will still be 1.
     Buffer global_hash;        // global hash table that is populated during merge in zf_ctx and is overlayed to vb_ctx during clone.
-    uint32_t global_hash_prime; // prime number - size of the core (without extensions) has table 
+    uint32_t global_hash_size; // number of slots in global_hash - a power of 2. doubles when the table grows
 
     uint32_t merge_num;        // in vb_ctx: the merge_num when global_hash was cloned. only entries with merge_num <= this number 
                                // are valid. other entries may be added by later merges and should be ignored.
@@ -158,12 +159,16 @@ typedef struct MtfContext {
     uint64_t txt_len;          // How many characters in the txt file are accounted for by snips in this ctx (for stats)
     uint32_t num_singletons;   // True singletons that appeared exactly once in the entire file
     uint32_t num_failed_singletons;// Words that we wrote into local in one VB only to discover later that they're not a singleton, and wrote into the global dict too
+    uint32_t num_words_used;   // VB: 1 + the highest word index in this VB's b250 or GT data (0 if none) - for SEC_DICT_INDEX
 
     // ----------------------------
     // ZIP in z_file only
     // ----------------------------
     pthread_mutex_t mutex;     // MtfContext in z_file (only) is protected by a mutex 
     bool mutex_initialized;
+    uint32_t num_dict_frags;   // number of dictionary fragments issued to merging VBs (protected by mutex)
+    uint32_t next_dict_frag;   // next dictionary fragment to be appended to z_file->dict_data (protected by compress_dictionary_data_mutex)
+    int8_t b250_comp_alg, local_comp_alg; // --codec-policy, --rans and quality strings: CompressionAlg of the b250 and local sections of this ctx, chosen by the first VB to compress them (COMP_UNKNOWN until then)
     
     // ----------------------------
     // PIZ only fields
@@ -175,6 +180,8 @@ typedef struct MtfContext {
     uint32_t last_line_i;      // PIZ only: the last line_i this ctx was encountered
     int64_t last_value;        // PIZ only: last value from which to conduct a delta. 
     int64_t last_delta;        // PIZ only: last delta value calculated
+    bool dict_pending;         // PIZ only: z_file: dictionary not fully read yet - it is read as VBs need it (DICTREAD_LAZY)
+    uint32_t next_dict_sl_i;   // PIZ only: z_file: with dict_pending - index into z_file->section_list_buf from which to look for the next fragment to read
 } MtfContext;
 
 // factor in which we grow buffers in CTX upon realloc
@@ -186,6 +193,8 @@ extern uint32_t mtf_evaluate_snip_seg (VBlockP segging_vb, MtfContextP vb_ctx, c
 extern uint32_t mtf_get_next_snip (VBlockP vb, MtfContext *ctx, SnipIterator *override_iterator, const char **snip, uint32_t *snip_len);
 extern int32_t mtf_search_for_word_index (MtfContext *ctx, const char *snip, unsigned snip_len);
 extern void mtf_clone_ctx (VBlockP vb);
+extern void mtf_clone_ctx_to_shard (VBlockP shard, ConstVBlockP vb);
+extern void mtf_merge_in_shard_ctx (VBlockP vb, VBlockP shard, const unsigned *num_dict_ids_at_hint);
 extern MtfNode *mtf_node_vb_do (const MtfContext *ctx, uint32_t node_index, const char **snip_in_dict, uint32_t *snip_len, const char *func, uint32_t code_line);
 #define mtf_node_vb(ctx, node_index, snip_in_dict, snip_len) mtf_node_vb_do(ctx, node_index, snip_in_dict, snip_len, __FUNCTION__, __LINE__)
 extern MtfNode *mtf_node_zf_do (const MtfContext *ctx, int32_t node_index, const char **snip_in_dict, uint32_t *snip_len, const char *func, uint32_t code_line);
@@ -210,8 +219,8 @@ extern uint8_t mtf_get_existing_did_i (VBlockP vb, DictIdType dict_id);
 extern uint8_t mtf_get_existing_did_i_from_z_file (DictIdType dict_id);
 
 extern void mtf_integrate_dictionary_fragment (VBlockP vb, char *data);
+extern void mtf_integrate_dictionary_fragments (ConstBufferP z_data, ConstBufferP frag_offsets, bool vbs_in_flight);
 extern void mtf_overlay_dictionaries_to_vb (VBlockP vb);
-extern void mtf_sort_dictionaries_vb_1(VBlockP vb);
 extern void mtf_verify_field_ctxs_do (VBlockP vb, const char *func, uint32_t code_line);
 #define mtf_verify_field_ctxs(vb) mtf_verify_field_ctxs_do(vb, __FUNCTION__, __LINE__);
 
@@ -220,7 +229,6 @@ extern void mtf_update_stats (VBlockP vb);
 extern void mtf_free_context (MtfContext *ctx);
 extern void mtf_destroy_context (MtfContext *ctx);
 
-extern void mtf_vb_1_lock (VBlockP vb);
 extern MtfNode *mtf_get_node_by_word_index (MtfContext *ctx, uint32_t word_index);
 extern void mtf_initialize_primary_field_ctxs (MtfContext *contexts /* an array */, DataType dt, uint8_t *dict_id_to_did_i_map, unsigned *num_dict_ids);
 
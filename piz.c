@@ -454,6 +454,9 @@ static void piz_uncompress_one_vb (VBlock *vb)
         piz_uncompress_all_ctxs (vb);
     }
 
+    if (vb->seek_points_header_offset) 
+        random_access_uncompress_seek_points (vb);
+
     DTP(uncompress)(vb);
 
     vb->is_processed = true; /* tell dispatcher this thread is done and can be joined. this operation needn't be atomic, but it likely is anyway */ 
@@ -467,12 +470,10 @@ static void piz_read_all_ctxs (VBlock *vb, SectionListEntry **next_sl)
 
     // note: since v5, all b250 files are SEC_B250, but files compressed with v2-v4 will have SEC_VCF_*_B250
     while (section_type_is_b250 ((*next_sl)->section_type) || (*next_sl)->section_type == SEC_LOCAL) {
-        *ENT (unsigned, vb->z_section_headers, vb->z_section_headers.len) = vb->z_data.len; 
-
         int32_t ret = zfile_read_section (vb, vb->vblock_i, NO_SB_I, &vb->z_data, "z_data", sizeof(SectionHeaderCtx), 
                                           (*next_sl)->section_type, *next_sl); // returns 0 if section is skipped
 
-        if (ret) vb->z_section_headers.len++;
+        if (ret) NEXTENT (unsigned, vb->z_section_headers) = ret;
 
         (*next_sl)++;                             
     }
@@ -499,7 +500,7 @@ static DataType piz_read_global_area (Md5Hash *original_file_digest) // out
         
         // read random access, but only if we are going to need it
         if (flag_regions || flag_show_index) {
-            zfile_read_all_dictionaries (0, DICTREAD_CHROM_ONLY); // read all CHROM/RNAME dictionaries - needed for regions_make_chregs()
+            zfile_read_all_dictionaries (DICTREAD_CHROM_ONLY); // read all CHROM/RNAME dictionaries - needed for regions_make_chregs()
 
             // update chrom node indeces using the CHROM dictionary, for the user-specified regions (in case -r/-R were specified)
             regions_make_chregs (dt_fields[data_type].chrom);
@@ -507,7 +508,7 @@ static DataType piz_read_global_area (Md5Hash *original_file_digest) // out
             // if the regions are negative, transform them to the positive complement instead
             regions_transform_negative_to_positive_complement();
 
-            SectionListEntry *ra_sl = sections_get_offset_first_section_of_type (SEC_RANDOM_ACCESS);
+            SectionListEntry *ra_sl = sections_get_offset_first_section_of_type (SEC_RANDOM_ACCESS, false);
             zfile_read_section (evb, 0, NO_SB_I, &evb->z_data, "z_data", sizeof (SectionHeader), SEC_RANDOM_ACCESS, ra_sl);
 
             zfile_uncompress_section (evb, evb->z_data.data, &z_file->ra_buf, "z_file->ra_buf", SEC_RANDOM_ACCESS);
@@ -526,9 +527,25 @@ static DataType piz_read_global_area (Md5Hash *original_file_digest) // out
         // get the last vb_i that included in the regions - returns -1 if no vb has the requested regions
         int32_t last_vb_i = flag_regions ? random_access_get_last_included_vb_i() : 0;
 
-        // read dictionaries (this also seeks to the start of the dictionaries)
+        // read dictionaries (this also seeks to the start of the dictionaries). with --regions or --grep, each dictionary
+        // is read only when the first VB that uses it is read - VBs excluded by --regions don't cause any dictionary reading
+        bool lazy = (flag_regions || flag_grep) && !flag_show_dict && !dict_id_show_one_dict.num;
+
+        // with lazy dictionaries, read the dictionary index if the file has one, so we read only the dictionary fragments needed
+        SectionListEntry *dict_index_sl = lazy ? sections_get_offset_first_section_of_type (SEC_DICT_INDEX, true) : NULL;
+        if (dict_index_sl) {
+            zfile_read_section (evb, 0, NO_SB_I, &evb->z_data, "z_data", sizeof (SectionHeader), SEC_DICT_INDEX, dict_index_sl);
+
+            zfile_uncompress_section (evb, evb->z_data.data, &z_file->dict_index_buf, "z_file->dict_index_buf", SEC_DICT_INDEX);
+
+            z_file->dict_index_buf.len /= sizeof (DictIndexEntry);
+            BGEN_random_access_dict_index();
+
+            buf_free (&evb->z_data);
+        }
+
         if (last_vb_i >= 0)
-            zfile_read_all_dictionaries (last_vb_i, flag_regions ? DICTREAD_EXCEPT_CHROM : DICTREAD_ALL);
+            zfile_read_all_dictionaries (lazy ? DICTREAD_LAZY : flag_regions ? DICTREAD_EXCEPT_CHROM : DICTREAD_ALL);
 
         // read dict_id aliases, if there are any
         dict_id_read_aliases();
@@ -545,6 +562,8 @@ static bool piz_read_one_vb (VBlock *vb)
 
     SectionListEntry *sl = sections_vb_first (vb->vblock_i); 
 
+    zfile_read_lazy_dictionaries (vb->vblock_i, sl); // with --regions or --grep: read dictionaries needed by this VB and not read yet
+
     int vb_header_offset = zfile_read_section (vb, vb->vblock_i, NO_SB_I, &vb->z_data, "z_data", 
                                                z_file->data_type == DT_VCF ? sizeof (SectionHeaderVbHeaderVCF) : sizeof (SectionHeaderVbHeader), 
                                                SEC_VB_HEADER, sl++); 
@@ -558,6 +577,14 @@ static bool piz_read_one_vb (VBlock *vb)
     // read all b250 and local of all fields and subfields
     piz_read_all_ctxs (vb, &sl);
 
+    // read the seek points of this VB, if it has them (--seek-points), so that with --regions we can skip the segments 
+    // of the VB that don't include any region
+    if (sl->section_type == SEC_SEEK_POINTS) {
+        if (flag_regions) 
+            vb->seek_points_header_offset = zfile_read_section (vb, vb->vblock_i, NO_SB_I, &vb->z_data, "z_data", sizeof (SectionHeader), SEC_SEEK_POINTS, sl);
+        sl++;
+    }
+
     // read additional sections and other logic specific to this data type
     bool ok_to_compute = DTPZ(read_one_vb) ? DTPZ(read_one_vb)(vb, sl) : true; // true if we should go forward with computing this VB (otherwise skip it)
 
@@ -635,13 +662,13 @@ bool piz_dispatcher (const char *z_basename, unsigned max_threads,
         dispatcher_resume (dispatcher); // accept more input 
 
     // this is the dispatcher loop. In each iteration, it can do one of 3 things, in this order of priority:
-    // 1. In input is not exhausted, and a compute thread is available - read a variant block and compute it
+    // 1. In input is not exhausted, and the dispatcher has a free slot - read a variant block and compute it
     // 2. Wait for the first thread (by sequential order) to complete and write data
 
     bool header_only_file = true; // initialize
     do {
-        // PRIORITY 1: In input is not exhausted, and a compute thread is available - read a variant block and compute it
-        if (!dispatcher_is_input_exhausted (dispatcher) && dispatcher_has_free_thread (dispatcher)) {
+        // PRIORITY 1: In input is not exhausted, and the dispatcher has a free slot - read a variant block and compute it
+        if (!dispatcher_is_input_exhausted (dispatcher) && dispatcher_has_free_slot (dispatcher)) {
 
             bool still_more_data = false, grepped_out = false;
             if (is_v2_or_above) {
@@ -707,6 +734,10 @@ bool piz_dispatcher (const char *z_basename, unsigned max_threads,
 
             txtfile_write_one_vblock (processed_vb);
             z_file->num_vbs++;
+
+            // if z_file is mapped - we're done with this VB's part of the file
+            if (processed_vb->z_data.type == BUF_MMAP) 
+                file_advise_dontneed (z_file, processed_vb->z_data.data - z_file->mmap_data, processed_vb->z_data.len);
             
             z_file->txt_data_so_far_single += processed_vb->vb_data_size; 
 
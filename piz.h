@@ -33,8 +33,8 @@ extern int32_t piz_decode_pos (VBlockP vb, int32_t last_pos, const char *delta_s
     vb->z_section_headers.len =1;
 
 #define READ_SB_SECTION(sec,header_type,sb_i) \
-    { NEXTENT (unsigned, vb->z_section_headers) = (uint32_t)vb->z_data.len; \
-      zfile_read_section ((VBlockP)vb, vb->vblock_i, sb_i, &vb->z_data, "z_data", sizeof(header_type), sec, sl++); }
+    { NEXTENT (unsigned, vb->z_section_headers) = \
+        (uint32_t)zfile_read_section ((VBlockP)vb, vb->vblock_i, sb_i, &vb->z_data, "z_data", sizeof(header_type), sec, sl++); }
 
 #define READ_SECTION(sec,header_type,is_optional) {  \
     if (!(is_optional) || sl->section_type == (sec)) \
@@ -34,6 +34,8 @@ void profiler_add (ProfilerRec *dst, const ProfilerRec *src)
     dst->vcf_zip_generate_phase_sections   += src->vcf_zip_generate_phase_sections;
     dst->zip_generate_variant_data_section += src->zip_generate_variant_data_section;
     dst->md5                               += src->md5;
+    dst->bgzf_uncompress_vb                += src->bgzf_uncompress_vb;
+    dst->bgzf_records_to_txt               += src->bgzf_records_to_txt;
     dst->lock_mutex_compress_dict          += src->lock_mutex_compress_dict;
     dst->lock_mutex_zf_ctx                 += src->lock_mutex_zf_ctx;    
     dst->mtf_merge_in_vb_ctx_one_dict_id   += src->mtf_merge_in_vb_ctx_one_dict_id;
@@ -106,6 +108,8 @@ void profiler_print_report (const ProfilerRec *p, unsigned max_threads, unsigned
         fprintf (stderr, "      md5: %u\n", ms(p->md5));
         fprintf (stderr, "   write: %u\n", ms(p->write));
         fprintf (stderr, "GENOZIP compute threads (vcf_zip_compress_one_vb): %u\n", ms(p->compute));
+        fprintf (stderr, "   bgzf_uncompress_vb: %u\n", ms(p->bgzf_uncompress_vb));
+        fprintf (stderr, "   bgzf_records_to_txt: %u\n", ms(p->bgzf_records_to_txt));
         fprintf (stderr, "   compressor: %u\n", ms(p->compressor));
         fprintf (stderr, "   seg_all_data_lines: %u\n", ms(p->seg_all_data_lines));
         fprintf (stderr, "   vcf_zip_generate_haplotype_sections: %u\n", ms(p->vcf_zip_generate_haplotype_sections));
@@ -116,9 +120,9 @@ void profiler_print_report (const ProfilerRec *p, unsigned max_threads, unsigned
         fprintf (stderr, "   zip_generate_variant_data_section: %u\n", ms(p->zip_generate_variant_data_section));
         fprintf (stderr, "   mtf_clone_ctx: %u\n", ms(p->mtf_clone_ctx));
         fprintf (stderr, "   lock_mutex_zf_ctx: %u\n", ms(p->lock_mutex_zf_ctx));
-        fprintf (stderr, "      mtf_merge_in_vb_ctx_one_dict_id: %u\n", ms(p->mtf_merge_in_vb_ctx_one_dict_id));
-        fprintf (stderr, "      lock_mutex_compress_dict: %u\n", ms(p->lock_mutex_compress_dict));
-        fprintf (stderr, "         zfile_compress_dictionary_data: %u\n", ms(p->zfile_compress_dictionary_data));
+        fprintf (stderr, "      mtf_merge_in_vb_ctx_one_dict_id (holding zf_ctx mutex): %u\n", ms(p->mtf_merge_in_vb_ctx_one_dict_id));
+        fprintf (stderr, "   zfile_compress_dictionary_data: %u\n", ms(p->zfile_compress_dictionary_data));
+        fprintf (stderr, "   lock_mutex_compress_dict (incl. waiting for fragment order): %u\n", ms(p->lock_mutex_compress_dict));
     }    
     fprintf (stderr, "buf_alloc: %u\n", ms(p->buf_alloc));
     fprintf (stderr, "tmp1: %u tmp2: %u tmp3: %u tmp4: %u tmp5: %u\n\n", ms(p->tmp1), ms(p->tmp2), ms(p->tmp3), ms(p->tmp4), ms(p->tmp5));
@@ -23,7 +23,7 @@ typedef struct {
         seg_all_data_lines, vcf_zip_generate_haplotype_sections, sample_haplotype_data, count_alt_alleles,
         zip_generate_genotype_sections, vcf_zip_generate_phase_sections, zip_generate_variant_data_section,
         mtf_integrate_dictionary_fragment, mtf_clone_ctx, mtf_merge_in_vb_ctx_one_dict_id,
-        md5,zfile_compress_dictionary_data,
+        md5,zfile_compress_dictionary_data, bgzf_uncompress_vb, bgzf_records_to_txt,
         lock_mutex_compress_dict, lock_mutex_zf_ctx,
         tmp1, tmp2, tmp3, tmp4, tmp5;
 } ProfilerRec;
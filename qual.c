@@ -0,0 +1,419 @@
+// ------------------------------------------------------------------
+//   qual.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// A codec for quality strings (SAM QUAL and FASTQ QUAL). Each quality score is coded with an adaptive range coder, in a
+// context of the preceding scores of its read, and its position in the read:
+// - the previous score
+// - the maximum of the two scores before it (omitted if the file has more than QUAL_MAX_ORDER2_SYMS distinct scores)
+// - the position in the read, in quarters of the read length
+// - how much the scores vary in the read so far - the sum of the differences between consecutive scores
+// The scores are first mapped to the indices of the distinct scores in the data, so that binned data (eg --optimize-QUAL)
+// has a small alphabet, and hence few contexts that learn quickly.
+//
+// The length of each read is coded too, before its scores - usually as "same as the previous read". With a callback, each
+// line provides one or two reads (eg the SAM QUAL and U2 fields) - otherwise, the data is a single read.
+//
+// Compressed data:
+//   format      : 1 byte - QUAL_RAW or QUAL_CODED
+//   QUAL_RAW    : the data, uncompressed
+//   QUAL_CODED  : the number of distinct scores minus 1 (1 byte) ; the distinct scores in ascending order (1 byte each) ;
+//                 the range coder stream (absent if there is only one distinct score)
+
+#include "genozip.h"
+#include "qual.h"
+#include "vblock.h"
+
+#define QUAL_RAW   0
+#define QUAL_CODED 1
+
+#define QUAL_MAX_ORDER2_SYMS 64          // with more distinct scores, the context omits the second and third previous scores
+#define QUAL_POS_BUCKETS     4
+#define QUAL_DELTA_BUCKETS   4
+#define QUAL_CTX_BUCKETS     (QUAL_POS_BUCKETS * QUAL_DELTA_BUCKETS)
+#define QUAL_MAX_MODELS      (QUAL_MAX_ORDER2_SYMS * QUAL_MAX_ORDER2_SYMS * QUAL_CTX_BUCKETS) // more than 256 * QUAL_CTX_BUCKETS
+#define QUAL_MAX_FREQS       (QUAL_MAX_MODELS * QUAL_MAX_ORDER2_SYMS)                        // more than 256 * 256 * QUAL_CTX_BUCKETS
+
+#define RC_TOP (1 << 24)
+#define RC_BOT (1 << 16)                 // the total frequency of a model must be smaller than this
+
+#define QUAL_STEP      16                // added to the frequency of a symbol each time it is coded
+#define QUAL_MAX_TOTAL (RC_BOT - 1 - QUAL_STEP) // when the total frequency of a model exceeds this, its frequencies are halved
+
+// an adaptive model of num_syms symbols: the symbols and their frequencies, ordered by descending frequency (approximately - 
+// a symbol moves up one place when its frequency exceeds the previous one's), so that searching for a symbol is usually short
+typedef struct { uint16_t *freq; uint8_t *sym; uint16_t *total; unsigned num_syms; } QualModel;
+
+typedef struct {
+    uint16_t total[QUAL_MAX_MODELS];
+    uint16_t freq[QUAL_MAX_FREQS];              // num_syms frequencies of each model
+    uint8_t sym[QUAL_MAX_FREQS];                // num_syms symbols of each model
+    uint16_t len_same_freq[2], len_same_total;  // read length - same as the previous read, or not
+    uint8_t len_same_sym[2];
+    uint16_t len_byte_freq[4][256], len_byte_total[4]; // read length - its 4 bytes, if not the same
+    uint8_t len_byte_sym[4][256];
+} QualWorkspace;
+
+uint32_t qual_workspace_size (void)
+{
+    return sizeof (QualWorkspace);
+}
+
+// ------------------
+// range coder
+// ------------------
+
+// a carry-less range coder (after Dmitry Subbotin)
+typedef struct {
+    uint32_t low, range, code;
+    uint8_t *next;           // ZIP: next byte to write PIZ: next byte to read
+    const uint8_t *after;
+    bool overflow;           // ZIP only: output didn't fit
+} RangeCoder;
+
+#define RC_NORMALIZE(rc, shift_byte)                                                              \
+    while (((rc)->low ^ ((rc)->low + (rc)->range)) < RC_TOP ||                                  \
+           ((rc)->range < RC_BOT && (((rc)->range = -(rc)->low & (RC_BOT - 1)), true))) {       \
+        shift_byte;                                                                             \
+        (rc)->low <<= 8;                                                                        \
+        (rc)->range <<= 8;                                                                      \
+    }
+
+static inline void rc_put_byte (RangeCoder *rc, uint8_t b)
+{
+    if (rc->next < rc->after) *rc->next++ = b;
+    else rc->overflow = true;
+}
+
+static inline uint8_t rc_get_byte (RangeCoder *rc)
+{
+    // note: we don't fail if the stream ends prematurely - the decoded data will be wrong, and caught by the length checks
+    return (rc->next < rc->after) ? *rc->next++ : 0;
+}
+
+static inline void rc_encode (RangeCoder *rc, uint32_t cum, uint32_t freq, uint32_t total)
+{
+    rc->range /= total;
+    rc->low   += cum * rc->range;
+    rc->range *= freq;
+
+    RC_NORMALIZE (rc, rc_put_byte (rc, rc->low >> 24));
+}
+
+static void rc_flush (RangeCoder *rc)
+{
+    for (unsigned i=0; i < 4; i++) {
+        rc_put_byte (rc, rc->low >> 24);
+        rc->low <<= 8;
+    }
+}
+
+static void rc_start_decode (RangeCoder *rc)
+{
+    for (unsigned i=0; i < 4; i++) rc->code = (rc->code << 8) | rc_get_byte (rc);
+}
+
+static inline uint32_t rc_get_cum (RangeCoder *rc, uint32_t total)
+{
+    rc->range /= total;
+    uint32_t cum = (rc->code - rc->low) / rc->range;
+    return MIN (cum, total-1); // greater only if the data is corrupted
+}
+
+static inline void rc_decode (RangeCoder *rc, uint32_t cum, uint32_t freq)
+{
+    rc->low   += cum * rc->range;
+    rc->range *= freq;
+
+    RC_NORMALIZE (rc, rc->code = (rc->code << 8) | rc_get_byte (rc));
+}
+
+// ------------------
+// adaptive models
+// ------------------
+
+static inline void qual_model_update (QualModel m, unsigned rank)
+{
+    m.freq[rank] += QUAL_STEP;
+    *m.total     += QUAL_STEP;
+
+    if (rank && m.freq[rank] > m.freq[rank-1]) {
+        uint16_t freq = m.freq[rank]; m.freq[rank] = m.freq[rank-1]; m.freq[rank-1] = freq;
+        uint8_t  sym  = m.sym[rank];  m.sym[rank]  = m.sym[rank-1];  m.sym[rank-1]  = sym;
+    }
+
+    if (*m.total > QUAL_MAX_TOTAL) {
+        *m.total = 0;
+        for (unsigned r=0; r < m.num_syms; r++) {
+            m.freq[r] = (m.freq[r] + 1) / 2; // remains at least 1
+            *m.total += m.freq[r];
+        }
+    }
+}
+
+static inline void qual_encode_sym (RangeCoder *rc, QualModel m, uint8_t sym)
+{
+    uint32_t cum = 0;
+    unsigned rank=0;
+    for (; m.sym[rank] != sym; rank++) cum += m.freq[rank];
+
+    rc_encode (rc, cum, m.freq[rank], *m.total);
+    qual_model_update (m, rank);
+}
+
+static inline uint8_t qual_decode_sym (RangeCoder *rc, QualModel m)
+{
+    uint32_t target = rc_get_cum (rc, *m.total), cum = 0;
+
+    unsigned rank=0;
+    for (; rank < m.num_syms-1 && cum + m.freq[rank] <= target; rank++) cum += m.freq[rank];
+
+    uint8_t sym = m.sym[rank];
+
+    rc_decode (rc, cum, m.freq[rank]);
+    qual_model_update (m, rank);
+
+    return sym;
+}
+
+static void qual_init_models (QualWorkspace *ws, unsigned num_syms, unsigned num_models)
+{
+    for (uint32_t m=0; m < num_models; m++) {
+        for (unsigned r=0; r < num_syms; r++) {
+            ws->freq[m * num_syms + r] = 1;
+            ws->sym [m * num_syms + r] = r;
+        }
+        ws->total[m] = num_syms;
+    }
+
+    ws->len_same_freq[0] = ws->len_same_freq[1] = 1;
+    ws->len_same_sym[0] = 0;
+    ws->len_same_sym[1] = 1;
+    ws->len_same_total = 2;
+
+    for (unsigned b=0; b < 4; b++) {
+        for (unsigned s=0; s < 256; s++) {
+            ws->len_byte_freq[b][s] = 1;
+            ws->len_byte_sym[b][s]  = s;
+        }
+        ws->len_byte_total[b] = 256;
+    }
+}
+
+#define QUAL_MODEL(model) ((QualModel){ &ws->freq[(model) * num_syms], &ws->sym[(model) * num_syms], &ws->total[model], num_syms })
+#define LEN_SAME_MODEL    ((QualModel){ ws->len_same_freq, ws->len_same_sym, &ws->len_same_total, 2 })
+#define LEN_BYTE_MODEL(b) ((QualModel){ ws->len_byte_freq[b], ws->len_byte_sym[b], &ws->len_byte_total[b], 256 })
+
+// ------------------
+// contexts
+// ------------------
+
+typedef struct {
+    unsigned num_syms;
+    bool is_order2;
+    uint32_t read_len, pos;
+    uint32_t pos_bucket, next_bucket_pos; // pos_bucket = pos * QUAL_POS_BUCKETS / read_len
+    uint8_t q1, q2, q3;   // previous scores (indices)
+    uint32_t delta;       // sum of differences between consecutive scores of the read so far
+} QualContext;
+
+static inline void qual_ctx_start_read (QualContext *qc, uint32_t read_len)
+{
+    qc->read_len = read_len;
+    qc->pos = qc->pos_bucket = qc->q1 = qc->q2 = qc->q3 = qc->delta = 0;
+    qc->next_bucket_pos = (read_len + QUAL_POS_BUCKETS-1) / QUAL_POS_BUCKETS; // first pos of bucket 1
+}
+
+// returns the index of the model of the next score
+static inline uint32_t qual_ctx_get_model (const QualContext *qc)
+{
+    unsigned delta_bucket = !qc->delta ? 0 : qc->delta < 8 ? 1 : qc->delta < 32 ? 2 : 3;
+
+    uint32_t prev = qc->is_order2 ? (qc->q1 * qc->num_syms + MAX (qc->q2, qc->q3)) : qc->q1;
+    return prev * QUAL_CTX_BUCKETS + qc->pos_bucket * QUAL_DELTA_BUCKETS + delta_bucket;
+}
+
+static inline void qual_ctx_update (QualContext *qc, uint8_t sym)
+{
+    if (qc->pos) qc->delta += (sym > qc->q1) ? sym - qc->q1 : qc->q1 - sym;
+    qc->q3 = qc->q2;
+    qc->q2 = qc->q1;
+    qc->q1 = sym;
+
+    // note: in reads shorter than QUAL_POS_BUCKETS, some buckets are skipped
+    for (qc->pos++; qc->pos >= qc->next_bucket_pos && qc->pos < qc->read_len; )
+        qc->next_bucket_pos = ((++qc->pos_bucket + 1) * qc->read_len + QUAL_POS_BUCKETS-1) / QUAL_POS_BUCKETS;
+}
+
+// ------------------
+// ZIP
+// ------------------
+
+// iterates over the reads of the data: the lines provided by the callback (one or two reads each), or the contiguous data
+typedef struct {
+    VBlockP vb;
+    CompGetLineCallback *callback;
+    const uint8_t *data;
+    uint32_t data_len;
+    uint32_t line_i;
+    unsigned part_i, num_parts;
+    char *parts[2];
+    uint32_t part_lens[2];
+} QualReads;
+
+static bool qual_next_read (QualReads *r, const uint8_t **read, uint32_t *read_len)
+{
+    if (!r->callback) {
+        if (r->line_i++) return false;
+        *read = r->data;
+        *read_len = r->data_len;
+        return r->data_len > 0;
+    }
+
+    do {
+        while (r->part_i == r->num_parts) {
+            if (r->line_i == r->vb->lines.len) return false;
+
+            r->callback (r->vb, r->line_i++, &r->parts[0], &r->part_lens[0], &r->parts[1], &r->part_lens[1]);
+            r->part_i    = 0;
+            r->num_parts = 2;
+        }
+
+        *read     = (const uint8_t *)r->parts[r->part_i];
+        *read_len = r->part_lens[r->part_i++];
+    } while (!*read_len); // skip empty parts
+
+    return true;
+}
+
+uint32_t qual_compress (VBlock *vb, const uint8_t *uncompressed, uint32_t uncompressed_len, CompGetLineCallback callback,
+                        uint8_t *compressed, uint32_t compressed_size, void *workspace)
+{
+    QualWorkspace *ws = (QualWorkspace *)workspace;
+    const uint8_t *read;
+    uint32_t read_len;
+
+    // first pass - get the distinct scores
+    bool sym_exists[256] = {};
+    QualReads reads = { .vb = vb, .callback = callback, .data = uncompressed, .data_len = uncompressed_len };
+    while (qual_next_read (&reads, &read, &read_len))
+        for (uint32_t i=0; i < read_len; i++) sym_exists[read[i]] = true;
+
+    unsigned num_syms = 0;
+    for (unsigned s=0; s < 256; s++) num_syms += sym_exists[s];
+
+    if (!num_syms || compressed_size < 2 + num_syms) goto raw;
+
+    compressed[0] = QUAL_CODED;
+    compressed[1] = num_syms - 1;
+
+    uint8_t sym_to_idx[256], *next = compressed + 2;
+    for (unsigned s=0; s < 256; s++)
+        if (sym_exists[s]) {
+            sym_to_idx[s] = next - (compressed + 2);
+            *next++ = s;
+        }
+
+    if (num_syms == 1) return 2 + num_syms; // all scores are the same - no need for a stream
+
+    // second pass - code the reads
+    QualContext qc = { .num_syms = num_syms, .is_order2 = (num_syms <= QUAL_MAX_ORDER2_SYMS) };
+    qual_init_models (ws, num_syms, (qc.is_order2 ? num_syms * num_syms : num_syms) * QUAL_CTX_BUCKETS);
+
+    RangeCoder rc = { .range = 0xffffffff, .next = next, .after = compressed + MIN (compressed_size, uncompressed_len + 1) };
+    uint32_t prev_read_len = 0;
+
+    reads = (QualReads){ .vb = vb, .callback = callback, .data = uncompressed, .data_len = uncompressed_len };
+    while (qual_next_read (&reads, &read, &read_len) && !rc.overflow) {
+
+        qual_encode_sym (&rc, LEN_SAME_MODEL, read_len != prev_read_len);
+        if (read_len != prev_read_len)
+            for (unsigned b=0; b < 4; b++)
+                qual_encode_sym (&rc, LEN_BYTE_MODEL(b), (read_len >> (b*8)) & 0xff);
+
+        prev_read_len = read_len;
+
+        qual_ctx_start_read (&qc, read_len);
+        for (uint32_t i=0; i < read_len; i++) {
+            uint8_t sym = sym_to_idx[read[i]];
+            qual_encode_sym (&rc, QUAL_MODEL (qual_ctx_get_model (&qc)), sym);
+            qual_ctx_update (&qc, sym);
+        }
+    }
+
+    rc_flush (&rc);
+
+    // case: the coded data is not smaller than the data (or doesn't fit) - store it as is
+    if (!rc.overflow) return rc.next - compressed;
+
+raw:
+    if (compressed_size < uncompressed_len + 1) return 0;
+
+    compressed[0] = QUAL_RAW;
+    uint8_t *raw_next = compressed + 1;
+
+    reads = (QualReads){ .vb = vb, .callback = callback, .data = uncompressed, .data_len = uncompressed_len };
+    while (qual_next_read (&reads, &read, &read_len)) {
+        memcpy (raw_next, read, read_len);
+        raw_next += read_len;
+    }
+
+    return raw_next - compressed;
+}
+
+// ------------------
+// PIZ
+// ------------------
+
+void qual_uncompress (const uint8_t *compressed, uint32_t compressed_len,
+                      uint8_t *uncompressed, uint32_t uncompressed_len, void *workspace)
+{
+    QualWorkspace *ws = (QualWorkspace *)workspace;
+
+    ASSERT0 (compressed_len >= 1, "Error in qual_uncompress: no data");
+
+    if (compressed[0] == QUAL_RAW) {
+        ASSERT (compressed_len == uncompressed_len + 1, "Error in qual_uncompress: expecting %u bytes of uncompressed data, but there are %u",
+                uncompressed_len, compressed_len - 1);
+        memcpy (uncompressed, &compressed[1], uncompressed_len);
+        return;
+    }
+
+    ASSERT (compressed[0] == QUAL_CODED && compressed_len >= 2 && compressed_len >= 2 + compressed[1] + 1,
+            "Error in qual_uncompress: bad header (format=%u compressed_len=%u)", compressed[0], compressed_len);
+
+    unsigned num_syms = compressed[1] + 1;
+    const uint8_t *idx_to_sym = &compressed[2];
+
+    if (num_syms == 1) {
+        memset (uncompressed, idx_to_sym[0], uncompressed_len);
+        return;
+    }
+
+    QualContext qc = { .num_syms = num_syms, .is_order2 = (num_syms <= QUAL_MAX_ORDER2_SYMS) };
+    qual_init_models (ws, num_syms, (qc.is_order2 ? num_syms * num_syms : num_syms) * QUAL_CTX_BUCKETS);
+
+    RangeCoder rc = { .range = 0xffffffff, .next = (uint8_t *)&compressed[2 + num_syms], .after = compressed + compressed_len };
+    rc_start_decode (&rc);
+
+    uint32_t read_len = 0;
+    for (uint32_t next=0; next < uncompressed_len; next += read_len) {
+
+        if (qual_decode_sym (&rc, LEN_SAME_MODEL)) {
+            read_len = 0;
+            for (unsigned b=0; b < 4; b++)
+                read_len |= (uint32_t)qual_decode_sym (&rc, LEN_BYTE_MODEL(b)) << (b*8);
+        }
+
+        ASSERT (read_len && read_len <= uncompressed_len - next, "Error in qual_uncompress: bad read length %u at offset %u of %u",
+                read_len, next, uncompressed_len);
+
+        qual_ctx_start_read (&qc, read_len);
+        for (uint32_t i=0; i < read_len; i++) {
+            uint8_t sym = qual_decode_sym (&rc, QUAL_MODEL (qual_ctx_get_model (&qc)));
+            uncompressed[next + i] = idx_to_sym[sym];
+            qual_ctx_update (&qc, sym);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+// ------------------------------------------------------------------
+//   qual.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef QUAL_INCLUDED
+#define QUAL_INCLUDED
+
+#include <stdint.h>
+#include "genozip.h"
+#include "compressor.h"
+
+// the caller provides the memory the coder needs, in a workspace of this size
+extern uint32_t qual_workspace_size (void);
+
+// compresses the quality strings - either contiguous data (treated as a single string), or one line at a time, as provided by
+// callback. returns the compressed length, or 0 if compressed_size is too small. compressed_size >= uncompressed_len+1 is
+// always sufficient.
+extern uint32_t qual_compress (VBlockP vb, const uint8_t *uncompressed, uint32_t uncompressed_len, CompGetLineCallback callback,
+                               uint8_t *compressed, uint32_t compressed_size, void *workspace);
+
+extern void qual_uncompress (const uint8_t *compressed, uint32_t compressed_len,
+                             uint8_t *uncompressed, uint32_t uncompressed_len, void *workspace);
+
+#endif
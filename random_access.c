@@ -10,6 +10,10 @@
 #include "file.h"
 #include "endianness.h"
 #include "regions.h"
+#include "zfile.h"
+#include "sections.h"
+
+static void random_access_update_seek_point_pos (VBlock *vb, uint32_t this_pos);
 
 static pthread_mutex_t ra_mutex;
 static bool ra_mutex_initialized = false;
@@ -64,10 +68,12 @@ void random_access_update_pos (VBlock *vb, uint8_t did_i_pos)
     else if (this_pos < ra_ent->min_pos) ra_ent->min_pos = this_pos; 
     
     else if (this_pos > ra_ent->max_pos) ra_ent->max_pos = this_pos;
+
+    random_access_update_seek_point_pos (vb, this_pos);
 }
 
 // called by ZIP compute thread, while holding the z_file mutex: merge in the VB's ra_buf in the global z_file one
-// note: the order of the merge is not necessarily the sequential order of VBs
+// note: the order of the merge is not necessarily the sequential order of VBs - random_access_sort_by_vb sorts them before writing
 void random_access_merge_in_vb (VBlock *vb)
 {
     pthread_mutex_lock (&ra_mutex);
@@ -96,6 +102,21 @@ void random_access_merge_in_vb (VBlock *vb)
     pthread_mutex_unlock (&ra_mutex);
 }
 
+static int random_access_sort_by_vb_i (const void *a, const void *b)
+{
+    const RAEntry *ra_a = (const RAEntry *)a, *ra_b = (const RAEntry *)b;
+
+    if (ra_a->vblock_i != ra_b->vblock_i) return (ra_a->vblock_i < ra_b->vblock_i) ? -1 : 1;
+    return (ra_a->chrom_index < ra_b->chrom_index) ? -1 : (ra_a->chrom_index > ra_b->chrom_index); // a chrom appears at most once per vb
+}
+
+// ZIP I/O thread: VBs merge in the order they complete, so their entries are not necessarily in VB order -
+// sort them, as PIZ (random_access_is_vb_included) expects the entries of each VB to follow those of the previous VB
+void random_access_sort_by_vb (void)
+{
+    qsort (z_file->ra_buf.data, z_file->ra_buf.len, sizeof (RAEntry), random_access_sort_by_vb_i);
+}
+
 // PIZ I/O thread: check if for the given VB,
 // the ranges in random access (from the file) overlap with the ranges in regions (from the command line -r or -R)
 bool random_access_is_vb_included (uint32_t vb_i,
@@ -136,7 +157,7 @@ bool random_access_is_vb_included (uint32_t vb_i,
 int32_t random_access_get_last_included_vb_i (void)
 {
     int32_t last_vb_i = -1;
-    for (unsigned ra_i=0; ra_i < z_file->ra_buf.len; ra_i++) { // note that all entries of the same vb_i are together, but vb_i's are not necessarily in seqential order
+    for (unsigned ra_i=0; ra_i < z_file->ra_buf.len; ra_i++) { // note that entries are sorted by vb_i (see random_access_sort_by_vb)
         
         const RAEntry *ra = ENT (RAEntry, z_file->ra_buf, ra_i);
         if ((int32_t)ra->vblock_i <= last_vb_i) continue; // we already decided to include this vb_i - no need to check further
@@ -165,6 +186,54 @@ unsigned random_access_sizeof_entry()
     return sizeof (RAEntry);
 }
 
+// called by ZIP I/O thread when writing a VB, so entries are in the order of VBs: add the number of words of 
+// each dictionary this VB uses, so that PIZ can read only the dictionary fragments needed for a region
+void random_access_dict_index_merge_in_vb (VBlock *vb)
+{
+    buf_alloc (evb, &z_file->dict_index_buf, (z_file->dict_index_buf.len + vb->num_dict_ids) * sizeof (DictIndexEntry), 2, "z_file->dict_index_buf", 0);
+
+    for (unsigned did_i=0; did_i < vb->num_dict_ids; did_i++) {
+        MtfContext *ctx = &vb->contexts[did_i];
+        if (!ctx->num_words_used) continue;
+
+        NEXTENT (DictIndexEntry, z_file->dict_index_buf) = (DictIndexEntry){ .vblock_i  = BGEN32 (vb->vblock_i), 
+                                                                             .num_words = BGEN32 (ctx->num_words_used),
+                                                                             .dict_id   = ctx->dict_id };
+    }
+}
+
+void BGEN_random_access_dict_index (void)
+{
+    ARRAY (DictIndexEntry, ent, z_file->dict_index_buf);
+
+    for (unsigned i=0; i < z_file->dict_index_buf.len; i++) {
+        ent[i].vblock_i  = BGEN32 (ent[i].vblock_i);
+        ent[i].num_words = BGEN32 (ent[i].num_words);
+    }
+}
+
+// PIZ I/O thread: get the dictionary index entries of a VB. returns NULL if the file has no dictionary index.
+const DictIndexEntry *random_access_get_dict_index (uint32_t vb_i, uint32_t *num_entries)
+{
+    if (!z_file->dict_index_buf.len) return NULL;
+
+    ARRAY (const DictIndexEntry, ent, z_file->dict_index_buf);
+
+    // binary search for the first entry of vb_i (entries are sorted by vblock_i)
+    uint32_t first=0, last=z_file->dict_index_buf.len;
+    while (first < last) {
+        uint32_t mid = (first + last) / 2;
+        if (ent[mid].vblock_i < vb_i) first = mid + 1;
+        else                          last  = mid;
+    }
+
+    uint32_t after = first;
+    while (after < z_file->dict_index_buf.len && ent[after].vblock_i == vb_i) after++;
+
+    *num_entries = after - first;
+    return &ent[first];
+}
+
 void random_access_show_index (bool from_zip)
 {
     fprintf (stderr, "Random-access index contents (result of --show-index):\n");
@@ -191,3 +260,302 @@ void random_access_show_index (bool from_zip)
     }
 }
 
+
+//--------------------------------------------------------------------------------------------------------------------
+// Seek points (--seek-points): every seek_points_interval lines, ZIP snapshots the state of all contexts of the VB. 
+// With --regions, PIZ reconstructs only the segments of a VB that intersect a region, starting each from its seek point,
+// rather than reconstructing all lines of the VB and filtering them.
+//--------------------------------------------------------------------------------------------------------------------
+
+static uint32_t seek_points_interval = 0; // 0 means no seek points
+
+// ZIP only: a seek point while the VB is being compressed - written to the file as a SeekPoint
+typedef struct {
+    uint32_t vb_line_i;
+    uint32_t chrom_node_index;  // NIL if the segment has more than one chrom
+    uint32_t min_pos, max_pos;  // 0 if no line in the segment has a POS (yet)
+    uint32_t first_snapshot;    // index into vb->seek_ctxs of the snapshot of did_i=0. there is one snapshot for each did_i < num_snapshots 
+    uint32_t num_snapshots;     // the number of contexts that existed when the seek point was added
+} ZipSeekPoint;
+
+// ZIP only: the state of a context at a seek point as segged. the b250 and local offsets are finalized after merge
+typedef struct {
+    uint32_t mtf_i_len;         // number of b250 words segged before the seek point
+    uint32_t mtf_len;           // number of nodes new to this VB created before the seek point
+    uint32_t local_len;         // local data segged before the seek point
+    uint32_t singletons_len;    // local data added by merge for singletons created between the previous seek point and this one
+    uint32_t b250_offset;       // set after b250 is generated
+    int32_t  prev_word_index;   
+    int64_t  last_value, last_delta;
+} SeekCtxSnapshot;
+
+void random_access_set_seek_points (const char *interval_str)
+{
+    int interval;
+    ASSERT (sscanf (interval_str, "%d", &interval) == 1 && interval >= 1, 
+            "%s: invalid argument of --seek-points: %s. Expecting a positive integer", global_cmd, interval_str);
+
+    seek_points_interval = interval;
+}
+
+static inline SeekCtxSnapshot *random_access_get_snapshot (VBlock *vb, const ZipSeekPoint *sp, uint8_t did_i)
+{
+    return (did_i < sp->num_snapshots) ? ENT (SeekCtxSnapshot, vb->seek_ctxs, sp->first_snapshot + did_i) : NULL;
+}
+
+// ZIP compute thread: called by seg before segging each line - adds a seek point every seek_points_interval lines 
+void random_access_add_seek_point (VBlock *vb)
+{
+    if (!seek_points_interval || !DTP(has_random_access) || vb->line_i % seek_points_interval) return;
+
+    buf_alloc (vb, &vb->seek_points, (vb->seek_points.len + 1) * sizeof (ZipSeekPoint), 2, "seek_points", vb->vblock_i);
+    buf_alloc (vb, &vb->seek_ctxs, (vb->seek_ctxs.len + vb->num_dict_ids) * sizeof (SeekCtxSnapshot), 2, "seek_ctxs", vb->vblock_i);
+
+    NEXTENT (ZipSeekPoint, vb->seek_points) = (ZipSeekPoint){ .vb_line_i      = vb->line_i, 
+                                                              .first_snapshot = vb->seek_ctxs.len,
+                                                              .num_snapshots  = vb->num_dict_ids };
+
+    for (unsigned did_i=0; did_i < vb->num_dict_ids; did_i++) {
+        MtfContext *ctx = &vb->contexts[did_i];
+
+        NEXTENT (SeekCtxSnapshot, vb->seek_ctxs) = (SeekCtxSnapshot){ .mtf_i_len       = ctx->mtf_i.len,
+                                                                      .mtf_len         = ctx->mtf.len,
+                                                                      .local_len       = ctx->local.len,
+                                                                      .prev_word_index = -1,
+                                                                      .last_value      = ctx->last_value,
+                                                                      .last_delta      = ctx->last_delta };
+    }
+}
+
+// ZIP: update the chrom and pos range of the segment of the current seek point
+static void random_access_update_seek_point_pos (VBlock *vb, uint32_t this_pos)
+{
+    if (!vb->seek_points.len) return;
+
+    ZipSeekPoint *sp = LASTENT (ZipSeekPoint, vb->seek_points);
+
+    if (!sp->min_pos) { // first line with a POS in this segment
+        sp->chrom_node_index = vb->chrom_node_index;
+        sp->min_pos = sp->max_pos = this_pos;
+        return;
+    }
+
+    if (sp->chrom_node_index != vb->chrom_node_index) sp->chrom_node_index = NIL; 
+
+    if      (this_pos < sp->min_pos) sp->min_pos = this_pos; 
+    else if (this_pos > sp->max_pos) sp->max_pos = this_pos;
+}
+
+// ZIP compute thread: called by merge when the snip of node_i (a node new to this VB) turned out to be a singleton, and was 
+// added to local. PIZ consumes it before the local data of all seek points from the first one added after node_i was created
+void random_access_seek_points_add_singleton (VBlock *vb, const MtfContext *ctx, uint32_t node_i, uint32_t singleton_len)
+{
+    ARRAY (ZipSeekPoint, sp, vb->seek_points);
+
+    // binary search for the first seek point at which node_i already existed (mtf_len is non-decreasing across seek points)
+    uint32_t first=0, last=vb->seek_points.len;
+    while (first < last) {
+        uint32_t mid = (first + last) / 2;
+        SeekCtxSnapshot *snap = random_access_get_snapshot (vb, &sp[mid], ctx->did_i);
+        if (snap && snap->mtf_len > node_i) last  = mid;
+        else                                first = mid + 1;
+    }
+
+    if (first < vb->seek_points.len) 
+        random_access_get_snapshot (vb, &sp[first], ctx->did_i)->singletons_len += singleton_len;
+}
+
+// ZIP compute thread: called when the dictionary of a context with all-unique words is moved to local (and it has no b250). 
+// its local data is the snips of its nodes in the order they were created, each followed by a separator
+void random_access_seek_points_unique_words (VBlock *vb, const MtfContext *ctx)
+{
+    ARRAY (ZipSeekPoint, sp, vb->seek_points);
+
+    for (unsigned i=0; i < vb->seek_points.len; i++) {
+        SeekCtxSnapshot *snap = random_access_get_snapshot (vb, &sp[i], ctx->did_i);
+        if (!snap) continue;
+
+        snap->local_len = (snap->mtf_len < ctx->mtf.len) ? ENT (MtfNode, ctx->mtf, snap->mtf_len)->char_index : ctx->local.len;
+        snap->mtf_i_len = 0;
+    }
+}
+
+// ZIP compute thread: after the b250 of a context is generated - calculate the b250 offset of each seek point, 
+// by decoding the b250 data in the same way PIZ consumes it
+void random_access_seek_points_b250 (VBlock *vb, const MtfContext *ctx)
+{
+    if (!vb->seek_points.len) return;
+
+    ARRAY (ZipSeekPoint, sp, vb->seek_points);
+
+    const uint8_t *next = FIRSTENT (const uint8_t, ctx->b250);
+    uint32_t word_i = 0;
+    int32_t prev_word_index = -1;
+
+    for (unsigned i=0; i < vb->seek_points.len; i++) {
+        SeekCtxSnapshot *snap = random_access_get_snapshot (vb, &sp[i], ctx->did_i);
+        if (!snap) continue;
+
+        for (; word_i < snap->mtf_i_len; word_i++) {
+            uint32_t word_index = base250_decode (&next);
+            prev_word_index = (word_index == WORD_INDEX_ONE_UP) ? prev_word_index + 1 : (int32_t)word_index;
+        }
+
+        snap->b250_offset     = next - FIRSTENT (const uint8_t, ctx->b250);
+        snap->prev_word_index = prev_word_index;
+    }
+}
+
+// ZIP compute thread: after all contexts are generated - compress the SEC_SEEK_POINTS section of this VB
+void random_access_compress_seek_points (VBlock *vb)
+{
+    if (!vb->seek_points.len) return;
+
+    ARRAY (ZipSeekPoint, sp, vb->seek_points);
+    MtfContext *chrom_ctx = &vb->contexts[DTF(chrom)];
+
+    // note: vb->compressed is not in use at this point - merge, that uses it for dictionary fragments, is done
+    Buffer *data = &vb->compressed;
+    buf_alloc (vb, data, vb->seek_points.len * sizeof (SeekPoint) + vb->seek_ctxs.len * sizeof (SeekPointCtx), 1, "compressed", 0);
+    data->len = 0;
+
+    uint32_t singletons_len[MAX_DICTS] = { 0 }; // singletons added to local up to the current seek point
+
+    for (unsigned i=0; i < vb->seek_points.len; i++) {
+        SeekPoint *dst_sp = (SeekPoint *)AFTERENT (char, *data);
+        data->len += sizeof (SeekPoint);
+
+        uint32_t num_ctxs = 0;
+        for (unsigned did_i=0; did_i < sp[i].num_snapshots; did_i++) {
+            SeekCtxSnapshot *snap = random_access_get_snapshot (vb, &sp[i], did_i);
+            
+            singletons_len[did_i] += snap->singletons_len;
+            uint32_t next_local = snap->local_len + singletons_len[did_i];
+
+            if (!snap->b250_offset && !next_local && !snap->last_value && !snap->last_delta) continue; // context is at its initial state
+
+            *(SeekPointCtx *)AFTERENT (char, *data) = (SeekPointCtx){ .dict_id         = vb->contexts[did_i].dict_id,
+                                                                      .b250_offset     = BGEN32 (snap->b250_offset),
+                                                                      .prev_word_index = BGEN32 (snap->prev_word_index),
+                                                                      .next_local      = BGEN32 (next_local),
+                                                                      .last_value      = BGEN64 (snap->last_value),
+                                                                      .last_delta      = BGEN64 (snap->last_delta) };
+            data->len += sizeof (SeekPointCtx);
+            num_ctxs++;
+        }
+
+        // in the VB we store the chrom node index, while in the file we store the word index
+        uint32_t chrom_index = (sp[i].min_pos && sp[i].chrom_node_index != NIL) 
+                             ? mtf_node_vb (chrom_ctx, sp[i].chrom_node_index, NULL, NULL)->word_index.n : NIL;
+
+        *dst_sp = (SeekPoint){ .vb_line_i   = BGEN32 (sp[i].vb_line_i),
+                               .chrom_index = BGEN32 (chrom_index),
+                               .min_pos     = BGEN32 (sp[i].min_pos),
+                               .max_pos     = BGEN32 (sp[i].max_pos),
+                               .num_ctxs    = BGEN32 (num_ctxs) };
+    }
+
+    zfile_compress_section_data_alg (vb, SEC_SEEK_POINTS, data, 0,0, COMP_LZMA);
+}
+
+// PIZ compute thread: uncompress the SEC_SEEK_POINTS section read by the I/O thread
+void random_access_uncompress_seek_points (VBlock *vb)
+{
+    zfile_uncompress_section (vb, ENT (char, vb->z_data, vb->seek_points_header_offset), &vb->seek_points, "seek_points", SEC_SEEK_POINTS);
+
+    for (uint64_t offset=0; offset < vb->seek_points.len; ) {
+        SeekPoint *sp = (SeekPoint *)ENT (char, vb->seek_points, offset);
+        sp->vb_line_i   = BGEN32 (sp->vb_line_i);
+        sp->chrom_index = BGEN32 (sp->chrom_index);
+        sp->min_pos     = BGEN32 (sp->min_pos);
+        sp->max_pos     = BGEN32 (sp->max_pos);
+        sp->num_ctxs    = BGEN32 (sp->num_ctxs);
+
+        SeekPointCtx *spc = (SeekPointCtx *)(sp + 1);
+        for (unsigned i=0; i < sp->num_ctxs; i++) {
+            spc[i].b250_offset     = BGEN32 (spc[i].b250_offset);
+            spc[i].prev_word_index = BGEN32 (spc[i].prev_word_index);
+            spc[i].next_local      = BGEN32 (spc[i].next_local);
+            spc[i].last_value      = BGEN64 (spc[i].last_value);
+            spc[i].last_delta      = BGEN64 (spc[i].last_delta);
+        }
+
+        offset += sizeof (SeekPoint) + sp->num_ctxs * sizeof (SeekPointCtx);
+    }
+
+    vb->next_seek_point = 0;
+}
+
+static inline const SeekPoint *random_access_get_seek_point (VBlock *vb, uint32_t offset)
+{
+    return (offset < vb->seek_points.len) ? (const SeekPoint *)ENT (char, vb->seek_points, offset) : NULL;
+}
+
+static inline uint32_t random_access_after_seek_point (const SeekPoint *sp, uint32_t offset)
+{
+    return offset + sizeof (SeekPoint) + sp->num_ctxs * sizeof (SeekPointCtx);
+}
+
+static inline bool random_access_is_seek_point_included (const SeekPoint *sp)
+{
+    if (sp->chrom_index == NIL) return true; // more than one chrom in this segment - we don't know
+    
+    return sp->min_pos && regions_get_ra_intersection (sp->chrom_index, sp->min_pos, sp->max_pos, NULL);
+}
+
+// PIZ: set the state of all contexts to their state at the seek point
+static void random_access_restore_seek_point (VBlock *vb, const SeekPoint *sp)
+{
+    // contexts not listed in the seek point are at their initial state
+    for (unsigned did_i=0; did_i < vb->num_dict_ids; did_i++) {
+        MtfContext *ctx = &vb->contexts[did_i];
+        mtf_init_iterator (ctx);
+        ctx->last_value = ctx->last_delta = 0;
+    }
+
+    const SeekPointCtx *spc = (const SeekPointCtx *)(sp + 1);
+    for (unsigned i=0; i < sp->num_ctxs; i++) {
+        uint8_t did_i = mtf_get_existing_did_i (vb, spc[i].dict_id);
+        if (did_i == DID_I_NONE) continue; // this context is not reconstructed (eg its data was skipped due to --drop-genotypes)
+
+        MtfContext *ctx = &vb->contexts[did_i];
+
+        if (ctx->b250.len) { // note: b250 is not loaded if skipped 
+            ASSERT (spc[i].b250_offset <= ctx->b250.len, "Error in random_access_restore_seek_point: b250_offset=%u beyond b250.len=%u in ctx=%s vb_i=%u",
+                    spc[i].b250_offset, (uint32_t)ctx->b250.len, ctx->name, vb->vblock_i);
+
+            ctx->iterator.next_b250       = spc[i].b250_offset ? ENT (const uint8_t, ctx->b250, spc[i].b250_offset) : NULL;
+            ctx->iterator.prev_word_index = spc[i].prev_word_index;
+        }
+        
+        ctx->next_local = spc[i].next_local;
+        ctx->last_value = spc[i].last_value;
+        ctx->last_delta = spc[i].last_delta;
+    }
+}
+
+// PIZ compute thread: called with --regions before reconstructing each line of a VB that has seek points. if the line 
+// starts a segment that doesn't intersect any region, skips to the first line of the next segment that does, restoring 
+// the contexts to their state at its seek point. returns false if no remaining line in the VB is included.
+bool random_access_seek_to_included_line (VBlock *vb, uint32_t *vb_line_i)
+{
+    const SeekPoint *sp = random_access_get_seek_point (vb, vb->next_seek_point);
+    if (!sp || sp->vb_line_i != *vb_line_i) return true; // not the first line of a segment
+
+    bool is_skipping = false;
+    while (sp && !random_access_is_seek_point_included (sp)) {
+        vb->next_seek_point = random_access_after_seek_point (sp, vb->next_seek_point);
+        sp = random_access_get_seek_point (vb, vb->next_seek_point);
+        is_skipping = true;
+    }
+
+    if (!sp) return false; // no more included segments in this VB
+
+    if (is_skipping) {
+        random_access_restore_seek_point (vb, sp);
+        *vb_line_i = sp->vb_line_i;
+    }
+
+    vb->next_seek_point = random_access_after_seek_point (sp, vb->next_seek_point);
+    return true;
+}
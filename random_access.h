@@ -13,10 +13,24 @@ extern int32_t random_access_get_last_chrom_node_index (VBlockP vb);
 extern void random_access_update_chrom (VBlockP vb, int32_t chrom_node_index);
 extern void random_access_update_pos (VBlockP vb, uint8_t did_i_pos);
 extern void random_access_merge_in_vb (VBlockP vb);
+extern void random_access_sort_by_vb (void);
 extern void BGEN_random_access (void);
 extern unsigned random_access_sizeof_entry(void);
+extern void random_access_dict_index_merge_in_vb (VBlockP vb);
+extern void BGEN_random_access_dict_index (void);
+extern const struct DictIndexEntry *random_access_get_dict_index (uint32_t vb_i, uint32_t *num_entries);
 extern void random_access_show_index(bool from_zip);
 extern bool random_access_is_vb_included (uint32_t vb_i, BufferP region_ra_intersection_matrix);
 extern int32_t random_access_get_last_included_vb_i (void);
 
+// seek points
+extern void random_access_set_seek_points (const char *interval_str);
+extern void random_access_add_seek_point (VBlockP vb);
+extern void random_access_seek_points_add_singleton (VBlockP vb, ConstMtfContextP ctx, uint32_t node_i, uint32_t singleton_len);
+extern void random_access_seek_points_unique_words (VBlockP vb, ConstMtfContextP ctx);
+extern void random_access_seek_points_b250 (VBlockP vb, ConstMtfContextP ctx);
+extern void random_access_compress_seek_points (VBlockP vb);
+extern void random_access_uncompress_seek_points (VBlockP vb);
+extern bool random_access_seek_to_included_line (VBlockP vb, uint32_t *vb_line_i);
+
 #endif
\ No newline at end of file
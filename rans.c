@@ -0,0 +1,502 @@
+// ------------------------------------------------------------------
+//   rans.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// A static rANS entropy coder, for sections whose bytes have a skewed distribution - b250 data (mostly a few frequent word
+// indices) and local integers. Each byte is coded in a context, with a frequency table for each context stored in the
+// compressed data. We try three models, and keep the one that compresses best:
+// RANS_ORDER0 - all bytes are in the same context
+// RANS_ORDER1 - the context is the previous byte
+// RANS_B250   - for b250 data: the context is the previous byte, and the position of the byte in its b250 word - a 1-byte
+//               word (250-255), or the first, second, third or fourth byte of a 4-byte word (see base250.h). eg the low byte of
+//               a word index is coded in the context of its high byte.
+// In RANS_ORDER1 and RANS_B250, contexts whose table would cost more than it saves don't get a table of their own - their
+// bytes are coded with a shared "fallback" table (in RANS_B250: one for each position in the word).
+//
+// The data is divided into RANS_NUM_LANES consecutive parts ("lanes"), each coded with its own rANS state, and the output of
+// all lanes is interleaved in a single byte stream. The lanes are independent of each other, so the decoder decodes a symbol
+// of each lane in every iteration without a dependency chain between them.
+//
+// Compressed data:
+//   model      : 1 byte - RANS_RAW, RANS_ORDER0, RANS_ORDER1 or RANS_B250
+//   RANS_RAW   : the data, uncompressed
+//   otherwise  : lane starts (RANS_B250 only) ; tables ; states ; stream
+//   lane starts: the offset of the first byte of each lane except the first - 4 bytes each. in the other models, the lanes
+//                are of equal length, and the last one also has the remainder.
+//   tables     : RANS_ORDER0: one table. otherwise: the number of tables minus 1 (2 bytes), and for each table: its context -
+//                or RANS_NUM_CTXS(model) + the fallback number - (2 bytes) and the table
+//   table      : the number of runs of consecutive symbols minus 1 (1 byte) ; for each run - its first symbol and its length
+//                minus 1 (1 byte each) ; for each symbol - its count, scaled down if needed (1 byte if < 128, otherwise 2 bytes
+//                big endian with the top bit set). the decoder calculates the frequencies from the counts, as the encoder does.
+//   states     : the final state of each lane - 4 bytes each
+// all numbers are little endian unless stated otherwise
+
+#include <math.h>
+#include "genozip.h"
+#include "rans.h"
+
+#define RANS_RAW    0
+#define RANS_ORDER0 1
+#define RANS_ORDER1 2
+#define RANS_B250   3
+
+#define RANS_NUM_LANES       4
+#define RANS_L               (1 << 23) // a state is in the range [RANS_L, RANS_L * 256) between symbols
+#define RANS_ORDER0_BITS     12        // frequencies of a table are scaled to sum to 1 << bits
+#define RANS_ORDERN_BITS     10        // fewer bits with multiple contexts, as the decoder expands each table to a slot lookup table
+#define RANS_MAX_CTXS        (4 << 8)  // RANS_B250: (position in word) << 8 | previous byte
+#define RANS_NUM_FALLBACKS   4         // RANS_B250: one for each position in the word
+#define RANS_MAX_TABLES      (RANS_MAX_CTXS + RANS_NUM_FALLBACKS)
+#define RANS_MIN_ORDERN_LEN  256       // tables of multiple contexts cost more than they can save on smaller data
+
+typedef struct {
+    uint32_t counts[RANS_MAX_TABLES][256]; // indexed by table: a context, or RANS_NUM_CTXS(model) + fallback
+    uint16_t freq[RANS_MAX_TABLES][256];
+    uint16_t cum[RANS_MAX_TABLES][256];    // sum of the frequencies of the smaller symbols
+    uint8_t  data[];                       // the table of each byte (uint16_t), followed by the stream - written backwards from its end
+} RansCompressWorkspace;
+
+typedef struct {
+    uint32_t ctx_to_entries[RANS_MAX_CTXS]; // the index in entry[] of the table of each context
+    uint32_t fallback_entries[RANS_NUM_FALLBACKS];
+    uint32_t counts[256];
+    uint16_t freq[256], cum[256];
+    // for each table, in the order of the tables in the data, an entry for each slot:
+    // symbol (8 bits) | frequency-1 (12 bits) | slot minus the cumulative frequency of the symbol (12 bits)
+    uint32_t entry[RANS_MAX_TABLES << RANS_ORDERN_BITS]; // RANS_ORDER0 uses 1 << RANS_ORDER0_BITS entries
+} RansUncompressWorkspace;
+
+#define RANS_NUM_CTXS(model) ((model) == RANS_ORDER0 ? 1 : (model) == RANS_ORDER1 ? 256 : RANS_MAX_CTXS)
+#define RANS_BITS(model)     ((model) == RANS_ORDER0 ? RANS_ORDER0_BITS : RANS_ORDERN_BITS)
+#define RANS_FALLBACK(model, ctx) ((model) == RANS_B250 ? (ctx) >> 8 : 0)
+
+// the context of the next byte of a lane, given this byte. pos is the position of the next byte in its b250 word, 0 if it
+// starts a word. all lanes start with context 0 and pos 0.
+#define RANS_NEXT_CTX(model, ctx, pos, sym) {                     \
+    if ((model) == RANS_ORDER1) (ctx) = (sym);                    \
+    else if ((model) == RANS_B250) {                              \
+        (pos) = (pos) ? ((pos) + 1) & 3 : ((sym) < 250);          \
+        (ctx) = ((pos) << 8) | (sym);                             \
+    }                                                             \
+}
+
+uint32_t rans_compress_workspace_size (uint32_t uncompressed_len)
+{
+    return sizeof (RansCompressWorkspace) + uncompressed_len * sizeof (uint16_t) // table of each byte
+                                          + 2 * uncompressed_len;                // stream - a symbol is encoded in at most 2 bytes
+}
+
+uint32_t rans_uncompress_workspace_size (void)
+{
+    return sizeof (RansUncompressWorkspace);
+}
+
+static inline void rans_put (uint8_t **next, uint32_t value, unsigned num_bytes)
+{
+    for (unsigned b=0; b < num_bytes; b++) *(*next)++ = value >> (b * 8);
+}
+
+static inline uint32_t rans_get (const uint8_t **next, const uint8_t *after, unsigned num_bytes)
+{
+    ASSERT0 (*next + num_bytes <= after, "Error in rans_uncompress: data ends prematurely");
+
+    uint32_t value = 0;
+    for (unsigned b=0; b < num_bytes; b++) value |= (uint32_t)*(*next)++ << (b * 8);
+    return value;
+}
+
+// divides the data into lanes. in RANS_B250, lanes start at a word boundary
+static void rans_get_lanes (unsigned model, const uint8_t *data, uint32_t len,
+                            uint32_t *lane_start, uint32_t *lane_len) // out
+{
+    uint32_t i=0;
+    for (unsigned l=0; l < RANS_NUM_LANES; l++) {
+        if (model == RANS_B250)
+            while (i < len && i < l * (len / RANS_NUM_LANES)) i += (data[i] < 250) ? 4 : 1;
+        else
+            i = l * (len / RANS_NUM_LANES);
+
+        lane_start[l] = MIN (i, len); // the last word might be cut short if this isn't b250 data
+    }
+
+    for (unsigned l=0; l < RANS_NUM_LANES; l++)
+        lane_len[l] = ((l < RANS_NUM_LANES-1) ? lane_start[l+1] : len) - lane_start[l];
+}
+
+// ZIP: scales down the counts of a table, if needed, so that they can be stored in at most 2 bytes each
+static void rans_quantize (uint32_t *counts, unsigned bits)
+{
+    uint32_t max_count = 0;
+    for (unsigned s=0; s < 256; s++) max_count = MAX (max_count, counts[s]);
+
+    if (max_count > (1 << bits))
+        for (unsigned s=0; s < 256; s++)
+            if (counts[s]) counts[s] = MAX (1, ((uint64_t)counts[s] << bits) / max_count);
+}
+
+// ZIP and PIZ: calculates the frequencies from the counts - they sum to 1 << bits, and every symbol that appears gets at least 1
+static void rans_normalize (const uint32_t *counts, unsigned bits, uint16_t *freq, uint16_t *cum)
+{
+    uint32_t target = 1 << bits, total = 0, sum = 0;
+    unsigned max_sym = 0;
+
+    for (unsigned s=0; s < 256; s++) {
+        total += counts[s];
+        if (counts[s] > counts[max_sym]) max_sym = s;
+    }
+
+    for (unsigned s=0; s < 256; s++) {
+        freq[s] = counts[s] ? MAX (1, (uint64_t)counts[s] * target / total) : 0;
+        sum += freq[s];
+    }
+
+    // the rounding error is given to (or taken from) the most frequent symbol, where it costs the least
+    int32_t diff = (int32_t)target - (int32_t)sum;
+    if ((int32_t)freq[max_sym] + diff >= 1)
+        freq[max_sym] += diff;
+
+    else // rare: many infrequent symbols were rounded up to 1 - take from all symbols that can spare
+        for (unsigned s=0; diff < 0; s = (s+1) % 256)
+            if (freq[s] > 1) { freq[s]--; diff++; }
+
+    for (unsigned s=0, c=0; s < 256; c += freq[s++]) cum[s] = c;
+}
+
+// ZIP: writes the table, or just calculates its length if next is NULL. returns the length.
+static uint32_t rans_write_table (uint8_t **next, const uint32_t *counts)
+{
+    uint8_t buf[1 + 256 * 4], *start = next ? *next : buf, *after_runs = start + 1;
+    unsigned num_runs = 0;
+
+    // runs of consecutive symbols
+    for (unsigned s=0; s < 256; s++)
+        if (counts[s] && (!s || !counts[s-1])) {
+            unsigned run_len = 1;
+            while (s + run_len < 256 && counts[s + run_len]) run_len++;
+
+            *after_runs++ = s;
+            *after_runs++ = run_len - 1;
+            num_runs++;
+        }
+
+    start[0] = num_runs - 1;
+
+    // counts
+    uint8_t *out = after_runs;
+    for (unsigned s=0; s < 256; s++)
+        if (counts[s] >= 128) { *out++ = 0x80 | (counts[s] >> 8); *out++ = counts[s] & 0xff; }
+        else if (counts[s])     *out++ = counts[s];
+
+    if (next) *next = out;
+    return out - start;
+}
+
+// PIZ: reads a table, and sets its slot entries
+static const uint8_t *rans_read_table (const uint8_t *next, const uint8_t *after, RansUncompressWorkspace *ws,
+                                       uint32_t *entry, unsigned bits)
+{
+    memset (ws->counts, 0, sizeof (ws->counts));
+
+    unsigned num_runs = rans_get (&next, after, 1) + 1;
+    const uint8_t *runs = next;
+    next += num_runs * 2;
+
+    for (unsigned r=0; r < num_runs; r++) {
+        ASSERT0 (&runs[r*2 + 1] < after, "Error in rans_uncompress: data ends prematurely");
+
+        unsigned first_sym = runs[r*2], run_len = runs[r*2 + 1] + 1;
+        ASSERT (first_sym + run_len <= 256, "Error in rans_uncompress: bad run of symbols: %u+%u", first_sym, run_len);
+
+        for (unsigned s=first_sym; s < first_sym + run_len; s++) {
+            uint32_t count = rans_get (&next, after, 1);
+            if (count & 0x80) count = ((count & 0x7f) << 8) | rans_get (&next, after, 1);
+
+            ASSERT (count && count <= (1 << bits), "Error in rans_uncompress: bad count %u of symbol %u", count, s);
+            ws->counts[s] = count;
+        }
+    }
+
+    rans_normalize (ws->counts, bits, ws->freq, ws->cum);
+
+    for (unsigned s=0; s < 256; s++)
+        for (uint32_t slot=ws->cum[s]; slot < ws->cum[s] + ws->freq[s]; slot++)
+            entry[slot] = s | ((ws->freq[s] - 1) << 8) | ((slot - ws->cum[s]) << 20);
+
+    return next;
+}
+
+static inline void rans_encode_sym (uint32_t *x, uint8_t **next, uint32_t freq, uint32_t cum, unsigned bits)
+{
+    // output the low bytes of the state, until it is small enough that it is in range after encoding the symbol
+    uint32_t x_max = ((RANS_L >> bits) << 8) * freq;
+    while (*x >= x_max) {
+        *--(*next) = *x & 0xff;
+        *x >>= 8;
+    }
+
+    *x = ((*x / freq) << bits) + (*x % freq) + cum;
+}
+
+// encodes the data with this model, and writes it to compressed if it is shorter than max_len and fits compressed_size.
+// returns the compressed length, or 0 if not written.
+static uint32_t rans_compress_model (const uint8_t *data, uint32_t len, unsigned model,
+                                     uint8_t *compressed, uint32_t compressed_size, uint32_t max_len, RansCompressWorkspace *ws)
+{
+    unsigned bits = RANS_BITS (model), num_ctxs = RANS_NUM_CTXS (model);
+    unsigned num_tables = num_ctxs + (model == RANS_ORDER0 ? 0 : RANS_NUM_FALLBACKS);
+    uint16_t *tables = (uint16_t *)ws->data; // the table of each byte
+
+    uint32_t lane_start[RANS_NUM_LANES], lane_len[RANS_NUM_LANES], max_lane_len = 0;
+    rans_get_lanes (model, data, len, lane_start, lane_len);
+
+    // get the context of each byte, and count the symbols in each context
+    memset (ws->counts, 0, num_tables * sizeof (ws->counts[0]));
+
+    for (unsigned l=0; l < RANS_NUM_LANES; l++) {
+        uint16_t ctx = 0;
+        uint8_t pos = 0;
+        for (uint32_t i=lane_start[l]; i < lane_start[l] + lane_len[l]; i++) {
+            tables[i] = ctx;
+            ws->counts[ctx][data[i]]++;
+            RANS_NEXT_CTX (model, ctx, pos, data[i]);
+        }
+        max_lane_len = MAX (max_lane_len, lane_len[l]);
+    }
+
+    // a context gets a table of its own only if it saves more than the table costs. otherwise, its counts are moved to its
+    // fallback table. we estimate the cost of coding with the fallback table from the counts of all contexts that share it.
+    uint16_t ctx_to_table[RANS_MAX_CTXS];
+    uint32_t fallback_counts[RANS_NUM_FALLBACKS][256] = {}, fallback_total[RANS_NUM_FALLBACKS] = {};
+
+    for (unsigned c=0; c < num_ctxs; c++)
+        for (unsigned s=0; s < 256; s++) {
+            fallback_counts[RANS_FALLBACK (model, c)][s] += ws->counts[c][s];
+            fallback_total[RANS_FALLBACK (model, c)]     += ws->counts[c][s];
+        }
+
+    for (unsigned c=0; c < num_ctxs; c++) {
+        ctx_to_table[c] = c;
+        if (model == RANS_ORDER0) continue;
+
+        unsigned f = RANS_FALLBACK (model, c);
+        uint32_t total = 0, quantized[256];
+        for (unsigned s=0; s < 256; s++) total += ws->counts[c][s];
+        if (!total) continue;
+
+        memcpy (quantized, ws->counts[c], sizeof (quantized));
+        rans_quantize (quantized, bits);
+
+        double own_bits = 8 * (2 + rans_write_table (NULL, quantized)), fallback_bits = 0;
+        for (unsigned s=0; s < 256; s++)
+            if (ws->counts[c][s]) {
+                own_bits      += ws->counts[c][s] * log2 ((double)total / ws->counts[c][s]);
+                fallback_bits += ws->counts[c][s] * log2 ((double)fallback_total[f] / fallback_counts[f][s]);
+            }
+
+        if (fallback_bits <= own_bits) {
+            ctx_to_table[c] = num_ctxs + f;
+            for (unsigned s=0; s < 256; s++) {
+                ws->counts[num_ctxs + f][s] += ws->counts[c][s];
+                ws->counts[c][s] = 0;
+            }
+        }
+    }
+
+    if (model != RANS_ORDER0)
+        for (uint32_t i=0; i < len; i++) tables[i] = ctx_to_table[tables[i]];
+
+    // build the tables that are used
+    uint32_t header_len = 1 + (model == RANS_B250) * (RANS_NUM_LANES-1) * 4 + (model != RANS_ORDER0) * 2 + RANS_NUM_LANES * 4;
+    unsigned num_used_tables = 0;
+    bool table_used[RANS_MAX_TABLES];
+
+    for (unsigned t=0; t < num_tables; t++) {
+        table_used[t] = false;
+        for (unsigned s=0; s < 256 && !table_used[t]; s++) table_used[t] = !!ws->counts[t][s];
+
+        if (table_used[t]) {
+            rans_quantize (ws->counts[t], bits);
+            rans_normalize (ws->counts[t], bits, ws->freq[t], ws->cum[t]);
+            header_len += (model != RANS_ORDER0) * 2 + rans_write_table (NULL, ws->counts[t]);
+            num_used_tables++;
+        }
+    }
+
+    if (header_len >= MIN (max_len, compressed_size)) return 0; // no point encoding
+
+    // encode, in the reverse order of decoding: the symbols of all lanes interleaved - last symbol first
+    uint8_t *after_stream = &ws->data[len * sizeof (uint16_t) + 2 * len], *next = after_stream;
+    uint32_t x[RANS_NUM_LANES];
+    for (unsigned l=0; l < RANS_NUM_LANES; l++) x[l] = RANS_L;
+
+    for (uint32_t i=max_lane_len; i > 0; i--)
+        for (int l=RANS_NUM_LANES-1; l >= 0; l--)
+            if (i <= lane_len[l]) {
+                uint32_t data_i = lane_start[l] + i-1;
+                uint16_t t = tables[data_i];
+                uint8_t sym = data[data_i];
+                rans_encode_sym (&x[l], &next, ws->freq[t][sym], ws->cum[t][sym], bits);
+            }
+
+    uint32_t stream_len = after_stream - next;
+    uint32_t compressed_len = header_len + stream_len;
+    if (compressed_len >= max_len || compressed_len > compressed_size) return 0;
+
+    // write the compressed data
+    uint8_t *out = compressed;
+    *out++ = model;
+
+    if (model == RANS_B250)
+        for (unsigned l=1; l < RANS_NUM_LANES; l++) rans_put (&out, lane_start[l], 4);
+
+    if (model != RANS_ORDER0) rans_put (&out, num_used_tables - 1, 2);
+
+    for (unsigned t=0; t < num_tables; t++)
+        if (table_used[t]) {
+            if (model != RANS_ORDER0) rans_put (&out, t, 2);
+            rans_write_table (&out, ws->counts[t]);
+        }
+
+    for (unsigned l=0; l < RANS_NUM_LANES; l++) rans_put (&out, x[l], 4);
+
+    memcpy (out, next, stream_len);
+
+    return compressed_len;
+}
+
+uint32_t rans_compress (const uint8_t *uncompressed, uint32_t uncompressed_len,
+                        uint8_t *compressed, uint32_t compressed_size, void *workspace)
+{
+    uint32_t raw_len = uncompressed_len + 1;
+
+    uint32_t compressed_len = rans_compress_model (uncompressed, uncompressed_len, RANS_ORDER0, compressed, compressed_size, raw_len, workspace);
+
+    // each model overwrites compressed only if it is better than the previous ones
+    if (uncompressed_len >= RANS_MIN_ORDERN_LEN)
+        for (unsigned model=RANS_ORDER1; model <= RANS_B250; model++) {
+            uint32_t model_len = rans_compress_model (uncompressed, uncompressed_len, model, compressed, compressed_size,
+                                                      compressed_len ? compressed_len : raw_len, workspace);
+            if (model_len) compressed_len = model_len;
+        }
+
+    // case: the data doesn't compress - store it as is
+    if (!compressed_len && raw_len <= compressed_size) {
+        compressed[0] = RANS_RAW;
+        memcpy (&compressed[1], uncompressed, uncompressed_len);
+        compressed_len = raw_len;
+    }
+
+    return compressed_len;
+}
+
+// decodes the lanes - inlined separately for each model, so that the ctx calculation is resolved at compile time
+static inline void rans_decode_lanes (unsigned model, const RansUncompressWorkspace *ws, uint32_t *x,
+                                      const uint8_t **next_p, const uint8_t *after,
+                                      uint8_t *uncompressed, const uint32_t *lane_start, const uint32_t *lane_len)
+{
+    const unsigned bits = RANS_BITS (model);
+    const uint32_t mask = (1 << bits) - 1;
+    const uint8_t *next = *next_p;
+
+    uint32_t entries[RANS_NUM_LANES]; // the entries of the table of the current context of each lane
+    uint16_t ctx[RANS_NUM_LANES] = {};
+    uint8_t pos[RANS_NUM_LANES] = {};
+
+    uint32_t min_lane_len = lane_len[0], max_lane_len = lane_len[0];
+    for (unsigned l=0; l < RANS_NUM_LANES; l++) {
+        min_lane_len = MIN (min_lane_len, lane_len[l]);
+        max_lane_len = MAX (max_lane_len, lane_len[l]);
+        entries[l] = ws->ctx_to_entries[0];
+    }
+
+    #define RANS_DECODE_SYM(l, i) {                                                                 \
+        uint32_t entry = ws->entry[entries[l] + (x[l] & mask)];                                     \
+        x[l] = (((entry >> 8) & 0xfff) + 1) * (x[l] >> bits) + (entry >> 20);                      \
+        uncompressed[i] = (uint8_t)entry;                                                           \
+        if (model != RANS_ORDER0) {                                                                 \
+            RANS_NEXT_CTX (model, ctx[l], pos[l], (uint8_t)entry);                                  \
+            entries[l] = ws->ctx_to_entries[ctx[l]];                                                \
+        }                                                                                           \
+        while (x[l] < RANS_L && next < after) x[l] = (x[l] << 8) | *next++;                         \
+    }
+
+    for (uint32_t i=0; i < min_lane_len; i++)
+        for (unsigned l=0; l < RANS_NUM_LANES; l++)
+            RANS_DECODE_SYM (l, lane_start[l] + i);
+
+    // lanes of RANS_B250 might be of different lengths, and in the other models, the last lane might be longer
+    for (uint32_t i=min_lane_len; i < max_lane_len; i++)
+        for (unsigned l=0; l < RANS_NUM_LANES; l++)
+            if (i < lane_len[l]) RANS_DECODE_SYM (l, lane_start[l] + i);
+
+    #undef RANS_DECODE_SYM
+
+    *next_p = next;
+}
+
+void rans_uncompress (const uint8_t *compressed, uint32_t compressed_len,
+                      uint8_t *uncompressed, uint32_t uncompressed_len, void *workspace)
+{
+    RansUncompressWorkspace *ws = (RansUncompressWorkspace *)workspace;
+    const uint8_t *next = compressed, *after = compressed + compressed_len;
+
+    unsigned model = rans_get (&next, after, 1);
+
+    if (model == RANS_RAW) {
+        ASSERT (compressed_len == uncompressed_len + 1, "Error in rans_uncompress: expecting %u bytes of uncompressed data, but there are %u",
+                uncompressed_len, compressed_len - 1);
+        memcpy (uncompressed, next, uncompressed_len);
+        return;
+    }
+
+    ASSERT (model == RANS_ORDER0 || model == RANS_ORDER1 || model == RANS_B250, "Error in rans_uncompress: unrecognized model %u", model);
+
+    // get the lanes
+    uint32_t lane_start[RANS_NUM_LANES] = {}, lane_len[RANS_NUM_LANES];
+    for (unsigned l=1; l < RANS_NUM_LANES; l++)
+        lane_start[l] = (model == RANS_B250) ? rans_get (&next, after, 4) : l * (uncompressed_len / RANS_NUM_LANES);
+
+    for (unsigned l=0; l < RANS_NUM_LANES; l++) {
+        uint32_t lane_after = (l < RANS_NUM_LANES-1) ? lane_start[l+1] : uncompressed_len;
+        ASSERT (lane_start[l] <= lane_after && lane_after <= uncompressed_len, "Error in rans_uncompress: bad start of lane %u", l+1);
+        lane_len[l] = lane_after - lane_start[l];
+    }
+
+    // read the tables. contexts that have no table of their own, use their fallback table
+    unsigned bits = RANS_BITS (model), num_ctxs = RANS_NUM_CTXS (model);
+    unsigned num_tables = (model == RANS_ORDER0) ? 1 : rans_get (&next, after, 2) + 1;
+    ASSERT (num_tables <= RANS_MAX_TABLES, "Error in rans_uncompress: bad number of tables %u", num_tables);
+
+    for (unsigned c=0; c < num_ctxs; c++) ws->ctx_to_entries[c] = (uint32_t)-1;
+    for (unsigned f=0; f < RANS_NUM_FALLBACKS; f++) ws->fallback_entries[f] = 0;
+
+    for (unsigned t=0; t < num_tables; t++) {
+        unsigned table_id = (model == RANS_ORDER0) ? 0 : rans_get (&next, after, 2);
+        ASSERT (table_id < num_ctxs + RANS_NUM_FALLBACKS, "Error in rans_uncompress: bad table %u", table_id);
+
+        if (table_id < num_ctxs) ws->ctx_to_entries[table_id] = t << bits;
+        else                     ws->fallback_entries[table_id - num_ctxs] = t << bits;
+
+        next = rans_read_table (next, after, ws, &ws->entry[t << bits], bits);
+    }
+
+    for (unsigned c=0; c < num_ctxs; c++)
+        if (ws->ctx_to_entries[c] == (uint32_t)-1) ws->ctx_to_entries[c] = ws->fallback_entries[RANS_FALLBACK (model, c)];
+
+    // read the states
+    uint32_t x[RANS_NUM_LANES];
+    for (unsigned l=0; l < RANS_NUM_LANES; l++) x[l] = rans_get (&next, after, 4);
+
+    switch (model) {
+        case RANS_ORDER0: rans_decode_lanes (RANS_ORDER0, ws, x, &next, after, uncompressed, lane_start, lane_len); break;
+        case RANS_ORDER1: rans_decode_lanes (RANS_ORDER1, ws, x, &next, after, uncompressed, lane_start, lane_len); break;
+        default:          rans_decode_lanes (RANS_B250,   ws, x, &next, after, uncompressed, lane_start, lane_len); break;
+    }
+
+    // the encoder started all states at RANS_L, so this is where the decoder ends if the data is intact
+    ASSERT (next == after, "Error in rans_uncompress: %u bytes of the stream were not consumed", (unsigned)(after - next));
+
+    for (unsigned l=0; l < RANS_NUM_LANES; l++)
+        ASSERT (x[l] == RANS_L, "Error in rans_uncompress: lane %u ended in state %u, expecting %u", l, x[l], RANS_L);
+}
@@ -0,0 +1,22 @@
+// ------------------------------------------------------------------
+//   rans.h
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+#ifndef RANS_INCLUDED
+#define RANS_INCLUDED
+
+#include <stdint.h>
+
+// the caller provides the memory the coder needs, in a workspace of this size
+extern uint32_t rans_compress_workspace_size (uint32_t uncompressed_len);
+extern uint32_t rans_uncompress_workspace_size (void);
+
+// returns the compressed length, or 0 if compressed_size is too small. compressed_size >= uncompressed_len+1 is always sufficient.
+extern uint32_t rans_compress (const uint8_t *uncompressed, uint32_t uncompressed_len,
+                               uint8_t *compressed, uint32_t compressed_size, void *workspace);
+
+extern void rans_uncompress (const uint8_t *compressed, uint32_t compressed_len,
+                             uint8_t *uncompressed, uint32_t uncompressed_len, void *workspace);
+
+#endif
@@ -14,6 +14,10 @@ COMPRESSOR_CALLBACK(sam_zip_get_start_len_line_i_qual)
 COMPRESSOR_CALLBACK(sam_zip_get_start_len_line_i_bd)
 COMPRESSOR_CALLBACK(sam_zip_get_start_len_line_i_bi)
 
+// BAM Stuff
+extern void sam_bam_read_header (BufferP txt_header);
+extern void sam_bam_uncompress_vb (VBlockP vb);
+
 // SEG Stuff
 extern void sam_seg_initialize (VBlockP vb);
 extern const char *sam_seg_txt_line (VBlockP vb_, const char *field_start_line, bool *has_special_eol);
@@ -0,0 +1,328 @@
+// ------------------------------------------------------------------
+//   sam_bam.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// ZIP of BAM files, without samtools. A BAM file is BGZF-compressed, and contains a binary header followed by binary
+// alignment records, see: https://samtools.github.io/hts-specs/SAMv1.pdf section 4.2
+// The I/O thread converts the binary header to the SAM header, and reads the (still compressed) BGZF blocks of each VB.
+// The compute thread uncompresses the blocks, and converts the records to SAM lines in txt_data (see bgzf_records_to_txt) -
+// the same text "samtools view" would produce - which are then segged like any other SAM data.
+
+#include "sam_private.h"
+#include "bgzf.h"
+#include "file.h"
+#include "strings.h"
+
+#define LE16(p) ((uint32_t)((uint8_t*)(p))[0] | ((uint32_t)((uint8_t*)(p))[1] << 8))
+#define LE32(p) (LE16(p) | ((uint32_t)((uint8_t*)(p))[2] << 16) | ((uint32_t)((uint8_t*)(p))[3] << 24))
+
+#define BAM_FIXED_LEN 36 // the fixed-length part of a record, including block_size
+
+// the references of the file, from the BAM header - RNAME and RNEXT are stored in the records as an index into this list
+static Buffer bam_ref_names = EMPTY_BUFFER; // nul-terminated reference names
+static Buffer bam_ref_index = EMPTY_BUFFER; // array of uint32_t - index into bam_ref_names of each reference
+static uint32_t bam_max_ref_name_len = 0;
+
+// ZIP I/O thread: reads the binary BAM header, and converts it to a SAM header in txt_header. If the header text has
+// no @SQ lines, we generate them from the binary reference list (like samtools does)
+void sam_bam_read_header (Buffer *txt_header)
+{
+    static Buffer hdr = EMPTY_BUFFER;
+    hdr.len = 0;
+
+    bgzf_read_header_data (&hdr, 8);
+    ASSERT (!memcmp (hdr.data, "BAM\1", 4), "Error: %s is not a BAM file - it doesn't start with the BAM magic string", txt_name);
+
+    uint32_t l_text = LE32 (&hdr.data[4]);
+    bgzf_read_header_data (&hdr, 8 + (uint64_t)l_text + 4);
+
+    // the header text might be padded with nuls
+    const char *text = &hdr.data[8];
+    uint32_t text_len = strnlen (text, l_text);
+
+    bool has_sq = false;
+    for (uint32_t i=0; i + 3 <= text_len && !has_sq; i++)
+        has_sq = (!i || text[i-1] == '\n') && !memcmp (&text[i], "@SQ", 3);
+
+    buf_alloc (evb, txt_header, text_len + 1, 1, "txt_data", 0);
+    memcpy (txt_header->data, text, text_len);
+    txt_header->len = text_len;
+
+    if (text_len && text[text_len-1] != '\n')
+        txt_header->data[txt_header->len++] = '\n';
+
+    // references: l_name, name (nul-terminated), l_ref
+    uint32_t n_ref = LE32 (&hdr.data[8 + l_text]);
+    buf_alloc (evb, &bam_ref_index, n_ref * sizeof (uint32_t), 1, "bam_ref_index", 0);
+    bam_ref_names.len = bam_ref_index.len = 0;
+    bam_max_ref_name_len = 1; // "*" or "="
+
+    uint64_t next = 12 + (uint64_t)l_text;
+    for (uint32_t ref_i=0; ref_i < n_ref; ref_i++) {
+        bgzf_read_header_data (&hdr, next + 4);
+        uint32_t l_name = LE32 (&hdr.data[next]);
+
+        bgzf_read_header_data (&hdr, next + 8 + (uint64_t)l_name);
+        const char *name = &hdr.data[next + 4];
+        ASSERT (l_name && !name[l_name-1], "Error: invalid BAM header in %s: name of reference #%u is not nul-terminated", txt_name, ref_i);
+
+        NEXTENT (uint32_t, bam_ref_index) = bam_ref_names.len;
+        buf_alloc (evb, &bam_ref_names, bam_ref_names.len + l_name, 2, "bam_ref_names", 0);
+        buf_add (&bam_ref_names, name, l_name); // including the nul
+        bam_max_ref_name_len = MAX (bam_max_ref_name_len, l_name - 1);
+
+        if (!has_sq) { 
+            buf_alloc (evb, txt_header, txt_header->len + l_name + 30, 2, "txt_data", 0);
+            txt_header->len += sprintf (AFTERENT (char, *txt_header), "@SQ\tSN:%s\tLN:%u\n", name, LE32 (&name[l_name]));
+        }
+
+        next += 8 + l_name;
+    }
+
+    // the remaining data is the beginning of the first records
+    bgzf_set_header_carry (&hdr, next);
+}
+
+static inline const char *sam_bam_ref_name (int32_t ref_id)
+{
+    ASSERT (ref_id >= -1 && ref_id < (int32_t)bam_ref_index.len, "Error: invalid refID=%d in BAM record of %s", ref_id, txt_name);
+
+    return (ref_id == -1) ? "*" : ENT (char, bam_ref_names, *ENT (uint32_t, bam_ref_index, ref_id));
+}
+
+static inline char *sam_bam_add_int (char *next, int64_t n)
+{
+    return next + str_int (n, next);
+}
+
+static inline char *sam_bam_add_str (char *next, const char *s)
+{
+    unsigned len = strlen (s);
+    memcpy (next, s, len);
+    return next + len;
+}
+
+static inline char *sam_bam_add_float (char *next, const uint8_t *p)
+{
+    uint32_t n = LE32 (p);
+    float f;
+    memcpy (&f, &n, sizeof (float));
+    return next + sprintf (next, "%g", f);
+}
+
+// returns the value of an integer of BAM type t, and its width
+static inline int64_t sam_bam_get_int (char t, const uint8_t *p, unsigned *width)
+{
+    switch (t) {
+        case 'c': *width=1; return (int8_t)p[0];
+        case 'C': *width=1; return p[0];
+        case 's': *width=2; return (int16_t)LE16 (p);
+        case 'S': *width=2; return LE16 (p);
+        case 'i': *width=4; return (int32_t)LE32 (p);
+        case 'I': *width=4; return LE32 (p);
+        default : ABORT ("Error: invalid integer type '%c' in BAM record of %s", t, txt_name); return 0;
+    }
+}
+
+static inline char *sam_bam_add_cigar (char *next, const uint8_t *cigar, uint32_t n_cigar_op)
+{
+    static const char ops[16] = "MIDNSHP=X???????";
+
+    for (uint32_t i=0; i < n_cigar_op; i++) {
+        uint32_t op = LE32 (&cigar[i*4]);
+        next = sam_bam_add_int (next, op >> 4);
+        *next++ = ops[op & 0xf];
+    }
+    return next;
+}
+
+// converts the optional fields of a record, starting at aux and ending at after, skipping the CG field if cg is set
+static char *sam_bam_add_aux (char *next, const uint8_t *aux, const uint8_t *after, const uint8_t *cg)
+{
+    while (aux < after) {
+        ASSERT (aux + 3 <= after, "Error: truncated optional field in BAM record of %s", txt_name);
+
+        const uint8_t *field = aux;
+        char type = aux[2];
+        aux += 3;
+
+        if (field != cg) {
+            *next++ = '\t';
+            *next++ = field[0];
+            *next++ = field[1];
+            *next++ = ':';
+            *next++ = (type=='c' || type=='C' || type=='s' || type=='S' || type=='I') ? 'i' : type;
+            *next++ = ':';
+        }
+
+        unsigned width = 0;
+        switch (type) {
+            case 'A':
+                *next++ = *aux++;
+                break;
+
+            case 'c': case 'C': case 's': case 'S': case 'i': case 'I':
+                next = sam_bam_add_int (next, sam_bam_get_int (type, aux, &width));
+                aux += width;
+                break;
+
+            case 'f':
+                next = sam_bam_add_float (next, aux);
+                aux += 4;
+                break;
+
+            case 'Z': case 'H': {
+                const uint8_t *nul = memchr (aux, 0, after - aux);
+                ASSERT (nul, "Error: unterminated string in optional field %c%c of a BAM record in %s", field[0], field[1], txt_name);
+                memcpy (next, aux, nul - aux);
+                next += nul - aux;
+                aux = nul + 1;
+                break;
+            }
+
+            case 'B': {
+                char subtype = aux[0];
+                uint32_t count = LE32 (&aux[1]);
+                aux += 5;
+
+                if (field == cg) { // long CIGAR, moved here as it has more than 65535 ops
+                    aux += count * 4;
+                    break;
+                }
+
+                *next++ = subtype;
+                for (uint32_t i=0; i < count; i++) {
+                    *next++ = ',';
+                    if (subtype == 'f') {
+                        next = sam_bam_add_float (next, aux);
+                        aux += 4;
+                    }
+                    else {
+                        next = sam_bam_add_int (next, sam_bam_get_int (subtype, aux, &width));
+                        aux += width;
+                    }
+                }
+                break;
+            }
+
+            default: ABORT ("Error: invalid type '%c' of optional field %c%c in BAM record of %s", type, field[0], field[1], txt_name);
+        }
+    }
+
+    ASSERT (aux == after, "Error: optional fields overflow their BAM record in %s", txt_name);
+    return next;
+}
+
+// finds a CG:B:I field with a long CIGAR - placed there by htslib if the CIGAR has more than 65535 ops,
+// replacing the CIGAR with "<seq_len>S<ref_len>N"
+static const uint8_t *sam_bam_find_cg (const uint8_t *aux, const uint8_t *after)
+{
+    while (aux + 3 <= after) {
+        char type = aux[2];
+        if (aux[0] == 'C' && aux[1] == 'G' && type == 'B' && aux[3] == 'I') return aux;
+
+        aux += 3;
+        unsigned width = 0;
+        switch (type) {
+            case 'A': case 'c': case 'C': aux += 1; break;
+            case 's': case 'S':           aux += 2; break;
+            case 'i': case 'I': case 'f': aux += 4; break;
+            case 'Z': case 'H':           { const uint8_t *nul = memchr (aux, 0, after - aux); if (!nul) return NULL; aux = nul + 1; break; }
+            case 'B':                     sam_bam_get_int (aux[0] == 'f' ? 'i' : aux[0], aux + 5, &width);
+                                          aux += 5 + LE32 (&aux[1]) * width; break;
+            default:                      return NULL; // sam_bam_add_aux will report the error
+        }
+    }
+    return NULL;
+}
+
+// converts one BAM record to a SAM line appended to txt_data
+static void sam_bam_record_to_sam (VBlock *vb, const uint8_t *rec)
+{
+    uint32_t block_size = LE32 (rec);
+    ASSERT (block_size >= BAM_FIXED_LEN - 4, "Error: invalid BAM record in %s: block_size=%u", txt_name, block_size);
+
+    const uint8_t *after = rec + 4 + block_size;
+    int32_t  ref_id      = LE32 (&rec[4]);
+    int32_t  pos         = LE32 (&rec[8]);
+    uint8_t  l_read_name = rec[12];
+    uint8_t  mapq        = rec[13];
+    uint32_t n_cigar_op  = LE16 (&rec[16]);
+    uint32_t flag        = LE16 (&rec[18]);
+    uint32_t l_seq       = LE32 (&rec[20]);
+    int32_t  next_ref_id = LE32 (&rec[24]);
+    int32_t  next_pos    = LE32 (&rec[28]);
+    int32_t  tlen        = LE32 (&rec[32]);
+
+    const uint8_t *read_name = &rec[BAM_FIXED_LEN];
+    const uint8_t *cigar     = read_name + l_read_name;
+    const uint8_t *seq       = cigar + n_cigar_op * 4;
+    const uint8_t *qual      = seq + (l_seq+1) / 2;
+    const uint8_t *aux       = qual + l_seq;
+
+    ASSERT (aux <= after && l_read_name && !read_name[l_read_name-1], "Error: invalid BAM record in %s", txt_name);
+
+    // case: long CIGAR is in the CG field
+    const uint8_t *cg = NULL;
+    if (n_cigar_op == 2 && (LE32 (cigar) & 0xf) == 4 /* S */ && (LE32 (cigar) >> 4) == l_seq && (LE32 (&cigar[4]) & 0xf) == 3 /* N */ &&
+        (cg = sam_bam_find_cg (aux, after))) {
+        cigar      = cg + 8;
+        n_cigar_op = LE32 (&cg[4]);
+    }
+
+    // a generous upper bound of the SAM line length: no binary field is more than 5 times longer in text
+    buf_alloc (vb, &vb->txt_data, vb->txt_data.len + 5 * (uint64_t)block_size + 2 * bam_max_ref_name_len + 100, 1.5, "txt_data", vb->vblock_i);
+    char *next = AFTERENT (char, vb->txt_data);
+
+    next = sam_bam_add_str (next, (const char *)read_name);                 *next++ = '\t';
+    next = sam_bam_add_int (next, flag);                                     *next++ = '\t';
+    next = sam_bam_add_str (next, sam_bam_ref_name (ref_id));                *next++ = '\t';
+    next = sam_bam_add_int (next, (int64_t)pos + 1);                         *next++ = '\t';
+    next = sam_bam_add_int (next, mapq);                                     *next++ = '\t';
+
+    if (n_cigar_op) next = sam_bam_add_cigar (next, cigar, n_cigar_op);
+    else            *next++ = '*';
+    *next++ = '\t';
+
+    if (next_ref_id != -1 && next_ref_id == ref_id) *next++ = '=';
+    else next = sam_bam_add_str (next, sam_bam_ref_name (next_ref_id));
+    *next++ = '\t';
+
+    next = sam_bam_add_int (next, (int64_t)next_pos + 1);                    *next++ = '\t';
+    next = sam_bam_add_int (next, tlen);                                     *next++ = '\t';
+
+    // SEQ: 2 bases per byte
+    static const char bases[16] = "=ACMGRSVTWYHKDBN";
+    if (l_seq) {
+        for (uint32_t i=0; i < l_seq / 2; i++) {
+            *next++ = bases[seq[i] >> 4];
+            *next++ = bases[seq[i] & 0xf];
+        }
+        if (l_seq % 2) *next++ = bases[seq[l_seq/2] >> 4];
+    }
+    else *next++ = '*';
+    *next++ = '\t';
+
+    // QUAL: Phred scores without the +33 offset, or 0xff if missing
+    if (l_seq && qual[0] != 0xff)
+        for (uint32_t i=0; i < l_seq; i++) *next++ = qual[i] + 33;
+    else
+        *next++ = '*';
+
+    next = sam_bam_add_aux (next, aux, after, cg);
+    *next++ = '\n';
+
+    vb->txt_data.len = next - vb->txt_data.data;
+}
+
+static uint32_t sam_bam_rec_len (const uint8_t *rec) 
+{ 
+    return 4 + LE32 (rec); // block_size doesn't include itself
+}
+
+// ZIP compute thread: uncompress the BGZF blocks of the VB, and convert the BAM records to SAM lines in txt_data
+void sam_bam_uncompress_vb (VBlock *vb)
+{
+    bgzf_records_to_txt (vb, 4, sam_bam_rec_len, sam_bam_record_to_sam);
+}
@@ -9,6 +9,7 @@
 #include "piz.h"
 #include "strings.h"
 #include "dict_id.h"
+#include "random_access.h"
 
 // CIGAR - calculate vb->seq_len from the CIGAR string, and if original CIGAR was "*" - recover it
 void sam_piz_special_CIGAR (VBlock *vb, MtfContext *ctx, const char *snip, unsigned snip_len)
@@ -70,9 +71,14 @@ void sam_piz_reconstruct_vb (VBlockSAM *vb)
 {
     piz_map_compound_field ((VBlockP)vb, sam_dict_id_is_qname_sf, &vb->qname_mapper);
 
-    for (vb->line_i=vb->first_line; vb->line_i < vb->first_line + vb->lines.len; vb->line_i++) {
+    for (uint32_t vb_line_i=0; vb_line_i < vb->lines.len; vb_line_i++) {
+
+        // --regions: skip segments of the VB that include no region, if the file has seek points
+        if (vb->seek_points.len && !random_access_seek_to_included_line ((VBlockP)vb, &vb_line_i)) break;
 
         uint32_t txt_data_start = vb->txt_data.len;
+        vb->dont_show_curr_line = false; // might become true due --regions
+        vb->line_i = vb->first_line + vb_line_i;
 
         piz_reconstruct_from_ctx (vb, SAM_QNAME,    '\t');
         piz_reconstruct_from_ctx (vb, SAM_FLAG,     '\t');
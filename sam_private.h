@@ -13,6 +13,7 @@ typedef struct {
     uint32_t seq_data_start, qual_data_start, e2_data_start, u2_data_start, bd_data_start, bi_data_start; // start within vb->txt_data
     uint32_t seq_data_len, qual_data_len, e2_data_len, u2_data_len, bd_data_len, bi_data_len;             // length within vb->txt_data
     uint32_t seq_len;        // actual sequence length determined from any or or of: CIGAR, SEQ, QUAL. If more than one contains the length, they must all agree
+    bool bi_is_delta;        // BI data in txt_data was already replaced by its delta from BD (the callback might be called more than once, eg with --codec-policy)
 } ZipDataLineSAM;
 
 typedef struct VBlockSAM {
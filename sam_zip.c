@@ -78,7 +78,7 @@ void sam_zip_get_start_len_line_i_bi (VBlock *vb, uint32_t vb_line_i,
 {
     ZipDataLineSAM *dl = DATA_LINE (vb_line_i);
 
-    if (dl->bi_data_len && dl->bd_data_len) {
+    if (dl->bi_data_len && dl->bd_data_len && !dl->bi_is_delta) {
 
         ASSERT (dl->bi_data_len == dl->bd_data_len, "Error: expecting dl->bi_data_len=%u to be equal to dl->bd_data_len=%u",
                 dl->bi_data_len, dl->bd_data_len);
@@ -88,6 +88,7 @@ void sam_zip_get_start_len_line_i_bi (VBlock *vb, uint32_t vb_line_i,
 
         // calculate character-wise delta
         for (unsigned i=0; i < dl->bi_data_len; i++) *(bi++) -= *(bd++);
+        dl->bi_is_delta = true;
     }
 
     *line_bi_data = dl->bi_data_len ? ENT (char, vb->txt_data, dl->bi_data_start) : NULL;
@@ -108,6 +109,7 @@ void sam_seg_initialize (VBlock *vb)
     vb->contexts[SAM_RNAME].flags     = CTX_FL_NO_STONS; // needs b250 node_index for random access
     vb->contexts[SAM_SEQ].flags       = CTX_FL_LOCAL_LZMA;
     vb->contexts[SAM_SEQ].ltype       = CTX_LT_SEQUENCE;
+    vb->contexts[SAM_QUAL].flags      = CTX_FL_LOCAL_QUAL;
     vb->contexts[SAM_QUAL].ltype      = CTX_LT_SEQUENCE;
     vb->contexts[SAM_TLEN].flags      = CTX_FL_STORE_VALUE;
     vb->contexts[SAM_OPTIONAL].flags  = CTX_FL_STRUCTURED;
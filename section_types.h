@@ -46,6 +46,8 @@ typedef enum {
     // added in v5
     SEC_DICT = 31, SEC_B250 = 32, SEC_LOCAL = 33, 
     SEC_DICT_ID_ALIASES = 34,
+    SEC_DICT_INDEX = 35, // optional
+    SEC_SEEK_POINTS = 36, // optional (--seek-points)
 
     NUM_SEC_TYPES // fake section for counting
 } SectionType;
@@ -74,6 +76,7 @@ typedef enum {
     {"SEC_HT_GTSHARK_X_ALLELE",        },\
     \
     {"SEC_DICT", }, {"SEC_B250", }, {"SEC_LOCAL", }, { "SEC_DICT_ID_ALIASES", },\
+    {"SEC_DICT_INDEX", }, {"SEC_SEEK_POINTS", },\
 }
 
 #define section_type_is_dictionary(s) ((s) == SEC_DICT                 || (s) == SEC_VCF_FRMT_SF_DICT_legacy || (s) == SEC_VCF_CHROM_DICT_legacy  || (s) == SEC_VCF_POS_DICT_legacy    || \
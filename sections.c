@@ -212,13 +212,15 @@ const char *st_name(SectionType sec_type)
 }
 
 // called by PIZ I/O
-SectionListEntry *sections_get_offset_first_section_of_type (SectionType st)
+SectionListEntry *sections_get_offset_first_section_of_type (SectionType st, bool soft_fail)
 {
     ARRAY (SectionListEntry, sl, z_file->section_list_buf);
 
     for (unsigned i=0; i < z_file->section_list_buf.len; i++)
         if (sl[i].section_type == st) return &sl[i];
 
+    if (soft_fail) return NULL;
+
     ABORT ("Error in sections_get_offset_first_section_of_type: Cannot find section_type=%s in z_file", st_name (st));
     return 0; // never reaches here - squash compiler warning
 }
\ No newline at end of file
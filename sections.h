@@ -152,6 +152,33 @@ typedef struct {
     uint32_t min_pos, max_pos;         // POS field value of smallest and largest POS value of this chrom in this VB (regardless of whether the VB is sorted)
 } RAEntry; 
 
+// the data of SEC_DICT_INDEX is an array of the following type, as is z_file->dict_index_buf. 
+// we maintain one entry per vb per every context whose dictionary is used by the vb, in the order of the vbs
+typedef struct DictIndexEntry {
+    uint32_t vblock_i;                 // the vb_i that uses this dictionary
+    uint32_t num_words;                // 1 + the highest word index used by this vb - only the dictionary fragments containing these words are needed to reconstruct it
+    DictIdType dict_id;
+} DictIndexEntry; 
+
+// the data of SEC_SEEK_POINTS (one section per VB, compressed with --seek-points) is a sequence of SeekPoint records, 
+// each followed by its num_ctxs SeekPointCtx entries. a seek point divides the VB into segments of lines, and records 
+// the state of each context at the first line of the segment, so PIZ can start reconstructing from there
+typedef struct SeekPoint {
+    uint32_t vb_line_i;                // first line of this segment (0-based, within the VB). the segment ends at the next seek point
+    uint32_t chrom_index;              // before merge: node index into chrom context mtf, after merge - word index in CHROM dictionary. NIL if the segment has more than one chrom
+    uint32_t min_pos, max_pos;         // smallest and largest POS in the segment, or 0 if it has no line with a POS
+    uint32_t num_ctxs;                 // number of SeekPointCtx entries following this SeekPoint
+} SeekPoint;
+
+// contexts not listed are at their initial state at the seek point (no b250 or local consumed yet, last_value=last_delta=0)
+typedef struct SeekPointCtx {
+    DictIdType dict_id;
+    uint32_t b250_offset;              // byte offset into the b250 data of the first b250 word of the segment
+    int32_t  prev_word_index;          // the word index preceding it (for BASE250_ONE_UP), -1 if none
+    uint32_t next_local;               // index into the local data of the first local item of the segment (elements for int ltypes, bytes otherwise)
+    int64_t  last_value, last_delta;   
+} SeekPointCtx;
+
 // ------------------------------------------------------------------------------------------------------
 // GENOZIP_FILE_FORMAT_VERSION==1 historical version (VCF only) - we support uncomrpessing old version files
 
@@ -226,7 +253,7 @@ extern void sections_list_concat (VBlockP vb, BufferP section_list_buf);
 extern SectionType sections_get_next_header_type(SectionListEntry **sl_ent, bool *skipped_vb, BufferP region_ra_intersection_matrix);
 extern bool sections_get_next_dictionary(SectionListEntry **sl_ent);
 extern bool sections_has_more_components(void);
-extern SectionListEntry *sections_get_offset_first_section_of_type (SectionType st);
+extern SectionListEntry *sections_get_offset_first_section_of_type (SectionType st, bool soft_fail);
 extern SectionListEntry *sections_vb_first (uint32_t vb_i);
 
 extern void BGEN_sections_list(void);
@@ -17,6 +17,12 @@
 #include "base64.h"
 #include "piz.h"
 #include "zfile.h"
+#include "dispatcher.h"
+#if defined __AVX2__
+#include <immintrin.h>
+#elif defined __SSE2__
+#include <emmintrin.h>
+#endif
 
 void seg_init_mapper (VBlock *vb, int field_i, Buffer *mapper_buf, const char *name)
 {
@@ -52,6 +58,98 @@ uint32_t seg_by_ctx (VBlock *vb, const char *snip, unsigned snip_len, MtfContext
     return node_index;
 } 
 
+// index the separators of one chunk of up to 64 bytes: bit i is set if txt[i] is a tab or newline (tab_nl) or a colon (colon)
+static inline void seg_index_separators_chunk (const char *txt, unsigned len, uint64_t *tab_nl, uint64_t *colon)
+{
+    uint64_t t=0, c=0;
+    for (unsigned i=0; i < len; i++) {
+        t |= (uint64_t)(txt[i] == '\t' || txt[i] == '\n') << i;
+        c |= (uint64_t)(txt[i] == ':') << i;
+    }
+    *tab_nl = t;
+    *colon  = c;
+}
+
+// build bitmaps of the tab/newline and colon positions in txt_data in a single (vectorized if possible) pass, 
+// to be consumed by seg_get_next_item instead of scanning byte-by-byte for each field. 
+// sep_index contains two bitmaps of sep_index.len words each: first tab_nl then colon.
+static void seg_index_separators (VBlock *vb)
+{
+    uint64_t num_words  = (vb->txt_data.len + 63) / 64;
+    uint64_t full_words = vb->txt_data.len / 64;
+
+    buf_alloc (vb, &vb->sep_index, 2 * num_words * sizeof (uint64_t), 1, "sep_index", vb->vblock_i);
+    vb->sep_index.len = num_words;
+
+    uint64_t *tab_nl = FIRSTENT (uint64_t, vb->sep_index);
+    uint64_t *colon  = tab_nl + num_words;
+    const char *txt  = vb->txt_data.data;
+
+#if defined __AVX2__
+    const __m256i tab = _mm256_set1_epi8 ('\t'), nl = _mm256_set1_epi8 ('\n'), col = _mm256_set1_epi8 (':');
+
+    for (uint64_t w=0; w < full_words; w++, txt += 64) {
+        __m256i lo = _mm256_loadu_si256 ((const __m256i *)txt);
+        __m256i hi = _mm256_loadu_si256 ((const __m256i *)(txt + 32));
+
+        tab_nl[w] = (uint64_t)(uint32_t)_mm256_movemask_epi8 (_mm256_or_si256 (_mm256_cmpeq_epi8 (lo, tab), _mm256_cmpeq_epi8 (lo, nl))) |
+                    (uint64_t)(uint32_t)_mm256_movemask_epi8 (_mm256_or_si256 (_mm256_cmpeq_epi8 (hi, tab), _mm256_cmpeq_epi8 (hi, nl))) << 32;
+
+        colon[w]  = (uint64_t)(uint32_t)_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (lo, col)) |
+                    (uint64_t)(uint32_t)_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (hi, col)) << 32;
+    }
+
+#elif defined __SSE2__
+    const __m128i tab = _mm_set1_epi8 ('\t'), nl = _mm_set1_epi8 ('\n'), col = _mm_set1_epi8 (':');
+
+    for (uint64_t w=0; w < full_words; w++, txt += 64) {
+        uint64_t t=0, c=0;
+        for (unsigned k=0; k < 4; k++) {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(txt + k*16));
+            t |= (uint64_t)(uint16_t)_mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (v, tab), _mm_cmpeq_epi8 (v, nl))) << (k*16);
+            c |= (uint64_t)(uint16_t)_mm_movemask_epi8 (_mm_cmpeq_epi8 (v, col)) << (k*16);
+        }
+        tab_nl[w] = t;
+        colon[w]  = c;
+    }
+
+#else
+    for (uint64_t w=0; w < full_words; w++, txt += 64) 
+        seg_index_separators_chunk (txt, 64, &tab_nl[w], &colon[w]);
+#endif
+
+    if (num_words > full_words) // last partial word
+        seg_index_separators_chunk (txt, vb->txt_data.len % 64, &tab_nl[full_words], &colon[full_words]);
+}
+
+// returns the index of the first tab or newline (or also colon, if with_colon) in str, or str_len if there is none
+static inline unsigned seg_find_separator (VBlock *vb, const char *str, unsigned str_len, bool with_colon)
+{
+    uint64_t offset = str - vb->txt_data.data;
+
+    // case: str is not in txt_data of a VB being segmented - scan byte-by-byte
+    if (!vb->sep_index.len || str < vb->txt_data.data || offset >= vb->txt_data.len) {
+        unsigned i=0; 
+        for (; i < str_len; i++) 
+            if (str[i] == '\t' || str[i] == '\n' || (with_colon && str[i] == ':')) break;
+        return i;
+    }
+
+    const uint64_t *tab_nl = FIRSTENT (const uint64_t, vb->sep_index);
+    const uint64_t *colon  = tab_nl + vb->sep_index.len;
+
+    uint64_t word_i = offset / 64;
+    uint64_t bits = (tab_nl[word_i] | (with_colon ? colon[word_i] : 0)) & (~0ULL << (offset % 64)); // ignore bits before str
+
+    while (!bits) {
+        if (++word_i == vb->sep_index.len) return str_len; 
+        bits = tab_nl[word_i] | (with_colon ? colon[word_i] : 0);
+    }
+
+    uint64_t i = word_i * 64 + __builtin_ctzll (bits) - offset;
+    return (unsigned)MIN (i, (uint64_t)str_len);
+}
+
 const char *seg_get_next_item (void *vb_, const char *str, int *str_len, bool allow_newline, bool allow_tab, bool allow_colon, 
                                unsigned *len, char *separator, 
                                bool *has_13, // out - only needed if allow_newline=true
@@ -59,25 +157,25 @@ const char *seg_get_next_item (void *vb_, const char *str, int *str_len, bool al
 {
     VBlockP vb = (VBlockP)vb_;
 
-    unsigned i=0; for (; i < *str_len; i++)
-        if ((allow_tab     && str[i] == '\t') ||
-            (allow_colon   && str[i] == ':')  ||
-            (allow_newline && str[i] == '\n')) {
-                *len = i;
-                *separator = str[i];
-                *str_len -= i+1;
-
-                // check for Windows-style '\r\n' end of line 
-                if (i && str[i] == '\n' && str[i-1] == '\r') {
-                    (*len)--;
-                    ASSERT0 (has_13, "Error in seg_get_next_item: has_13==NULL but expecting it because allow_newline=true");
-                    *has_13 = true;
-                }
-
-                return str + i+1; // beyond the separator
+    // note: a colon with allow_colon=false is not an error, its just part of the string rather than being a separator
+    unsigned i = seg_find_separator (vb, str, *str_len, allow_colon);
+    
+    if (i < *str_len && ((allow_tab     && str[i] == '\t') ||
+                         (allow_colon   && str[i] == ':')  ||
+                         (allow_newline && str[i] == '\n'))) {
+        *len = i;
+        *separator = str[i];
+        *str_len -= i+1;
+
+        // check for Windows-style '\r\n' end of line 
+        if (i && str[i] == '\n' && str[i-1] == '\r') {
+            (*len)--;
+            ASSERT0 (has_13, "Error in seg_get_next_item: has_13==NULL but expecting it because allow_newline=true");
+            *has_13 = true;
         }
-        else if ((!allow_tab     && str[i] == '\t') ||  // note: a colon with allow_colon=false is not an error, its just part of the string rather than being a separator
-                 (!allow_newline && str[i] == '\n')) break;
+
+        return str + i+1; // beyond the separator
+    }
             
     ASSSEG (*str_len, str, "Error: missing %s field", item_name);
 
@@ -97,19 +195,21 @@ const char *seg_get_next_line (void *vb_, const char *str, int *str_len, unsigne
 {
     VBlockP vb = (VBlockP)vb_;
 
-    unsigned i=0; for (; i < *str_len; i++)
-        if (str[i] == '\n') {
-                *len = i;
-                *str_len -= i+1;
+    const char *newline = memchr (str, '\n', *str_len); // memchr is vectorized
+    unsigned i = newline ? newline - str : *str_len;
 
-                // check for Windows-style '\r\n' end of line 
-                if (i && str[i-1] == '\r') {
-                    (*len)--;
-                    *has_13 = true;
-                }
+    if (newline) {
+        *len = i;
+        *str_len -= i+1;
 
-                return str + i+1; // beyond the separator
+        // check for Windows-style '\r\n' end of line 
+        if (i && str[i-1] == '\r') {
+            (*len)--;
+            *has_13 = true;
         }
+
+        return str + i+1; // beyond the separator
+    }
     
     ASSSEG (*str_len, str, "Error: missing %s field", item_name);
 
@@ -649,7 +749,7 @@ static void seg_set_hash_hints (VBlock *vb, int third_num)
     for (unsigned did_i=0; did_i < vb->num_dict_ids; did_i++) {
 
         MtfContext *ctx = &vb->contexts[did_i];
-        if (ctx->global_hash_prime) continue; // our service is not needed - global_cache for this dict already exists
+        if (ctx->global_hash_size) continue; // our service is not needed - global_cache for this dict already exists
 
         if (third_num == 1) 
             ctx->mtf_len_at_1_3 = ctx->mtf.len;
@@ -661,6 +761,10 @@ static void seg_set_hash_hints (VBlock *vb, int third_num)
 
 static uint32_t seg_estimate_num_lines (VBlock *vb)
 {
+    // case: the reader indexed the newlines - we know the exact number of lines (a FASTQ entry consists of 4 lines)
+    if (vb->txt_line_ends.len) 
+        return vb->data_type == DT_FASTQ ? (vb->txt_line_ends.len + 3) / 4 : vb->txt_line_ends.len;
+
     // get first line length
     uint32_t len=0; for (; len < vb->txt_data.len && vb->txt_data.data[len] != '\n'; len++) {};
 
@@ -707,40 +811,40 @@ static void seg_verify_file_size (VBlock *vb)
     }
 }
 
-// split each lines in this variant block to its components
-void seg_all_data_lines (VBlock *vb)
+static void seg_alloc_lines (VBlock *vb, uint32_t num_lines, bool is_exact, uint32_t sizeof_line)
 {
-    START_TIMER;
-
-    mtf_initialize_primary_field_ctxs (vb->contexts, vb->data_type, vb->dict_id_to_did_i_map, &vb->num_dict_ids); // Create ctx for the fields in the correct order 
-
-    mtf_verify_field_ctxs (vb);
-    
-    uint32_t sizeof_line = DTP(sizeof_zip_dataline) ? DTP(sizeof_zip_dataline)() : 0;
-
-    if (!sizeof_line) sizeof_line=1; // we waste a little bit of memory to avoid making exceptions throughout the code logic
- 
-    // allocate lines
-    buf_alloc (vb, &vb->lines, seg_estimate_num_lines(vb) * sizeof_line, 1.2, "lines", vb->vblock_i);
+    buf_alloc (vb, &vb->lines, num_lines * sizeof_line, is_exact ? 1 : 1.2, "lines", vb->vblock_i);
     buf_zero (&vb->lines);
-    vb->lines.len = vb->lines.size / sizeof_line;
+    vb->lines.len = is_exact ? num_lines : vb->lines.size / sizeof_line;
 
     // allocate the mtf_i for the fields which each have num_lines entries
     for (int f=0; f < DTF(num_fields); f++) 
         buf_alloc (vb, &vb->contexts[f].mtf_i, vb->lines.len * sizeof (uint32_t), 1, "contexts->mtf_i", f);
-    
-    if (DTP(seg_initialize)) DTP(seg_initialize) (vb); // data-type specific initialization
+}
 
-    const char *field_start = vb->txt_data.data;
-    bool hash_hints_set_1_3 = false, hash_hints_set_2_3 = false;
+// seg the lines in [start, after) of vb->txt_data, returns true if any line has a Windows-style \r\n. 
+// num_dict_ids_at_hint (2 entries) is set to the number of contexts when each hash hint was taken, if it was taken in this range
+static bool seg_line_range (VBlock *vb, const char *start, const char *after, uint32_t sizeof_line, unsigned *num_dict_ids_at_hint)
+{
+    // collect stats at the approximate 1/3 or 2/3s marks of the file, to help hash_alloc_global create a hash
+    // table. note: we do this for every vb, not just 1, because hash_alloc_global runs in the first
+    // vb a new field/subfield is introduced. in a seg shard, only the shard in which the mark falls takes the hint
+    uint64_t start_offset = start - vb->txt_data.data;
+    bool hash_hints_set_1_3 = (start_offset > vb->txt_data.len / 3);
+    bool hash_hints_set_2_3 = (start_offset > 2 * vb->txt_data.len / 3);
+
+    const char *field_start = start;
     bool does_any_line_have_13 = false;
     for (vb->line_i=0; vb->line_i < vb->lines.len; vb->line_i++) {
 
-        if (field_start - vb->txt_data.data == vb->txt_data.len) { // we're done
+        if (field_start == after) { // we're done
             vb->lines.len = vb->line_i; // update to actual number of lines
             break;
         }
 
+        // --seek-points: snapshot the state of the contexts before every N lines
+        random_access_add_seek_point (vb);
+
         //fprintf (stderr, "vb->line_i=%u\n", vb->line_i);
         bool has_13 = false;
         const char *next_field = DTP(seg_txt_line) (vb, field_start, &has_13);
@@ -750,22 +854,188 @@ void seg_all_data_lines (VBlock *vb)
         field_start = next_field;
 
         // if our estimate number of lines was too small, increase it
-        if (vb->line_i == vb->lines.len-1 && field_start - vb->txt_data.data != vb->txt_data.len) 
+        if (vb->line_i == vb->lines.len-1 && field_start != after) 
             seg_more_lines (vb, sizeof_line);
 
-        // collect stats at the approximate 1/3 or 2/3s marks of the file, to help hash_alloc_global create a hash
-        // table. note: we do this for every vb, not just 1, because hash_alloc_global runs in the first
-        // vb a new field/subfield is introduced
         if (!hash_hints_set_1_3 && (field_start - vb->txt_data.data) > vb->txt_data.len / 3) {
             seg_set_hash_hints (vb, 1);
+            num_dict_ids_at_hint[0] = vb->num_dict_ids;
             hash_hints_set_1_3 = true;
         }
         else if (!hash_hints_set_2_3 && (field_start - vb->txt_data.data) > 2 * vb->txt_data.len / 3) {
             seg_set_hash_hints (vb, 2);
+            num_dict_ids_at_hint[1] = vb->num_dict_ids;
             hash_hints_set_2_3 = true;
         }
     }
 
+    return does_any_line_have_13;
+}
+
+// --seg-shards: a seg shard is a line range of a VB, segged by a separate "shard VB" into shard-local contexts, concurrently 
+// with the other shards. the shards are then merged into the VB's contexts in order, before mtf_merge_in_vb_ctx. 
+// Only data types whose seg state is fully contained in the contexts can be sharded - i.e. there is no state carried
+// from one line to the next (such as POS deltas, last_line in FASTA or sample state in VCF) - currently this is FASTQ.
+typedef struct {
+    VBlock *vb;                       // shard VB
+    const char *start, *after;       // line range of this shard in the txt_data of the VB being segged
+    uint32_t first_line, num_lines;   
+    uint32_t sizeof_line;
+    unsigned num_dict_ids_at_hint[2];
+    bool has_13;
+} SegShard;
+
+static unsigned num_seg_shards = 1;
+
+void seg_set_num_shards (const char *num_shards_str)
+{
+    int num_shards;
+    ASSERT (sscanf (num_shards_str, "%d", &num_shards) == 1 && num_shards >= 1 && num_shards <= MAX_SEG_SHARDS, 
+            "%s: invalid argument of --seg-shards: %s. Expecting an integer between 1 and %u", global_cmd, num_shards_str, MAX_SEG_SHARDS);
+
+    num_seg_shards = num_shards;
+}
+
+// called by the I/O thread at the beginning of each file
+void seg_verify_num_shards (DataType dt)
+{
+    static bool warned = false;
+    
+    if (num_seg_shards > 1 && dt != DT_FASTQ && !warned) {
+        ASSERTW (false, "%s: Warning: --seg-shards is supported for FASTQ files only, it is ignored for %s", global_cmd, dt_name (dt));
+        warned = true;
+    }
+}
+
+#define MIN_LINES_PER_SEG_SHARD 1000
+
+static unsigned seg_get_num_shards (VBlock *vb, uint32_t num_lines)
+{
+    if (num_seg_shards == 1 || vb->data_type != DT_FASTQ || !vb->txt_line_ends.len) return 1;
+
+    return MAX (1, MIN (num_seg_shards, num_lines / MIN_LINES_PER_SEG_SHARD));
+}
+
+// a subtask run by the dispatcher pool
+static void seg_shard_seg (void *shard_)
+{
+    SegShard *shard = (SegShard *)shard_;
+
+    seg_alloc_lines (shard->vb, shard->num_lines, true, shard->sizeof_line);
+
+    shard->has_13 = seg_line_range (shard->vb, shard->start, shard->after, shard->sizeof_line, shard->num_dict_ids_at_hint);
+}
+
+static void seg_shard_initialize (VBlock *vb, unsigned shard_i, SegShard *shard, uint32_t num_lines, unsigned num_shards, uint32_t sizeof_line)
+{
+    if (!vb->seg_shards[shard_i]) {
+        unsigned sizeof_vb = DTP(sizeof_vb) ? DTP(sizeof_vb)() : sizeof (VBlock);
+        vb->seg_shards[shard_i] = calloc (sizeof_vb, 1);
+        ASSERT0 (vb->seg_shards[shard_i], "Error: failed to calloc shard vb");
+        vb->seg_shards[shard_i]->data_type = vb->data_type;
+    }
+
+    VBlock *shard_vb = vb->seg_shards[shard_i];
+    shard_vb->id                   = vb->id;
+    shard_vb->vblock_i             = vb->vblock_i;
+    shard_vb->in_use               = true;
+    shard_vb->buffer_list.vb       = shard_vb;
+    shard_vb->vb_position_txt_file = vb->vb_position_txt_file;
+    shard_vb->txt_data             = vb->txt_data;  // borrowed - the shard segs its range of the entire txt_data, so offsets into txt_data are the same as vb's
+    shard_vb->sep_index            = vb->sep_index; // borrowed
+
+    mtf_clone_ctx_to_shard (shard_vb, vb);
+
+    // divide the lines between the shards, with the boundaries after the last newline of the previous shard's last line
+    unsigned newlines_per_line = (vb->data_type == DT_FASTQ) ? 4 : 1;
+    ARRAY (const uint32_t, line_ends, vb->txt_line_ends);
+
+    uint32_t first_line = (uint64_t)num_lines * shard_i / num_shards;
+    uint32_t after_line = (uint64_t)num_lines * (shard_i+1) / num_shards;
+
+    *shard = (SegShard){ .vb          = shard_vb, 
+                         .first_line  = first_line,
+                         .num_lines   = after_line - first_line,
+                         .sizeof_line = sizeof_line,
+                         .start       = vb->txt_data.data + (first_line ? line_ends[first_line * newlines_per_line - 1] + 1 : 0),
+                         .after       = (shard_i == num_shards-1) ? AFTERENT (char, vb->txt_data) 
+                                                                  : vb->txt_data.data + line_ends[after_line * newlines_per_line - 1] + 1 };
+}
+
+// seg the shards concurrently, and merge them into vb in order. returns true if any line has a Windows-style \r\n
+static bool seg_line_range_by_shards (VBlock *vb, unsigned num_shards, uint32_t sizeof_line)
+{
+    SegShard shards[MAX_SEG_SHARDS];
+    uint32_t num_lines = vb->lines.len;
+
+    for (unsigned shard_i=0; shard_i < num_shards; shard_i++)
+        seg_shard_initialize (vb, shard_i, &shards[shard_i], num_lines, num_shards, sizeof_line);
+
+    // seg the shards on the workers of the dispatcher pool - the first shard is segged by this thread
+    dispatcher_run_subtasks (seg_shard_seg, shards, sizeof (SegShard), num_shards);
+
+    // merge the shards, in order
+    bool does_any_line_have_13 = false;
+    for (unsigned shard_i=0; shard_i < num_shards; shard_i++) {
+        SegShard *shard = &shards[shard_i];
+
+        ASSERT (shard->vb->lines.len == shard->num_lines, "Error in seg_line_range_by_shards: expecting shard %u to have %u lines, but it has %u", 
+                shard_i, shard->num_lines, (uint32_t)shard->vb->lines.len);
+
+        // hash hints of contexts that have no new nodes in this shard before the mark. the rest are set in mtf_merge_in_shard_ctx
+        for (unsigned hint_i=0; hint_i < 2; hint_i++) 
+            if (shard->num_dict_ids_at_hint[hint_i]) {
+                vb->line_i = shard->first_line + (hint_i ? shard->vb->num_lines_at_2_3 : shard->vb->num_lines_at_1_3) - 1;
+                seg_set_hash_hints (vb, hint_i+1);
+            }
+
+        mtf_merge_in_shard_ctx (vb, shard->vb, shard->num_dict_ids_at_hint);
+
+        memcpy (&vb->lines.data[shard->first_line * sizeof_line], shard->vb->lines.data, shard->num_lines * sizeof_line);
+
+        vb->longest_line_len = MAX (vb->longest_line_len, shard->vb->longest_line_len);
+        if (shard->has_13) does_any_line_have_13 = true;
+
+        // return the borrowed buffers, and release the shard VB for the next VB
+        memset (&shard->vb->txt_data, 0, sizeof (Buffer));
+        memset (&shard->vb->sep_index, 0, sizeof (Buffer));
+        vb_release_vb (shard->vb);
+    }
+
+    vb->line_i = num_lines;
+    return does_any_line_have_13;
+}
+
+// split each lines in this variant block to its components
+void seg_all_data_lines (VBlock *vb)
+{
+    START_TIMER;
+
+    mtf_initialize_primary_field_ctxs (vb->contexts, vb->data_type, vb->dict_id_to_did_i_map, &vb->num_dict_ids); // Create ctx for the fields in the correct order 
+
+    mtf_verify_field_ctxs (vb);
+    
+    uint32_t sizeof_line = DTP(sizeof_zip_dataline) ? DTP(sizeof_zip_dataline)() : 0;
+
+    if (!sizeof_line) sizeof_line=1; // we waste a little bit of memory to avoid making exceptions throughout the code logic
+ 
+    // allocate lines
+    bool is_exact = vb->txt_line_ends.len > 0;
+    uint32_t num_lines = seg_estimate_num_lines(vb);
+    seg_alloc_lines (vb, num_lines, is_exact, sizeof_line);
+    
+    if (DTP(seg_initialize)) DTP(seg_initialize) (vb); // data-type specific initialization
+
+    seg_index_separators (vb);
+
+    unsigned num_shards = seg_get_num_shards (vb, num_lines);
+    unsigned num_dict_ids_at_hint[2]; // not used 
+
+    bool does_any_line_have_13 = (num_shards > 1) ? seg_line_range_by_shards (vb, num_shards, sizeof_line)
+                                                  : seg_line_range (vb, vb->txt_data.data, AFTERENT (char, vb->txt_data), sizeof_line, num_dict_ids_at_hint);
+
+    buf_free (&vb->sep_index); // valid only while txt_data is segmented
+
     // if no line has special EOL, we can get rid of the EOL ctx
     if (!does_any_line_have_13) {
         MtfContext *eol_ctx = &vb->contexts[DTF(eol)];
@@ -12,6 +12,8 @@
 #include "move_to_front.h"
 
 extern void seg_all_data_lines (VBlockP vb); 
+extern void seg_set_num_shards (const char *num_shards_str);
+extern void seg_verify_num_shards (DataType dt);
 
 extern void seg_init_mapper (VBlockP vb, int field_i, BufferP mapper_buf, const char *name);
 
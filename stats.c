@@ -59,7 +59,8 @@ static void stats_get_sizes (DictIdType dict_id /* option 1 */, int overhead_sec
         else if (section->section_type == SEC_TXT_HEADER && overhead_sec == OVERHEAD_SEC_TXT_HDR)
             *local_compressed_size += (section+1)->offset - section->offset;
 
-        else if (section->section_type == SEC_RANDOM_ACCESS && overhead_sec == OVERHEAD_SEC_RA_INDEX)
+        else if ((section->section_type == SEC_RANDOM_ACCESS || section->section_type == SEC_DICT_INDEX || section->section_type == SEC_SEEK_POINTS) 
+                 && overhead_sec == OVERHEAD_SEC_RA_INDEX)
             *local_compressed_size += (section+1)->offset - section->offset;
         
         else if ((section->section_type == SEC_VCF_HT_DATA && dict_id.num == dict_id_fields[VCF_GT]) ||
@@ -205,8 +206,8 @@ void stats_show_sections (void)
         /* % dict         */ s->pc_dict              = !ctx->mtf_i.len         ? 0 : 100.0 * (double)ctx->mtf.len / (double)ctx->mtf_i.len;
         /* % singletons   */ s->pc_singletons        = !ctx->mtf_i.len         ? 0 : 100.0 * (double)ctx->num_singletons / (double)ctx->mtf_i.len;
         /* % failed singl.*/ s->pc_failed_singletons = !ctx->mtf_i.len         ? 0 : 100.0 * (double)ctx->num_failed_singletons / (double)ctx->mtf_i.len;
-        /* % hash occupn. */ s->pc_hash_occupancy    = !ctx->global_hash_prime ? 0 : 100.0 * (double)(ctx->mtf.len + ctx->ol_mtf.len) / (double)ctx->global_hash_prime;
-        /* Hash           */ str_uint_commas (ctx->global_hash_prime, s->hash);
+        /* % hash occupn. */ s->pc_hash_occupancy    = !ctx->global_hash_size  ? 0 : 100.0 * (double)(ctx->mtf.len + ctx->ol_mtf.len) / (double)ctx->global_hash_size;
+        /* Hash           */ str_uint_commas (ctx->global_hash_size, s->hash);
         /* uncomp dict    */ str_size (ctx->dict.len, s->uncomp_dict);
         /* comp dict      */ str_size (dict_compressed_size, s->comp_dict);
         }
@@ -171,6 +171,83 @@ cut -f1-8 test-file.vcf > test-input.vcf
 ./genozip test-input.vcf -ft -o ${output}.genozip || exit 1
 rm test-input.vcf
 
+if `command -v bgzip >& /dev/null` && `command -v gzip >& /dev/null`; then
+    for i in {1..300}; do cat test-file.fq; done > bgzf-test.fq # more than 64KB - several BGZF blocks
+    for file in test-file.vcf bgzf-test.fq; do
+        ext=${file#*.}
+        test_header "$file - genounzip --bgzip, and BGZF as input"
+        ./genozip $file -fo ${output}.$ext.genozip || exit 1 # note: the data type extension tells genounzip the output type
+        ./genounzip ${output}.$ext.genozip --bgzip -fo bgzf-test.output.$ext.gz || exit 1
+        gzip -dc bgzf-test.output.$ext.gz > bgzf-test.output.$ext || exit 1
+        cmp_2_files $file bgzf-test.output.$ext.fake-extension
+        ./genozip bgzf-test.output.$ext.gz -@3 -ft -o ${output}.genozip || exit 1
+        rm bgzf-test.output.$ext.gz bgzf-test.output.$ext ${output}.$ext.genozip
+    done
+    rm bgzf-test.fq
+fi
+
+# genocat --regions uses the dictionary index to read only the dictionaries it needs, and seek points
+# to decompress only part of a vblock - the output must be the same with and without seek points
+test_regions() {
+    test_header "$1 --regions $2 - with and without --seek-points"
+    ./genozip $1 -fo ${output}.genozip || exit 1
+    ./genocat ${output}.genozip --regions $2 > regions-test.1 || exit 1
+    ./genozip $1 --seek-points 2 -fo ${output}.genozip || exit 1
+    ./genocat ${output}.genozip --regions $2 > regions-test.2 || exit 1
+    if ! cmp -s regions-test.1 regions-test.2; then
+        echo "FAILED - genocat --regions output differs with --seek-points"
+        exit 1
+    fi
+    wc=`grep -v "^[#@]" regions-test.2 | wc -l`
+    if [[ $wc != $3 ]]; then
+        echo "FAILED - expected $3 lines, but getting $wc"
+        exit 1
+    fi
+    rm regions-test.1 regions-test.2
+}
+
+test_regions test-file.vcf 13 5
+test_regions test-file.vcf ^13 4
+test_regions test-file.sam chr2,chr5 4
+
+# VBs complete out of order with several threads - random access entries must still be written in VB order
+test_header "genocat --regions of a multi-vblock file compressed with -@8"
+(echo "##fileformat=VCFv4.2"; echo -e "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO"
+ for chrom in 1 2; do seq 1 100000 | awk -v chrom=$chrom '{print chrom "\t" $1*10 "\t.\tA\tG\t.\tPASS\tDP=" $1%50}'; done) > regions-test.vcf
+./genozip regions-test.vcf -@8 -B1 -fo ${output}.genozip || exit 1
+for regions in 1:100000-300000,2:900000-1000000:30002 1:100000-300000:20001; do # the latter excludes later VBs, whose dictionary fragments may still be needed
+    expected=${regions##*:}
+    wc=`./genocat ${output}.genozip --regions ${regions%:*} | grep -v "^#" | wc -l`
+    if [[ $wc != $expected ]]; then
+        echo "FAILED - expected $expected lines, but getting $wc"
+        exit 1
+    fi
+done
+rm regions-test.vcf
+
+for file in test-file.vcf test-file.sam test-file.fq; do
+    for opt in "--zstd 3" "--zstd 19:b250,local --zstd 1" "--codec-policy ratio" "--codec-policy speed" "--rans"; do
+        test_header "$file $opt"
+        ./genozip $file $opt -ft -o ${output}.genozip || exit 1
+    done
+done
+
+# test-file.bam: paired and unmapped reads, indels and clipping, odd-length SEQ, missing QUAL, all integer, float, 
+# char, hex and array tag types - read natively, without samtools
+test_header "test-file.bam - BAM input"
+./genozip test-file.bam -ft -o ${output}.sam.genozip || exit 1
+./genozip test-file.bam -@3 -ft -o ${output}.sam.genozip || exit 1
+rm ${output}.sam.genozip
+test_count_genocat_lines test-file.bam "--no-header" 8
+
+# test-file.bcf: multi-allelic records, missing values, haploid and mixed-ploidy GT, vector-end padding of FORMAT 
+# fields and samples with trailing fields dropped - read natively, without bcftools
+test_header "test-file.bcf - BCF input"
+./genozip test-file.bcf -ft -o ${output}.vcf.genozip || exit 1
+./genozip test-file.bcf -@3 -ft -o ${output}.vcf.genozip || exit 1
+rm ${output}.vcf.genozip
+test_count_genocat_lines test-file.bcf "--no-header" 7
+
 if `command -v samtools >& /dev/null`; then
     test_header "test_file.sam - input and output as BAM"
     samtools view test-file.sam -OBAM -h > bam-test.input.bam    
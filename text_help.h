@@ -21,7 +21,7 @@ static const char *help_genozip[] = {
     "   GVF: gvf (possibly .gz .bgz .bz2 .xz)",
     "   23andMe: genome*Full*.txt (possibly zip)",
     "",
-    "Note: for comressing .bcf, .bam or .xz files requires bcftools, samtools or xz, respectively, to be installed",
+    "Note: for comressing .xz files requires xz to be installed",
     "",
     "Examples: genozip file1.vcf file2.vcf -o concat.vcf.genozip",
     "          genozip --optimize -password 12345 ftp://ftp.ncbi.nlm.nih.gov/file2.vcf.gz",
@@ -70,8 +70,20 @@ static const char *help_genozip[] = {
     "",
     "   -@ --threads      <number>. Specify the maximum number of threads. By default, this is set to the number of cores available. The number of threads actually used may be less, if sufficient to balance CPU and I/O",
     "",
+    "   --vblocks-in-flight <number>. The maximum number of vblocks being compressed or waiting to be written at any time. By default, this is the number of threads plus 2, so that threads don't idle while a slow vblock holds up writing the ones after it. Each vblock in flight consumes memory of about the vblock size (see --vblock), so memory consumption is linear with this value",
+    "",
     "   -B --vblock       <number between 1 and 2048>. Set the maximum size of data (in megabytes) of the source textual (VCF, SAM, FASTQ etc) data that can go into one vblock. By default, this is set to "TXT_DATA_PER_VB_DEFAULT" MB. Smaller values will result in faster subsetting with --regions and --grep, while larger values will result in better compression. Note that memory consumption of both genozip and genounzip is linear with the vblock value used for compression",
     "",
+    "   --seek-points     <number of lines>. (VCF, SAM, 23andMe, GFF3) Add a seek point every this number of lines of each vblock. With seek points, genocat --regions decompresses only the parts of a vblock that include the requested regions, rather than the entire vblock. Useful for files that are queried for small regions. This increases the file size slightly - more so for smaller numbers",
+    "",
+    "   --zstd            <level>[:<section types>]. Compress sections with zstd at this level (1 to 22, or negative for even faster compression) instead of bzip2 and lzma. Optionally, followed by a comma-separated list of the section types (as shown by --show-headers) to which this applies, for example --zstd 3:b250,local - and this option may be repeated with different levels for different section types. Files compressed with zstd decompress considerably faster, and are typically somewhat larger",
+    "",
+    "   --codec-policy    <ratio|speed>. Choose the compression algorithm of each field separately, by trying bzip2, lzma, zstd, rANS and no compression on the data of the first vblock in which the field appears. ratio - use the algorithm that compresses the field best ; speed - use the algorithm that decompresses fastest, unless its compression is more than 10% worse than the best. By default, each field uses a fixed algorithm. --zstd takes precedence over this option",
+    "",
+    "   --rans            Compress the dictionary indices of each field, and fields that are integers, with an rANS entropy coder instead of bzip2 and lzma, where this compresses them smaller. Files compressed with rANS decompress faster. --zstd and --codec-policy take precedence over this option",
+    "",
+    "   --seg-shards      <number between 1 and 16>. (FASTQ only) Split each vblock into this number of line ranges, segmented concurrently by the compute threads. Dictionary words may be ordered differently, so the compressed file may differ slightly from the one created without this option. Useful for large vblocks when there are more cores than vblocks being compressed concurrently",
+    "",
     "   --register        Register (or re-register) a non-commericial license to use genozip",
 
 #if !defined _WIN32 && !defined __APPLE__ // not relevant for personal computers
@@ -208,6 +220,8 @@ static const char *help_genounzip[] = {
 #if !defined _WIN32 && !defined __APPLE__ // not relevant for personal computers
     "                     Tip: if you are concerned about sharing the computer with other users, rather than using --threads to reduce the number of threads, a better option would be to use the command nice, e.g. 'nice genozip....'. This yields CPU to other users if needed, but still uses all the cores that are available",
 #endif
+    "",
+    "   --vblocks-in-flight <number>. The maximum number of vblocks being decompressed or waiting to be written at any time. By default, this is the number of threads plus 2. Each vblock in flight consumes memory, so memory consumption is linear with this value",
     "",
     "   -h --help         Show this help page. Use with -f to see developer options.",
     "",
@@ -295,6 +309,8 @@ static const char *help_genocat[] = {
 #if !defined _WIN32 && !defined __APPLE__ // not relevant for personal computers
     "                     Tip: if you're concerned about sharing the computer with other users, rather than using --threads to reduce the number of threads, a better option would be to use the command nice, e.g. 'nice genozip....'. This yields CPU to other users if needed, but still uses all the cores that are available",
 #endif
+    "",
+    "   --vblocks-in-flight <number>. The maximum number of vblocks being decompressed or waiting to be written at any time. By default, this is the number of threads plus 2. Each vblock in flight consumes memory, so memory consumption is linear with this value",
     "",
     "   -q --quiet        Don't show warnings",    
     "",
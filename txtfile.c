@@ -15,17 +15,24 @@
 #include "txtfile.h"
 #include "vblock.h"
 #include "vcf.h"
+#include "sam.h"
 #include "zfile.h"
 #include "file.h"
 #include "compressor.h"
 #include "strings.h"
 #include "endianness.h"
 #include "crypt.h"
+#include "bgzf.h"
 #include "zlib/zlib.h"
 
 static bool is_first_txt = true; 
 static uint32_t last_txt_header_len = 0;
 
+// ZIP: data of BGZF VBs is md5-ed by the compute threads, in the order the VBs were read (BAM and BCF VBs: always - also to set their position in the txt file)
+static pthread_mutex_t bgzf_md5_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bgzf_md5_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t bgzf_vbs_read = 0, bgzf_vbs_md5ed = 0;
+
 uint32_t txtfile_get_last_header_len(void) { return last_txt_header_len; }
 
 static void txtfile_update_md5 (const char *data, uint32_t len, bool is_2ndplus_txt_header)
@@ -82,6 +89,21 @@ static uint32_t txtfile_read_block (char *data, uint32_t max_bytes)
         if (bytes_read)
             txt_file->disk_so_far = gzconsumed64 ((gzFile)txt_file->file); 
     }
+    else if (txt_file->comp_alg == COMP_BGZ) {
+        // one block at a time - used for the txt header (VB data is read by txtfile_read_vblock_bgzf)
+        static Buffer bgzf_data = EMPTY_BUFFER;
+        ASSERT (max_bytes >= BGZF_MAX_BLOCK_SIZE, "Error in txtfile_read_block: max_bytes=%u is too small for a BGZF block", max_bytes);
+
+        BgzfBlock block = { .txt_size = 0 };
+        bgzf_data.len = 0;
+        while (!block.txt_size && bgzf_read_block (evb, (FILE *)txt_file->file, &bgzf_data, &block)); // skip empty blocks
+
+        if (block.txt_size) {
+            block.txt_index = 0;
+            bgzf_uncompress_one_block (bgzf_data.data, &block, data);
+            bytes_read = block.txt_size;
+        }
+    }
     else if (txt_file->comp_alg == COMP_BZ2) { 
         bytes_read = BZ2_bzread ((BZFILE *)txt_file->file, data, max_bytes);
 
@@ -107,6 +129,18 @@ void txtfile_read_header (bool is_first_txt, bool header_required,
     int32_t bytes_read;
     char prev_char='\n';
 
+    // BAM and BCF: the header is binary - we convert it to a SAM or VCF header 
+    if (file_has_bgzf_records (txt_file)) {
+        if (txt_file->comp_alg == COMP_BAM) sam_bam_read_header (&evb->txt_data);
+        else                                vcf_bcf_read_header (&evb->txt_data);
+
+        for (uint32_t i=0; i < evb->txt_data.len; i++)
+            if (evb->txt_data.data[i] == '\n') evb->lines.len++;
+
+        txt_file->txt_data_so_far_single += evb->txt_data.len;
+        goto finish;
+    }
+
     // read data from the file until either 1. EOF is reached 2. end of txt header is reached
     while (1) { 
 
@@ -186,6 +220,134 @@ static inline bool txtfile_fastq_is_end_of_line (VBlock *vb,
 }
 
 // ZIP
+// index all newlines in txt_data - so that seg knows the exact number of lines, and can split the VB by line ranges
+static void txtfile_index_lines (VBlock *vb)
+{
+    // first pass: count, so that txt_line_ends is allocated exactly once
+    uint32_t num_lines = 0;
+    const char *next = vb->txt_data.data, *after = vb->txt_data.data + vb->txt_data.len;
+    while (next < after && (next = memchr (next, '\n', after - next))) { // memchr is vectorized
+        num_lines++;
+        next++;
+    }
+
+    buf_alloc (vb, &vb->txt_line_ends, num_lines * sizeof (uint32_t), 1, "txt_line_ends", vb->vblock_i);
+    vb->txt_line_ends.len = 0;
+
+    next = vb->txt_data.data;
+    while (next < after && (next = memchr (next, '\n', after - next))) {
+        NEXTENT (uint32_t, vb->txt_line_ends) = next - vb->txt_data.data;
+        next++;
+    }
+}
+
+// ZIP I/O thread: read the BGZF blocks of a VB, and lay out their uncompressed data in txt_data following the data 
+// unconsumed by the previous VB. We uncompress only the final blocks, so we can find the last complete line - the compute 
+// thread uncompresses the rest (in txtfile_bgzf_uncompress_vb). Returns the start of uncompressed data in txt_data.
+// BAM and BCF: the blocks contain binary records, that are converted to txt by the compute thread - we just read the blocks
+static uint32_t txtfile_read_vblock_bgzf (VBlock *vb)
+{
+    START_TIMER;
+
+    vb->bgzf_data.len = vb->bgzf_blocks.len = 0;
+
+    // BAM and BCF: we read less, so that the txt generated from the binary data fits in the VB
+    bool has_records = file_has_bgzf_records (txt_file);
+    uint64_t max_len = has_records ? BGZF_RECORDS_PER_VB : global_max_memory_per_vb;
+    uint64_t len     = has_records ? 0 : vb->txt_data.len;
+
+    bool is_eof = false;
+    while (len + BGZF_MAX_BLOCK_SIZE <= max_len) {
+        BgzfBlock block;
+        if (!bgzf_read_block (vb, (FILE *)txt_file->file, &vb->bgzf_data, &block)) { is_eof = true; break; }
+        if (!block.txt_size) continue; // an empty block - eg the EOF marker block
+
+        block.txt_index = len;
+
+        buf_alloc (vb, &vb->bgzf_blocks, (vb->bgzf_blocks.len + 1) * sizeof (BgzfBlock), 2, "bgzf_blocks", vb->vblock_i);
+        NEXTENT (BgzfBlock, vb->bgzf_blocks) = block;
+
+        len += block.txt_size;
+    }
+
+    COPY_TIMER (evb->profile.read);
+
+    if (has_records) {
+        // case: all the records are in the BGZF block of the header - we need a VB to convert them, so we give it an empty block
+        if (bgzf_take_header_carry() && !vb->bgzf_blocks.len) {
+            buf_alloc (vb, &vb->bgzf_blocks, sizeof (BgzfBlock), 1, "bgzf_blocks", vb->vblock_i);
+            NEXTENT (BgzfBlock, vb->bgzf_blocks) = (BgzfBlock){ .is_uncompressed = true };
+        }
+
+        return 0; // txt_data is generated by the compute thread
+    }
+
+    vb->txt_data.len = len;
+
+    // uncompress blocks from the end, until we have enough lines to identify the last complete line (a FASTQ line is 4 text lines) 
+    int32_t block_i;
+    uint32_t num_newlines = 0;
+    for (block_i = (int32_t)vb->bgzf_blocks.len - 1; block_i >= 0 && num_newlines < 8; block_i--) {
+        BgzfBlock *block = ENT (BgzfBlock, vb->bgzf_blocks, block_i);
+        bgzf_uncompress_one_block (vb->bgzf_data.data, block, vb->txt_data.data);
+
+        const char *next = &vb->txt_data.data[block->txt_index], *after = next + block->txt_size;
+        while (next < after && (next = memchr (next, '\n', after - next))) {
+            num_newlines++;
+            next++;
+        }
+    }
+
+    ASSERT (!is_eof || !vb->txt_data.len || vb->txt_data.data[vb->txt_data.len-1] == '\n', "Error: invalid input file %s - expecting it to end with a newline", txt_name);
+
+    // if all blocks are uncompressed, all txt_data is available (the data unconsumed by the previous VB is not compressed)
+    return (block_i >= 0) ? ENT (BgzfBlock, vb->bgzf_blocks, block_i + 1)->txt_index : 0;
+}
+
+// ZIP compute thread: complete the reading of a VB of a BGZF file - uncompress the blocks the I/O thread left compressed,  
+// (BAM and BCF: and convert the records to txt) and do what the I/O thread does for other VBs after reading them: md5 and indexing the lines
+void txtfile_bgzf_uncompress_vb (VBlock *vb)
+{
+    bool has_records = file_has_bgzf_records (txt_file);
+
+    if (txt_file->comp_alg == COMP_BAM) 
+        sam_bam_uncompress_vb (vb);
+    else if (txt_file->comp_alg == COMP_BCF) 
+        vcf_bcf_uncompress_vb (vb);
+    else
+        bgzf_uncompress_vb (vb, vb->txt_data.data);
+
+    if (flag_md5 || has_records) {
+        // wait for our turn - the md5 is of the data in the order of the file
+        pthread_mutex_lock (&bgzf_md5_mutex);
+        while (bgzf_vbs_md5ed != vb->bgzf_seq)
+            pthread_cond_wait (&bgzf_md5_cond, &bgzf_md5_mutex);
+        pthread_mutex_unlock (&bgzf_md5_mutex);
+
+        // BAM and BCF: only now we know the size of our txt
+        if (has_records) {
+            vb->vb_position_txt_file = txt_file->txt_data_so_far_single;
+            txt_file->txt_data_so_far_single += vb->txt_data.len;
+            vb->vb_data_size = vb->txt_data.len; 
+
+            txtfile_update_md5 (vb->txt_data.data, vb->txt_data.len, false);
+        }
+
+        // md5 the data of our blocks, including the final partial line that was moved to the next VB
+        else if (vb->bgzf_blocks.len) {
+            const BgzfBlock *first = FIRSTENT (BgzfBlock, vb->bgzf_blocks), *last = LASTENT (BgzfBlock, vb->bgzf_blocks);
+            txtfile_update_md5 (&vb->txt_data.data[first->txt_index], last->txt_index + last->txt_size - first->txt_index, false);
+        }
+
+        pthread_mutex_lock (&bgzf_md5_mutex);
+        bgzf_vbs_md5ed++;
+        pthread_cond_broadcast (&bgzf_md5_cond);
+        pthread_mutex_unlock (&bgzf_md5_mutex);
+    }
+
+    txtfile_index_lines (vb);
+}
+
 void txtfile_read_vblock (VBlock *vb) 
 {
     START_TIMER;
@@ -202,8 +364,11 @@ void txtfile_read_vblock (VBlock *vb)
         buf_free (&txt_file->unconsumed_txt);
     }
 
+    bool is_bgzf = (txt_file->comp_alg == COMP_BGZ || file_has_bgzf_records (txt_file));
+    uint32_t first_i = is_bgzf ? txtfile_read_vblock_bgzf (vb) : 0; // txt_data before first_i is still compressed
+
     // read data from the file until either 1. EOF is reached 2. end of block is reached
-    while (vb->txt_data.len < global_max_memory_per_vb) {  // make sure there's at least READ_BUFFER_SIZE space available
+    while (!is_bgzf && vb->txt_data.len < global_max_memory_per_vb) {  // make sure there's at least READ_BUFFER_SIZE space available
 
         uint32_t bytes_one_read = txtfile_read_block (&vb->txt_data.data[vb->txt_data.len], 
                                                       MIN (READ_BUFFER_SIZE, global_max_memory_per_vb - vb->txt_data.len));
@@ -222,7 +387,7 @@ void txtfile_read_vblock (VBlock *vb)
     }
 
     // drop the final partial line which we will move to the next vb
-    for (int32_t i=vb->txt_data.len-1; i >= 0; i--) {
+    for (int32_t i=vb->txt_data.len-1; i >= (int32_t)first_i; i--) {
 
         if (vb->txt_data.data[i] == '\n') {
 
@@ -243,10 +408,19 @@ void txtfile_read_vblock (VBlock *vb)
         }
     }
 
-    vb->vb_position_txt_file = txt_file->txt_data_so_far_single;
+    if (!is_bgzf) 
+        txtfile_index_lines (vb);
+    
+    else if ((flag_md5 && vb->txt_data.len) || vb->bgzf_blocks.len)
+        vb->bgzf_seq = bgzf_vbs_read++; // VB will be md5-ed (BAM and BCF: also split into records) by its compute thread (VBs without data are not computed)
+
+    // BAM and BCF: set by the compute thread, after converting the data to txt
+    if (!file_has_bgzf_records (txt_file)) {
+        vb->vb_position_txt_file = txt_file->txt_data_so_far_single;
 
-    txt_file->txt_data_so_far_single += vb->txt_data.len;
-    vb->vb_data_size = vb->txt_data.len; // initial value. it may change if --optimize is used.
+        txt_file->txt_data_so_far_single += vb->txt_data.len;
+        vb->vb_data_size = vb->txt_data.len; // initial value. it may change if --optimize is used.
+    }
     
     if (file_is_read_via_int_decompressor (txt_file))
         vb->vb_data_read_size = file_tell (txt_file) - pos_before; // gz/bz2 compressed bytes read
@@ -292,7 +466,8 @@ void txtfile_write_one_vblock (VBlockP vb)
     COPY_TIMER (vb->profile.write);
 }
 
-// ZIP only - estimate the size of the txt data in this file. affects the hash table size and the progress indicator.
+// ZIP I/O thread - estimate the size of the txt data in this file from VB 1, after it is read and before it is dispatched, 
+// so we can't use anything found by seg. affects the hash table size and the progress indicator.
 void txtfile_estimate_txt_data_size (VBlock *vb)
 {
     uint64_t disk_size = txt_file->disk_size; 
@@ -305,24 +480,22 @@ void txtfile_estimate_txt_data_size (VBlock *vb)
     
     double ratio=1;
 
-    bool is_no_ht_vcf = (txt_file->data_type == DT_VCF && vcf_vb_has_haplotype_data(vb));
+    bool is_no_ht_vcf = (txt_file->data_type == DT_VCF && global_vcf_num_samples > 0); // from the VCF header, as VB 1 is not segged yet
 
     switch (txt_file->comp_alg) {
         // if we decomprssed gz/bz2 data directly - we extrapolate from the observed compression ratio
         case COMP_GZ:
+        case COMP_BGZ:
         case COMP_BZ2: ratio = (double)vb->vb_data_size / (double)vb->vb_data_read_size; break;
 
         // for compressed files for which we don't have their size (eg streaming from an http server) - we use
         // estimates based on a benchmark compression ratio of files with and without genotype data
 
-        // note: .bcf files might be compressed or uncompressed - we have no way of knowing as 
-        // "bcftools view" always serves them to us in plain VCF format. These ratios are assuming
-        // the bcf is compressed as it normally is.
-        case COMP_BCF: ratio = is_no_ht_vcf ? 55 : 8.5; break;
-
         case COMP_XZ:  ratio = is_no_ht_vcf ? 171 : 12.7; break;
 
-        case COMP_BAM: ratio = 4; break;
+        // BAM and BCF: the I/O thread doesn't know the size of the txt yet - we use a benchmark ratio
+        case COMP_BCF: ratio = vb->vb_data_size ? (double)vb->vb_data_size / (double)vb->vb_data_read_size : (is_no_ht_vcf ? 55 : 8.5); break;
+        case COMP_BAM: ratio = vb->vb_data_size ? (double)vb->vb_data_size / (double)vb->vb_data_read_size : 4; break;
 
         case COMP_ZIP: ratio = 3; break;
 
@@ -346,6 +519,7 @@ void txtfile_header_initialize(void)
 bool txtfile_header_to_genozip (uint32_t *txt_line_i)
 {    
     z_file->disk_at_beginning_of_this_txt_file = z_file->disk_so_far;
+    bgzf_vbs_read = bgzf_vbs_md5ed = 0; // all VBs of the previous file are done
 
     if (DTPT(txt_header_required) == HDR_MUST || DTPT(txt_header_required) == HDR_OK)
         txtfile_read_header (is_first_txt, DTPT(txt_header_required) == HDR_MUST, DTPT(txt_header_1st_char)); // reads into evb->txt_data and evb->lines.len
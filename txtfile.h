@@ -11,6 +11,7 @@
 
 extern void txtfile_read_header (bool is_first_txt, bool header_required, char first_char);
 extern void txtfile_read_vblock (VBlockP vb);
+extern void txtfile_bgzf_uncompress_vb (VBlockP vb);
 extern unsigned txtfile_write_to_disk (ConstBufferP buf);
 extern void txtfile_estimate_txt_data_size (VBlockP vb);
 extern void txtfile_write_one_vblock (VBlockP vb);
@@ -28,19 +28,30 @@ void vb_release_vb (VBlock *vb)
     vb->z_next_header_i = 0;
     vb->num_dict_ids = 0;
     vb->chrom_node_index = vb->seq_len = 0; 
+    vb->seek_points_header_offset = vb->next_seek_point = 0;
     vb->vb_position_txt_file = 0;
     vb->num_lines_at_1_3 = vb->num_lines_at_2_3 = 0;
     vb->dont_show_curr_line = false;    
     vb->num_type1_subfields = vb->num_type2_subfields = 0;
+    vb->bgzf_seq = 0;
+    vb->zstd_level = 0;
     
     memset(&vb->profile, 0, sizeof (vb->profile));
     memset(vb->dict_id_to_did_i_map, 0, sizeof(vb->dict_id_to_did_i_map));
 
     buf_free(&vb->lines);
     buf_free(&vb->ra_buf);
+    buf_free(&vb->seek_points);
+    buf_free(&vb->seek_ctxs);
     buf_free(&vb->compressed);
+    buf_free(&vb->dict_frag);
     buf_free(&vb->txt_data);
     buf_free(&vb->txt_data_spillover);
+    buf_free(&vb->txt_line_ends);
+    buf_free(&vb->sep_index);
+    buf_free(&vb->bgzf_data);
+    buf_free(&vb->bgzf_blocks);
+    buf_free(&vb->bgzf_records);
     buf_free(&vb->z_data);
     buf_free(&vb->z_section_headers);
     buf_free(&vb->spiced_pw);
@@ -66,6 +77,7 @@ void vb_release_vb (VBlock *vb)
     // vb->num_lines_alloced
     // vb->buffer_list : we DON'T free this because the buffers listed are still available and going to be re-used/
     //                   we have logic in vb_get_vb() to update its vb_i
+    // vb->seg_shards : shard VBs (released by seg after merging them), along with their buffers
     // vb->num_sample_blocks : we keep this value as it is needed by vb_cleanup_memory, and it doesn't change
     //                         between VBs of a file or concatenated files.
     // vb->data_type : type of this vb 
@@ -76,9 +88,17 @@ void vb_destroy_vb (VBlockP *vb_p)
     VBlockP vb = *vb_p;
 
     buf_destroy (&vb->ra_buf);
+    buf_destroy (&vb->seek_points);
+    buf_destroy (&vb->seek_ctxs);
     buf_destroy (&vb->compressed);
+    buf_destroy (&vb->dict_frag);
     buf_destroy (&vb->txt_data);
     buf_destroy (&vb->txt_data_spillover);
+    buf_destroy (&vb->txt_line_ends);
+    buf_destroy (&vb->sep_index);
+    buf_destroy (&vb->bgzf_data);
+    buf_destroy (&vb->bgzf_blocks);
+    buf_destroy (&vb->bgzf_records);
     buf_destroy (&vb->z_data);
     buf_destroy (&vb->z_section_headers);
     buf_destroy (&vb->spiced_pw);
@@ -94,6 +114,9 @@ void vb_destroy_vb (VBlockP *vb_p)
     for (unsigned i=0; i < NUM_COMPRESS_BUFS; i++)
         buf_destroy (&vb->compress_bufs[i]);
 
+    for (unsigned i=0; i < MAX_SEG_SHARDS; i++)
+        if (vb->seg_shards[i]) vb_destroy_vb (&vb->seg_shards[i]);
+
     // destory data_type -specific buffers
     if (vb->data_type != DT_NONE && DTP(destroy_vb))
         DTP(destroy_vb)(vb);
@@ -24,6 +24,8 @@ typedef struct SubfieldMapper {
 
 #define NUM_COMPRESS_BUFS 7   // bzlib2 compress requires 4 and decompress requires 2 ; lzma compress requires 7 and decompress 1
 
+#define MAX_SEG_SHARDS 16     // maximum value of --seg-shards
+
 typedef enum { GS_READ, GS_TEST, GS_UNCOMPRESS } GrepStages;
 
 // IMPORTANT: if changing fields in VBlockVCF, also update vb_release_vb
@@ -60,6 +62,10 @@ typedef enum { GS_READ, GS_TEST, GS_UNCOMPRESS } GrepStages;
     Buffer ra_buf;             /* ZIP only: array of RAEntry - copied to z_file at the end of each vb compression, then written as a SEC_RANDOM_ACCESS section at the end of the genozip file */\
     int32_t chrom_node_index;  /* ZIP and PIZ: index into ra_buf:ZIP: used by random_access_update_chrom/random_access_update_pos to sync between them, PIZ: store the chrom when it is encountered */\
     uint32_t seq_len;          /* PIZ only - last calculated seq_len (as defined by each data_type) */\
+    Buffer seek_points;        /* ZIP: seek points added every --seek-points lines PIZ: data of the SEC_SEEK_POINTS section of this VB (with --regions) */\
+    Buffer seek_ctxs;          /* ZIP only: the state of each context at each seek point */\
+    uint32_t seek_points_header_offset; /* PIZ only: offset of the SEC_SEEK_POINTS section header in z_data, 0 if the VB has no seek points */\
+    uint32_t next_seek_point;  /* PIZ only: byte offset into seek_points of the next seek point to be reached */\
     \
     /* regions & filters */ \
     Buffer region_ra_intersection_matrix;  /* PIZ: a byte matrix - each row represents an ra in this vb, and each column is a region specieid in the command. the cell contains 1 if this ra intersects with this region */\
@@ -76,12 +82,21 @@ typedef enum { GS_READ, GS_TEST, GS_UNCOMPRESS } GrepStages;
     Buffer txt_data;                  /* ZIP only: txt_data as read from disk - either the VCF header (in evb) or the VB data lines */\
     uint32_t txt_data_next_offset;    /* we re-use txt_data memory to overlay stuff in segregate */\
     Buffer txt_data_spillover;        /* when re-using txt_data, if it is too small, we spill over to this buffer */\
+    Buffer txt_line_ends;             /* ZIP only: uint32_t offsets of all the newlines in txt_data, indexed when the VB is read */\
+    Buffer sep_index;                 /* ZIP only: during seg - bitmaps of the tab/newline and colon positions in txt_data */\
+    VBlockP seg_shards[MAX_SEG_SHARDS]; /* ZIP only: VBs that seg line ranges of this VB concurrently (--seg-shards), merged into this VB after seg */\
+    Buffer bgzf_data;                 /* ZIP only: deflate data of the BGZF blocks of this VB, if txt_file is BGZF */\
+    Buffer bgzf_blocks;               /* ZIP only: array of BgzfBlock - the BGZF blocks of this VB, uncompressed into txt_data by the compute thread */\
+    Buffer bgzf_records;              /* ZIP only: BAM and BCF - the uncompressed binary records of this VB, converted to txt_data by the compute thread */\
+    uint32_t bgzf_seq;                /* ZIP only: BGZF VBs are md5-ed (and BAM VBs split into records) by their compute threads, in this order */\
     \
     int16_t z_next_header_i;          /* next header of this VB to be encrypted or decrypted */\
     \
     Buffer z_section_headers;         /* PIZ only: an array of unsigned offsets of section headers within z_data */\
     \
     Buffer compressed;                /* used by various zfile functions */\
+    int zstd_level;                   /* ZIP only: level of the section currently being compressed with zstd (--zstd) */\
+    Buffer dict_frag;                 /* ZIP: copy of the dictionary fragment this VB added to a zf_ctx, compressed outside of zf_ctx->mutex. PIZ: dictionary fragment being integrated */\
     \
     /* dictionaries stuff - we use them for 1. subfields with genotype data, 2. fields 1-9 of the VCF file 3. infos within the info field */\
     uint32_t num_dict_ids;            /* total number of dictionaries of all types */\
@@ -29,6 +29,10 @@ extern bool vcf_piz_is_skip_section (VBlockP vb, SectionType st, DictIdType dict
 extern void vcf_zfile_compress_vb_header (VBlockP vb);
 extern void vcf_zfile_update_compressed_vb_header (VBlockP vb, uint32_t vcf_first_line_i);
 
+// BCF stuff
+extern void vcf_bcf_read_header (BufferP txt_header);
+extern void vcf_bcf_uncompress_vb (VBlockP vb);
+
 // VCF Header stuff
 extern void vcf_header_initialize (void);
 extern bool vcf_header_set_globals (const char *filename, BufferP vcf_header);
@@ -41,7 +45,6 @@ extern void vcf_vb_destroy_vb();
 extern void vcf_vb_cleanup_memory();
 extern unsigned vcf_vb_size (void);
 extern unsigned vcf_vb_zip_dl_size (void);
-extern bool vcf_vb_has_haplotype_data (VBlockP vb);
 
 // Samples stuff
 extern void vcf_samples_add  (const char *samples_str);
@@ -0,0 +1,415 @@
+// ------------------------------------------------------------------
+//   vcf_bcf.c
+//   Copyright (C) 2020 Divon Lan <divon@genozip.com>
+//   Please see terms and conditions in the files LICENSE.non-commercial.txt and LICENSE.commercial.txt
+
+// ZIP of BCF files, without bcftools. A BCF file is BGZF-compressed, and contains the VCF header text followed by binary
+// variant records, see: https://samtools.github.io/hts-specs/VCFv4.3.pdf section 6
+// The I/O thread reads the header, and reads the (still compressed) BGZF blocks of each VB. The compute thread uncompresses
+// the blocks, and converts the records to VCF lines in txt_data (see bgzf_records_to_txt) - the same text "bcftools view"
+// would produce - which are then segged like any other VCF data.
+
+#include "vcf_private.h"
+#include "bgzf.h"
+#include "file.h"
+#include "strings.h"
+
+#define LE16(p) ((uint32_t)((uint8_t*)(p))[0] | ((uint32_t)((uint8_t*)(p))[1] << 8))
+#define LE32(p) (LE16(p) | ((uint32_t)((uint8_t*)(p))[2] << 16) | ((uint32_t)((uint8_t*)(p))[3] << 24))
+
+// types of typed values
+#define BCF_BT_NULL  0
+#define BCF_BT_INT8  1
+#define BCF_BT_INT16 2
+#define BCF_BT_INT32 3
+#define BCF_BT_FLOAT 5
+#define BCF_BT_CHAR  7
+
+static const unsigned bcf_type_size[16] = { [BCF_BT_INT8]=1, [BCF_BT_INT16]=2, [BCF_BT_INT32]=4, [BCF_BT_FLOAT]=4, [BCF_BT_CHAR]=1 };
+
+#define BCF_FLOAT_MISSING    0x7F800001
+#define BCF_FLOAT_VECTOR_END 0x7F800002
+#define BCF_STR_MISSING      0x07
+
+// the dictionaries of the file, from the header: strings (FILTER, INFO and FORMAT IDs) and contigs. records refer to them by index
+typedef struct { Buffer names, index; uint32_t max_len; } BcfDict; // index: array of uint32_t - index into names of each nul-terminated name
+static BcfDict bcf_strings = { EMPTY_BUFFER, EMPTY_BUFFER, 0 }, bcf_contigs = { EMPTY_BUFFER, EMPTY_BUFFER, 0 };
+static int32_t bcf_gt_key = -1;
+
+#define BCF_NO_NAME ((uint32_t)-1)
+
+static void vcf_bcf_dict_set (BcfDict *dict, uint32_t idx, const char *name, unsigned name_len)
+{
+    if (idx >= dict->index.len) {
+        buf_alloc (evb, &dict->index, (idx + 1) * sizeof (uint32_t), 2, "bcf_dict_index", 0);
+        while (dict->index.len <= idx) NEXTENT (uint32_t, dict->index) = BCF_NO_NAME;
+    }
+
+    *ENT (uint32_t, dict->index, idx) = dict->names.len;
+
+    buf_alloc (evb, &dict->names, dict->names.len + name_len + 1, 2, "bcf_dict_names", 0);
+    buf_add (&dict->names, name, name_len);
+    NEXTENT (char, dict->names) = 0;
+
+    dict->max_len = MAX (dict->max_len, name_len);
+}
+
+static int32_t vcf_bcf_dict_find (const BcfDict *dict, const char *name, unsigned name_len)
+{
+    for (uint32_t i=0; i < dict->index.len; i++) {
+        uint32_t offset = *ENT (uint32_t, dict->index, i);
+        if (offset != BCF_NO_NAME && !strncmp (ENT (char, dict->names, offset), name, name_len) && !dict->names.data[offset + name_len])
+            return i;
+    }
+    return -1;
+}
+
+static inline const char *vcf_bcf_dict_name (const BcfDict *dict, int32_t idx)
+{
+    ASSERT (idx >= 0 && idx < (int32_t)dict->index.len && *ENT (uint32_t, dict->index, idx) != BCF_NO_NAME,
+            "Error: BCF record in %s refers to a %s with IDX=%d, which is not defined in the header",
+            txt_name, dict == &bcf_contigs ? "contig" : "FILTER, INFO or FORMAT", idx);
+
+    return ENT (char, dict->names, *ENT (uint32_t, dict->index, idx));
+}
+
+// adds the ID of a structured header line (eg ##INFO=<ID=DP,...>) to the dictionary - at its IDX if specified, or otherwise
+// at the end, unless it is already there (eg an ID that is both INFO and FORMAT)
+static void vcf_bcf_add_header_line (BcfDict *dict, const char *line, const char *after)
+{
+    const char *gt = memchr (line, '>', after - line);
+    if (gt) after = gt;
+
+    const char *id = NULL, *idx = NULL;
+    for (const char *c = line; c + 4 < after; c++)
+        if (c[0] == '<' || c[0] == ',') {
+            if (!memcmp (&c[1], "ID=", 3))  id  = &c[4];
+            if (c + 5 < after && !memcmp (&c[1], "IDX=", 4)) idx = &c[5];
+        }
+
+    if (!id) return;
+
+    unsigned id_len = 0;
+    while (&id[id_len] < after && id[id_len] != ',') id_len++;
+
+    if (idx)
+        vcf_bcf_dict_set (dict, atoi (idx), id, id_len);
+    else if (dict == &bcf_contigs || vcf_bcf_dict_find (dict, id, id_len) < 0)
+        vcf_bcf_dict_set (dict, dict->index.len, id, id_len);
+}
+
+// ZIP I/O thread: reads the BCF header - the VCF header text, and builds the dictionaries from it
+void vcf_bcf_read_header (Buffer *txt_header)
+{
+    static Buffer hdr = EMPTY_BUFFER;
+    hdr.len = 0;
+
+    bgzf_read_header_data (&hdr, 9);
+    ASSERT (!memcmp (hdr.data, "BCF\2", 4), "Error: %s is not a BCF file - it doesn't start with the BCF magic string", txt_name);
+
+    uint32_t l_text = LE32 (&hdr.data[5]);
+    bgzf_read_header_data (&hdr, 9 + (uint64_t)l_text);
+
+    const char *text = &hdr.data[9];
+    uint32_t text_len = strnlen (text, l_text); // the text is nul-terminated
+
+    buf_alloc (evb, txt_header, text_len + 1, 1, "txt_data", 0);
+    memcpy (txt_header->data, text, text_len);
+    txt_header->len = text_len;
+
+    if (text_len && text[text_len-1] != '\n')
+        txt_header->data[txt_header->len++] = '\n';
+
+    // dictionaries - PASS is always the first string, even if not in the header
+    bcf_strings.names.len = bcf_strings.index.len = bcf_contigs.names.len = bcf_contigs.index.len = 0;
+    bcf_strings.max_len = bcf_contigs.max_len = 1;
+    vcf_bcf_dict_set (&bcf_strings, 0, "PASS", 4);
+
+    for (const char *line = text, *after = text + text_len; line < after; ) {
+        const char *eol = memchr (line, '\n', after - line);
+        if (!eol) eol = after;
+
+        if      (eol - line > 10 && (!memcmp (line, "##FILTER=<", 10))) vcf_bcf_add_header_line (&bcf_strings, line, eol);
+        else if (eol - line > 8  && (!memcmp (line, "##INFO=<",    8))) vcf_bcf_add_header_line (&bcf_strings, line, eol);
+        else if (eol - line > 10 && (!memcmp (line, "##FORMAT=<", 10))) vcf_bcf_add_header_line (&bcf_strings, line, eol);
+        else if (eol - line > 10 && (!memcmp (line, "##contig=<", 10))) vcf_bcf_add_header_line (&bcf_contigs, line, eol);
+
+        line = eol + 1;
+    }
+
+    bcf_gt_key = vcf_bcf_dict_find (&bcf_strings, "GT", 2);
+
+    // the remaining data is the beginning of the first records
+    bgzf_set_header_carry (&hdr, 9 + (uint64_t)l_text);
+}
+
+static inline int32_t vcf_bcf_get_int (uint8_t type, const uint8_t *p)
+{
+    switch (type) {
+        case BCF_BT_INT8 : return (int8_t)p[0];
+        case BCF_BT_INT16: return (int16_t)LE16 (p);
+        case BCF_BT_INT32: return (int32_t)LE32 (p);
+        default          : ABORT ("Error: invalid integer type %u in BCF record of %s", type, txt_name); return 0;
+    }
+}
+
+// the missing and vector-end values of each integer type
+static inline int32_t vcf_bcf_int_missing (uint8_t type) { return type == BCF_BT_INT8 ? INT8_MIN : type == BCF_BT_INT16 ? INT16_MIN : INT32_MIN; }
+
+// reads the type and count of a typed value, returns the position of its data
+static inline const uint8_t *vcf_bcf_get_typed (const uint8_t *p, const uint8_t *after, uint8_t *type, uint32_t *count)
+{
+    ASSERT (p < after, "Error: BCF record in %s is truncated", txt_name);
+
+    *type  = *p & 0xf;
+    *count = *p >> 4;
+    p++;
+
+    ASSERT (*type == BCF_BT_NULL || bcf_type_size[*type], "Error: invalid type %u in BCF record of %s", *type, txt_name);
+
+    if (*count == 15) { // a larger count follows, as a typed integer
+        uint8_t count_type = *p & 0xf;
+        ASSERT (count_type >= BCF_BT_INT8 && count_type <= BCF_BT_INT32, "Error: invalid count type %u in BCF record of %s", count_type, txt_name);
+
+        *count = vcf_bcf_get_int (count_type, p + 1);
+        p += 1 + bcf_type_size[count_type];
+    }
+
+    ASSERT (p + (uint64_t)*count * bcf_type_size[*type] <= after, "Error: BCF record in %s is truncated", txt_name);
+    return p;
+}
+
+// reads a typed integer - eg a key in the dictionary
+static inline const uint8_t *vcf_bcf_get_typed_int (const uint8_t *p, const uint8_t *after, int32_t *value)
+{
+    uint8_t type;
+    uint32_t count;
+    p = vcf_bcf_get_typed (p, after, &type, &count);
+    ASSERT (count == 1, "Error: expecting a single integer in BCF record of %s", txt_name);
+
+    *value = vcf_bcf_get_int (type, p);
+    return p + bcf_type_size[type];
+}
+
+static inline char *vcf_bcf_add_str (char *next, const char *s)
+{
+    unsigned len = strlen (s);
+    memcpy (next, s, len);
+    return next + len;
+}
+
+static inline char *vcf_bcf_add_float (char *next, uint32_t bits)
+{
+    float f;
+    memcpy (&f, &bits, sizeof (float));
+    return next + sprintf (next, "%g", f);
+}
+
+// appends the values of an array, up to the vector end. missing values are '.'
+static char *vcf_bcf_add_array (char *next, uint8_t type, uint32_t count, const uint8_t *p)
+{
+    if (type == BCF_BT_CHAR)
+        for (uint32_t i=0; i < count && p[i]; i++)
+            *next++ = (p[i] == BCF_STR_MISSING) ? '.' : p[i];
+
+    else if (type == BCF_BT_FLOAT)
+        for (uint32_t i=0; i < count; i++) {
+            uint32_t bits = LE32 (&p[i*4]);
+            if (bits == BCF_FLOAT_VECTOR_END) break;
+            if (i) *next++ = ',';
+
+            if (bits == BCF_FLOAT_MISSING) *next++ = '.';
+            else next = vcf_bcf_add_float (next, bits);
+        }
+
+    else if (type != BCF_BT_NULL) {
+        int32_t missing = vcf_bcf_int_missing (type);
+        unsigned size = bcf_type_size[type];
+
+        for (uint32_t i=0; i < count; i++) {
+            int32_t value = vcf_bcf_get_int (type, &p[i*size]);
+            if (value == missing + 1) break; // vector end
+            if (i) *next++ = ',';
+
+            if (value == missing) *next++ = '.';
+            else next += str_int (value, next);
+        }
+    }
+
+    return next;
+}
+
+// GT: each allele is (allele+1) << 1 | phased, or 0 if missing
+static char *vcf_bcf_add_gt (char *next, uint8_t type, uint32_t count, const uint8_t *p)
+{
+    int32_t vector_end = vcf_bcf_int_missing (type) + 1;
+    unsigned size = bcf_type_size[type];
+
+    uint32_t i;
+    for (i=0; i < count; i++) {
+        int32_t value = vcf_bcf_get_int (type, &p[i*size]);
+        if (value == vector_end) break;
+        if (i) *next++ = (value & 1) ? '|' : '/';
+
+        if (value >> 1) next += str_int ((value >> 1) - 1, next);
+        else            *next++ = '.';
+    }
+
+    if (!i) *next++ = '.';
+    return next;
+}
+
+// true if a FORMAT field of a sample has no values at all - as trailing fields dropped from a sample are encoded
+static inline bool vcf_bcf_is_vector_end (uint8_t type, const uint8_t *p)
+{
+    switch (type) {
+        case BCF_BT_CHAR : return !p[0];
+        case BCF_BT_FLOAT: return LE32 (p) == BCF_FLOAT_VECTOR_END;
+        case BCF_BT_NULL : return true;
+        default          : return vcf_bcf_get_int (type, p) == vcf_bcf_int_missing (type) + 1;
+    }
+}
+
+static uint32_t vcf_bcf_rec_len (const uint8_t *rec)
+{
+    return 8 + LE32 (rec) + LE32 (&rec[4]); // l_shared and l_indiv don't include themselves
+}
+
+// ensures there are at least len bytes available in txt_data after next
+#define BCF_ENSURE(len) { uint64_t txt_len = next - vb->txt_data.data;                                                  \
+                          buf_alloc (vb, &vb->txt_data, txt_len + (len), 1.5, "txt_data", vb->vblock_i);                \
+                          next = vb->txt_data.data + txt_len; }
+
+// converts one BCF record to a VCF line appended to txt_data
+static void vcf_bcf_record_to_vcf (VBlock *vb, const uint8_t *rec)
+{
+    uint32_t l_shared = LE32 (rec);
+    uint32_t l_indiv  = LE32 (&rec[4]);
+    ASSERT (l_shared >= 24, "Error: invalid BCF record in %s: l_shared=%u", txt_name, l_shared);
+
+    const uint8_t *shared = &rec[8], *after_shared = shared + l_shared;
+    const uint8_t *indiv  = after_shared, *after = indiv + l_indiv;
+
+    int32_t  chrom    = LE32 (&shared[0]);
+    int32_t  pos      = LE32 (&shared[4]);
+    uint32_t qual     = LE32 (&shared[12]);
+    uint32_t n_info   = LE32 (&shared[16]) & 0xffff;
+    uint32_t n_allele = LE32 (&shared[16]) >> 16;
+    uint32_t n_sample = LE32 (&shared[20]) & 0xffffff;
+    uint32_t n_fmt    = shared[23];
+
+    // a generous upper bound of the VCF line length: no binary value is more than 5 times longer in text, plus the names
+    char *next = AFTERENT (char, vb->txt_data);
+    BCF_ENSURE (5 * ((uint64_t)l_shared + l_indiv) + (n_info + n_fmt) * (bcf_strings.max_len + 2) + bcf_contigs.max_len + 100);
+
+    // CHROM, POS
+    next = vcf_bcf_add_str (next, vcf_bcf_dict_name (&bcf_contigs, chrom)); *next++ = '\t';
+    next += str_int ((int64_t)pos + 1, next);                                *next++ = '\t';
+
+    // ID
+    uint8_t type;
+    uint32_t count;
+    const uint8_t *p = vcf_bcf_get_typed (&shared[24], after_shared, &type, &count);
+    const char *field_start = next;
+    next = vcf_bcf_add_array (next, type, count, p);
+    if (next == field_start) *next++ = '.';
+    *next++ = '\t';
+    p += count * bcf_type_size[type];
+
+    // REF, ALT
+    for (uint32_t allele_i=0; allele_i < n_allele; allele_i++) {
+        p = vcf_bcf_get_typed (p, after_shared, &type, &count);
+        if (allele_i >= 2) *next++ = ',';
+        next = vcf_bcf_add_array (next, type, count, p);
+        if (allele_i == 0) *next++ = '\t';
+        p += count * bcf_type_size[type];
+    }
+    if (n_allele == 0) *next++ = '.', *next++ = '\t';
+    if (n_allele <= 1) *next++ = '.';
+    *next++ = '\t';
+
+    // QUAL
+    if (qual == BCF_FLOAT_MISSING) *next++ = '.';
+    else next = vcf_bcf_add_float (next, qual);
+    *next++ = '\t';
+
+    // FILTER
+    p = vcf_bcf_get_typed (p, after_shared, &type, &count);
+    BCF_ENSURE ((uint64_t)count * (bcf_strings.max_len + 1) + 2);
+    for (uint32_t i=0; i < count; i++) {
+        if (i) *next++ = ';';
+        next = vcf_bcf_add_str (next, vcf_bcf_dict_name (&bcf_strings, vcf_bcf_get_int (type, &p[i * bcf_type_size[type]])));
+    }
+    if (!count) *next++ = '.';
+    *next++ = '\t';
+    p += count * bcf_type_size[type];
+
+    // INFO
+    for (uint32_t info_i=0; info_i < n_info; info_i++) {
+        int32_t key;
+        p = vcf_bcf_get_typed_int (p, after_shared, &key);
+        p = vcf_bcf_get_typed (p, after_shared, &type, &count);
+
+        if (info_i) *next++ = ';';
+        next = vcf_bcf_add_str (next, vcf_bcf_dict_name (&bcf_strings, key));
+
+        if (count) { // not a flag
+            *next++ = '=';
+            if (count == 1 && vcf_bcf_is_vector_end (type, p) && type != BCF_BT_CHAR) *next++ = '.';
+            else next = vcf_bcf_add_array (next, type, count, p);
+        }
+        p += count * bcf_type_size[type];
+    }
+    if (!n_info) *next++ = '.';
+
+    ASSERT (p == after_shared, "Error: invalid BCF record in %s: shared data has %d unexpected bytes", txt_name, (int)(after_shared - p));
+
+    // FORMAT and samples
+    if (n_fmt) {
+        struct { int32_t key; uint8_t type; uint32_t count; const uint8_t *data; } fmts[256];
+
+        p = indiv;
+        for (uint32_t fmt_i=0; fmt_i < n_fmt; fmt_i++) {
+            p = vcf_bcf_get_typed_int (p, after, &fmts[fmt_i].key);
+            p = vcf_bcf_get_typed (p, after, &fmts[fmt_i].type, &fmts[fmt_i].count);
+            fmts[fmt_i].data = p;
+            p += (uint64_t)n_sample * fmts[fmt_i].count * bcf_type_size[fmts[fmt_i].type];
+            ASSERT (p <= after, "Error: BCF record in %s is truncated", txt_name);
+
+            *next++ = fmt_i ? ':' : '\t';
+            next = vcf_bcf_add_str (next, vcf_bcf_dict_name (&bcf_strings, fmts[fmt_i].key));
+        }
+
+        for (uint32_t sample_i=0; sample_i < n_sample; sample_i++) {
+            *next++ = '\t';
+
+            for (uint32_t fmt_i=0; fmt_i < n_fmt; fmt_i++) {
+                uint32_t size = fmts[fmt_i].count * bcf_type_size[fmts[fmt_i].type];
+                const uint8_t *data = fmts[fmt_i].data + sample_i * size;
+
+                // trailing fields dropped from this sample
+                if (!fmts[fmt_i].count || vcf_bcf_is_vector_end (fmts[fmt_i].type, data)) {
+                    if (!fmt_i) *next++ = '.';
+                    break;
+                }
+
+                if (fmt_i) *next++ = ':';
+
+                if (fmts[fmt_i].key == bcf_gt_key && fmts[fmt_i].type != BCF_BT_CHAR && fmts[fmt_i].type != BCF_BT_FLOAT)
+                    next = vcf_bcf_add_gt (next, fmts[fmt_i].type, fmts[fmt_i].count, data);
+                else
+                    next = vcf_bcf_add_array (next, fmts[fmt_i].type, fmts[fmt_i].count, data);
+            }
+        }
+    }
+
+    *next++ = '\n';
+
+    vb->txt_data.len = next - vb->txt_data.data;
+}
+
+// ZIP compute thread: uncompress the BGZF blocks of the VB, and convert the BCF records to VCF lines in txt_data
+void vcf_bcf_uncompress_vb (VBlock *vb)
+{
+    bgzf_records_to_txt (vb, 8, vcf_bcf_rec_len, vcf_bcf_record_to_vcf);
+}
@@ -199,15 +199,18 @@ static void vcf_piz_reconstruct_genotype_data_line (VBlockVCF *vb, unsigned vb_l
                     snip = min_dp;
                 }
 
-                if (snip && snip_len && is_line_included) { // it can be a valid empty subfield if snip="" and snip_len=0
+                // note: we reconstruct even if the line is not included (eg due to --regions), as the snip might consume local data
+                if (snip && snip_len) { // it can be a valid empty subfield if snip="" and snip_len=0
                 
                     // ugly hack until I get time to refactor this code - reconstruct to txt_data, copy to gt_line_data and later copy back to txt_data. yuck
                     uint64_t start = vb->txt_data.len;
                     piz_reconstruct_one_snip ((VBlockP)vb, sf_ctx, snip, snip_len);  
                     uint64_t snip_len = vb->txt_data.len - start;
-                    memcpy (next, ENT (char, vb->txt_data, start), snip_len); 
+                    if (is_line_included) {
+                        memcpy (next, ENT (char, vb->txt_data, start), snip_len); 
+                        next += snip_len;
+                    }
                     vb->txt_data.len -= snip_len;
-                    next += snip_len;
                 }
             }
 
@@ -240,6 +243,22 @@ static void vcf_piz_reconstruct_genotype_data_line (VBlockVCF *vb, unsigned vb_l
     COPY_TIMER(vb->profile.vcf_piz_reconstruct_genotype_data_line);
 }
 
+// --regions with seek points: advance the sample iterators past the genotype data of lines that are skipped
+static void vcf_piz_skip_genotype_data_lines (VBlockVCF *vb, uint32_t first_vb_line_i, uint32_t after_vb_line_i)
+{
+    ARRAY (SnipIterator, sample_iterator, vb->sample_iterator);
+    ARRAY (const SubfieldMapper, formats, piz_format_mapper_buf);
+
+    for (uint32_t vb_line_i=first_vb_line_i; vb_line_i < after_vb_line_i; vb_line_i++) {
+        
+        uint32_t num_subfields = formats[DATA_LINE (vb_line_i)->format_mtf_i].num_subfields;
+
+        for (unsigned sample_i=0; sample_i < global_vcf_num_samples; sample_i++) 
+            for (unsigned sf=0; sf < num_subfields; sf++) 
+                sample_iterator[sample_i].next_b250 += base250_len (sample_iterator[sample_i].next_b250);
+    }
+}
+
 static void vcf_piz_get_phase_data_line (VBlockVCF *vb, unsigned vb_line_i)
 {
     START_TIMER;
@@ -493,10 +512,20 @@ static void vcf_piz_reconstruct_vb (VBlockVCF *vb)
     // fields, but only those info subfields defined in the INFO names of a particular line are used in that line).
             
     // now reconstruct the lines, one line at a time
-    for (unsigned vb_line_i=0; vb_line_i < vb->lines.len; vb_line_i++) {
+    for (uint32_t vb_line_i=0; vb_line_i < vb->lines.len; vb_line_i++) {
+
+        // --regions: skip segments of the VB that include no region, if the file has seek points
+        if (vb->seek_points.len) {
+            uint32_t first_skipped_line_i = vb_line_i;
+            if (!random_access_seek_to_included_line ((VBlockP)vb, &vb_line_i)) break;
+            
+            if (vb_line_i > first_skipped_line_i && vb->has_genotype_data && !flag_drop_genotypes && !flag_gt_only)
+                vcf_piz_skip_genotype_data_lines (vb, first_skipped_line_i, vb_line_i);
+        }
 
         vb->line_i = vb->first_line + vb_line_i;
         uint64_t txt_data_start = vb->txt_data.len;
+        vb->dont_show_curr_line = false; // might become true due --regions
 
         // re-construct fields CHROM to FORMAT, including INFO subfields into vb->txt_data
         piz_reconstruct_from_ctx (vb, VCF_CHROM,  '\t');
@@ -705,6 +734,12 @@ void vcf_piz_uncompress_vb (VBlockVCFP vb)
 }
 
 
+// free the mapper, so that the next file maps its own FORMAT dictionary, even if its VB=1 is not read
+void vcf_piz_free_format_mapper (void)
+{
+    buf_free (&piz_format_mapper_buf);
+}
+
 bool vcf_piz_read_one_vb (VBlock *vb_, SectionListEntry *sl)
 { 
     VBlockVCFP vb = (VBlockVCFP)vb_;
@@ -713,7 +748,8 @@ bool vcf_piz_read_one_vb (VBlock *vb_, SectionListEntry *sl)
     #define vb_header ((SectionHeaderVbHeaderVCF *)vb->z_data.data)
     
     // first VB, we map all format subfields to a global mapper. this uses dictionary info only, not b250
-    if (vb->vblock_i == 1) 
+    // note: with --regions, VB=1 might be skipped - so we map in the first VB that is actually read 
+    if (vb->vblock_i == 1 || !buf_is_allocated (&piz_format_mapper_buf)) 
         vcf_piz_map_format_subfields(vb_);
         
     // read the sample data
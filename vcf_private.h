@@ -120,6 +120,7 @@ typedef VBlockVCF *VBlockVCFP;
 extern unsigned vcf_vb_num_samples_in_sb (const VBlockVCF *vb, unsigned sb_i);
 extern uint32_t global_vcf_samples_per_block;
 extern void vcf_seg_complete_missing_lines (VBlockVCFP vb);
+extern void vcf_piz_free_format_mapper (void);
 
 // Samples stuff
 extern void samples_digest_vcf_header (Buffer *vcf_header_buf);
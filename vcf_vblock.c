@@ -10,7 +10,6 @@
 
 unsigned vcf_vb_size (void) { return sizeof (VBlockVCF); }
 unsigned vcf_vb_zip_dl_size (void) { return sizeof (ZipDataLineVCF); }
-bool vcf_vb_has_haplotype_data (VBlockP vb) { return ((VBlockVCFP)vb)->has_haplotype_data; }
 
 // cleanup vb (except common) and get it ready for another usage (without freeing memory held in the Buffers)
 void vcf_vb_release_vb (VBlockVCF *vb) 
@@ -116,6 +115,8 @@ void vcf_vb_cleanup_memory (VBlock *vb_)
     vb->num_sample_blocks = 0;
 
     global_vcf_num_samples = 0;
+
+    vcf_piz_free_format_mapper();
 }
 
 
@@ -128,6 +128,8 @@ static void vcf_zip_generate_genotype_one_section (VBlockVCF *vb, unsigned sb_i)
                     MtfNode *node = mtf_node_vb (ctx, node_index, NULL, NULL);
                     Base250 index = node->word_index;
 
+                    if (index.n >= ctx->num_words_used) ctx->num_words_used = index.n + 1;
+
                     if (flag_show_gt_nodes) fprintf (stderr, "%.*s:%u ", DICT_ID_LEN, ctx->name, index.n);
 
                     base250_copy (dst_next, index);
@@ -176,8 +178,8 @@ static void vcf_zip_generate_phase_sections (VBlockVCF *vb)
             ZipDataLineVCF *dl = DATA_LINE (line_i);
             if (dl->phase_type == PHASE_MIXED_PHASED) 
                 memcpy (next, &PHASE_DATA(vb,dl)[sb_i * num_samples_in_sb], num_samples_in_sb);
-            else
-                memset (next, (char)dl->phase_type, num_samples_in_sb);
+            else // note: a line in which all samples are haploid, in a VB of higher ploidy, has PHASE_UNKNOWN
+                memset (next, (char)(dl->phase_type == PHASE_UNKNOWN ? PHASE_HAPLO : dl->phase_type), num_samples_in_sb);
 
             next += num_samples_in_sb;
         }
@@ -314,16 +316,27 @@ static void vcf_zip_generate_haplotype_sections (VBlockVCF *vb)
     COPY_TIMER (vb->profile.vcf_zip_generate_haplotype_sections);
 }
 
-static CompressionAlg vcf_zip_get_best_gt_compressor (VBlock *vb, Buffer *test_data)
+// gt data: best of lzma and bzlib ; ht data: bzlib. with --codec-policy - best of all codecs for both. decided once, on the first VB.
+static CompressionAlg vcf_zip_get_best_compressor (VBlock *vb, SectionType st, Buffer *test_data)
 {
-    static CompressionAlg best_gt_data_compressor = COMP_UNKNOWN;
+    static CompressionAlg best_gt_data_compressor = COMP_UNKNOWN, best_ht_data_compressor = COMP_UNKNOWN;
     static Buffer compressed = EMPTY_BUFFER; // no thread issues as protected my mutex
 
+    if (st == SEC_VCF_HT_DATA && !comp_has_codec_policy()) return COMP_BZ2;
+
+    CompressionAlg *best_compressor = (st == SEC_VCF_GT_DATA) ? &best_gt_data_compressor : &best_ht_data_compressor;
+
     // get best compression algorithm for gt data - lzma or bzlib - their performance varies considerably with
     // the type of data - with either winning by a big margin
     pthread_mutex_lock (&best_gt_data_compressor_mutex);    
 
-    if (best_gt_data_compressor != COMP_UNKNOWN) goto finish; // answer already known
+    if (*best_compressor != COMP_UNKNOWN) goto finish; // answer already known
+
+    // --codec-policy: trial all codecs, and choose according to the policy
+    if (comp_has_codec_policy()) {
+        *best_compressor = comp_get_best_alg (vb, test_data->data, test_data->len, NULL);
+        goto finish;
+    }
 
     #define TEST_BLOCK_SIZE 100000
     buf_alloc (vb, &compressed, TEST_BLOCK_SIZE+1000, 1, "compressed_data_test", 0);
@@ -336,15 +349,15 @@ static CompressionAlg vcf_zip_get_best_gt_compressor (VBlock *vb, Buffer *test_d
     uint32_t lzma_comp_len = compressed.size;
     comp_compress_lzma (vb, test_data->data, uncompressed_len, NULL, compressed.data, &lzma_comp_len, false);
     
-    if      (bzlib_comp_len < uncompressed_len && bzlib_comp_len < lzma_comp_len) best_gt_data_compressor = COMP_BZ2;
-    else if (lzma_comp_len  < uncompressed_len && lzma_comp_len < bzlib_comp_len) best_gt_data_compressor = COMP_LZMA;
-    else                                                                          best_gt_data_compressor = COMP_PLN;
+    if      (bzlib_comp_len < uncompressed_len && bzlib_comp_len < lzma_comp_len) *best_compressor = COMP_BZ2;
+    else if (lzma_comp_len  < uncompressed_len && lzma_comp_len < bzlib_comp_len) *best_compressor = COMP_LZMA;
+    else                                                                          *best_compressor = COMP_PLN;
 
     buf_free (&compressed);
 
 finish:
     pthread_mutex_unlock (&best_gt_data_compressor_mutex);
-    return best_gt_data_compressor;
+    return *best_compressor;
 }
 
 void vcf_zip_generate_ht_gt_compress_vb_header (VBlockP vb_)
@@ -387,7 +400,7 @@ void vcf_zip_compress_one_vb (VBlockP vb_)
             // we compress each section at a time to save memory
             vcf_zip_generate_genotype_one_section (vb, sb_i); 
 
-            gt_data_alg = vcf_zip_get_best_gt_compressor (vb_, &vb->genotype_one_section_data);
+            gt_data_alg = vcf_zip_get_best_compressor (vb_, SEC_VCF_GT_DATA, &vb->genotype_one_section_data);
 
             COMPRESS_DATA_SECTION (SEC_VCF_GT_DATA, genotype_one_section_data, char, gt_data_alg, false); // gt data
 
@@ -399,7 +412,8 @@ void vcf_zip_compress_one_vb (VBlockP vb_)
 
         if (vb->has_haplotype_data) {
             if (!flag_gtshark)
-                COMPRESS_DATA_SECTION (SEC_VCF_HT_DATA, haplotype_sections_data[sb_i], char, COMP_BZ2, false) // ht data
+                COMPRESS_DATA_SECTION (SEC_VCF_HT_DATA, haplotype_sections_data[sb_i], char, 
+                                       vcf_zip_get_best_compressor (vb_, SEC_VCF_HT_DATA, &vb->haplotype_sections_data[sb_i]), false) // ht data
             else 
                 vcf_zfile_compress_haplotype_data_gtshark (vb_, &vb->haplotype_sections_data[sb_i], sb_i);
         }
@@ -1,2 +1,2 @@
-#define GENOZIP_CODE_VERSION "5.0.9"
-#define GENOZIP_FILE_FORMAT_VERSION 5
+#define GENOZIP_CODE_VERSION "6.0.0"
+#define GENOZIP_FILE_FORMAT_VERSION 6
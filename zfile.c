@@ -23,6 +23,7 @@
 #include "arch.h"
 #include "strings.h"
 #include "dict_id.h"
+#include "random_access.h"
 
 bool is_v2_or_above=true, is_v3_or_above=true, is_v4_or_above=true, is_v5_or_above=true; // default to 'true' for ZIP, modifed when PIZ reads the genozip header
 
@@ -184,25 +185,39 @@ static void zfile_get_metadata(char *metadata)
     ASSERT0 (strlen (metadata) < FILE_METADATA_LEN, "Error: metadata too long");
 }
 
-// ZIP: called by compute threads, while holding the compress_dictionary_data_mutex
+// ZIP: called by compute threads, after releasing zf_ctx->mutex. compresses a dictionary fragment into vb->compressed, 
+// to be later appended to z_file->dict_data by zfile_append_dictionary_data
 void zfile_compress_dictionary_data (VBlock *vb, MtfContext *ctx, 
-                                     uint32_t num_words, const char *data, uint32_t num_chars)
+                                     uint32_t num_words, const char *data, uint32_t num_chars,
+                                     SectionHeaderP header_p /* out - a SectionHeaderDictionary */)
 {
     START_TIMER;
 
-    SectionHeaderDictionary header;
-    memset (&header, 0, sizeof(header)); // safety
+    SectionHeaderDictionary *header = (SectionHeaderDictionary *)header_p;
+    memset (header, 0, sizeof(SectionHeaderDictionary)); // safety
 
-    header.h.magic                 = BGEN32 (GENOZIP_MAGIC);
-    header.h.section_type          = SEC_DICT;
-    header.h.data_uncompressed_len = BGEN32 (num_chars);
-    header.h.compressed_offset     = BGEN32 (sizeof(SectionHeaderDictionary));
-    header.h.sec_compression_alg  = COMP_BZ2;
-    header.h.vblock_i              = BGEN32 (vb->vblock_i);
-    header.h.section_i             = BGEN16 (vb->z_next_header_i++);
-    header.num_snips               = BGEN32 (num_words);
-    header.dict_id                 = ctx->dict_id;
+    header->h.magic                 = BGEN32 (GENOZIP_MAGIC);
+    header->h.section_type          = SEC_DICT;
+    header->h.data_uncompressed_len = BGEN32 (num_chars);
+    header->h.compressed_offset     = BGEN32 (sizeof(SectionHeaderDictionary));
+    header->h.sec_compression_alg   = COMP_BZ2;
+    header->h.vblock_i              = BGEN32 (vb->vblock_i);
+    header->h.section_i             = BGEN16 (vb->z_next_header_i++);
+    header->num_snips               = BGEN32 (num_words);
+    header->dict_id                 = ctx->dict_id;
 
+    vb->compressed.name = "compressed"; // comp_compress requires that it is set in advance
+    vb->compressed.len  = 0;
+    comp_compress (vb, &vb->compressed, false, (SectionHeader*)header, data, NULL);
+
+    COPY_TIMER (vb->profile.zfile_compress_dictionary_data)    
+}
+
+// ZIP: called by compute threads, while holding the compress_dictionary_data_mutex, in the order in which the 
+// fragments of each dictionary were created
+void zfile_append_dictionary_data (VBlock *vb, MtfContext *ctx, SectionHeaderP header,
+                                   uint32_t num_words, const char *data, uint32_t num_chars)
+{
     if (flag_show_dict) {
         fprintf (stderr, "%s (vb_i=%u, did=%u, num_snips=%u):\t", 
                  ctx->name, vb->vblock_i, ctx->did_i, num_words);
@@ -212,11 +227,49 @@ void zfile_compress_dictionary_data (VBlock *vb, MtfContext *ctx,
     if (dict_id_printable (ctx->dict_id).num == dict_id_show_one_dict.num)
         str_print_null_seperated_data (data, num_chars, false);
 
-    z_file->dict_data.name  = "z_file->dict_data"; // comp_compress requires that it is set in advance
-    comp_compress (vb, &z_file->dict_data, true, (SectionHeader*)&header, data, NULL);
+    sections_add_to_list (vb, header); // must be before we update z_file->dict_data.len, as it is the offset of this section
 
-    COPY_TIMER (vb->profile.zfile_compress_dictionary_data)    
-//printf ("End compress dict vb_i=%u did_i=%u\n", vb->vblock_i, ctx->did_i);
+    buf_alloc (evb, &z_file->dict_data, z_file->dict_data.len + vb->compressed.len, 1.5, "z_file->dict_data", 0);
+    buf_add (&z_file->dict_data, vb->compressed.data, vb->compressed.len);
+}
+
+// quality strings are compressed both with their dedicated codec and with bzip2 by the first VB to compress them, and the smaller
+// of the two is remembered, as with --codec-policy. they are not subject to --codec-policy, as the dedicated codec needs the 
+// data of each line separately, so it can't be trialed on a sample
+// --codec-policy: the codec of the b250 (or local) sections of a ctx is chosen by the first VB to compress one, by trialing
+//         the codecs on its data. the winner is remembered in the z_file ctx of this dict_id, and used by all subsequent VBs.
+// --rans: the b250 sections, and the local sections of integer ctxs, are compressed both with rANS and with default_alg by 
+//         the first VB to compress one, and the smaller of the two is remembered, as with --codec-policy
+static CompressionAlg zfile_get_ctx_comp_alg (VBlock *vb, const MtfContext *ctx, SectionType st, 
+                                              const char *data, uint32_t data_len, CompGetLineCallback callback, // as in comp_compress
+                                              CompressionAlg default_alg)
+{
+    bool is_qual = (default_alg == COMP_QUAL);
+    bool is_rans = !is_qual && !comp_has_codec_policy() && flag_rans && (st == SEC_B250 || (ctx->ltype >= CTX_LT_INT8 && ctx->ltype <= CTX_LT_UINT64));
+
+    if (!is_qual && !is_rans && !comp_has_codec_policy()) return default_alg;
+
+    // a section too short to be compressed (see comp_compress) can't tell us which codec is better for this ctx
+    if ((is_qual || is_rans) && data_len < MIN_LEN_FOR_COMPRESSION) return default_alg;
+
+    uint8_t zf_did_i = mtf_get_existing_did_i_from_z_file (ctx->dict_id);
+    int8_t *zf_alg = (zf_did_i == DID_I_NONE) ? NULL // not expected after merge, but if it happens, we just don't remember the winner 
+                   : (st == SEC_B250)         ? &z_file->contexts[zf_did_i].b250_comp_alg 
+                   :                            &z_file->contexts[zf_did_i].local_comp_alg;
+
+    CompressionAlg comp_alg = zf_alg ? __atomic_load_n (zf_alg, __ATOMIC_RELAXED) : COMP_UNKNOWN;
+    if (comp_alg != COMP_UNKNOWN) return comp_alg;
+
+    comp_alg = is_qual ? comp_get_smaller_alg (vb, st, COMP_QUAL, COMP_BZ2, data, data_len, callback)
+             : is_rans ? comp_get_smaller_alg (vb, st, COMP_RANS, default_alg, data, data_len, callback)
+             :           comp_get_best_alg (vb, data, data_len, callback);
+
+    // if several VBs trialed this ctx concurrently, the first to finish publishes its winner, and the others adopt it
+    int8_t published = COMP_UNKNOWN;
+    if (zf_alg && !__atomic_compare_exchange_n (zf_alg, &published, (int8_t)comp_alg, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        comp_alg = published;
+
+    return comp_alg;
 }
 
 void zfile_compress_b250_data (VBlock *vb, MtfContext *ctx, CompressionAlg comp_alg)
@@ -228,7 +281,7 @@ void zfile_compress_b250_data (VBlock *vb, MtfContext *ctx, CompressionAlg comp_
     header.h.section_type          = SEC_B250;
     header.h.data_uncompressed_len = BGEN32 (ctx->b250.len);
     header.h.compressed_offset     = BGEN32 (sizeof(SectionHeaderCtx));
-    header.h.sec_compression_alg   = comp_alg;
+    header.h.sec_compression_alg   = zfile_get_ctx_comp_alg (vb, ctx, SEC_B250, ctx->b250.data, ctx->b250.len, NULL, comp_alg);
     header.h.vblock_i              = BGEN32 (vb->vblock_i);
     header.h.section_i             = BGEN16 (vb->z_next_header_i++);
     header.dict_id                 = ctx->dict_id;
@@ -255,20 +308,22 @@ void zfile_compress_local_data (VBlock *vb, MtfContext *ctx)
     memset (&header, 0, sizeof(header)); // safety
 
     unsigned local_len_multiplier  = ctx_lt_sizeof_one[ctx->ltype];
+    uint32_t local_len             = ctx->local.len * local_len_multiplier;
+    CompGetLineCallback *callback  = zfile_get_local_data_callback (vb->data_type, ctx->dict_id);
 
     header.h.magic                 = BGEN32 (GENOZIP_MAGIC);
     header.h.section_type          = SEC_LOCAL;
-    header.h.data_uncompressed_len = BGEN32 (ctx->local.len * local_len_multiplier); 
+    header.h.data_uncompressed_len = BGEN32 (local_len); 
     header.h.compressed_offset     = BGEN32 (sizeof(SectionHeaderCtx));
-    header.h.sec_compression_alg   = (ctx->flags & CTX_FL_LOCAL_LZMA) ? COMP_LZMA : COMP_BZ2;
+    header.h.sec_compression_alg   = zfile_get_ctx_comp_alg (vb, ctx, SEC_LOCAL, callback ? NULL : ctx->local.data, local_len, callback,
+                                                             (ctx->flags & CTX_FL_LOCAL_QUAL) ? COMP_QUAL 
+                                                           : (ctx->flags & CTX_FL_LOCAL_LZMA) ? COMP_LZMA : COMP_BZ2);
     header.h.vblock_i              = BGEN32 (vb->vblock_i);
     header.h.section_i             = BGEN16 (vb->z_next_header_i++);
     header.dict_id                 = ctx->dict_id;
     header.flags                   = ctx->flags;
     header.ltype                   = ctx->ltype;
 
-    CompGetLineCallback *callback = zfile_get_local_data_callback (vb->data_type, ctx->dict_id);
-
     comp_compress (vb, &vb->z_data, false, (SectionHeader*)&header, 
                    callback ? NULL : ctx->local.data, 
                    callback);
@@ -351,6 +406,74 @@ void *zfile_read_from_disk (VBlock *vb, Buffer *buf, unsigned len, bool fail_qui
     return start;
 }
 
+// mmap counterpart of zfile_read_from_disk: "reads" len bytes at the current position of the mapped z_file, by overlaying buf 
+// on them, or extending the existing overlay over them (and over any skipped sections in between) - no copying. Only if buf
+// already contains data of its own, the bytes are copied. Returns a pointer to the data within buf, or NULL if at EOF
+static void *zfile_read_from_mmap (VBlock *vb, Buffer *buf, const char *buf_name, unsigned len)
+{
+    START_TIMER;
+
+    ASSERT0 (len, "Error: in zfile_read_from_mmap, len is 0");
+
+    if (z_file->mmap_next == z_file->disk_size) return NULL; // EOF
+
+    ASSERT (z_file->mmap_next + len <= z_file->disk_size, "Error: end-of-file while reading %s, wanted to read %u bytes but only %"PRIu64" remain", 
+            z_name, len, z_file->disk_size - z_file->mmap_next);
+
+    char *start = z_file->mmap_data + z_file->mmap_next;
+
+    if (!buf->data) 
+        buf_overlay_mmap (vb, buf, start, len, buf_name, vb->vblock_i);
+
+    else if (buf->type == BUF_MMAP && buf->data >= z_file->mmap_data && buf->data + buf->len <= start)
+        buf->len = start + len - buf->data;
+
+    else {
+        buf_alloc (vb, buf, buf->len + len, 2, buf_name, vb->vblock_i);
+        start = AFTERENT (char, *buf);
+        buf_add (buf, z_file->mmap_data + z_file->mmap_next, len);
+    }
+
+    z_file->mmap_next   += len;
+    z_file->disk_so_far += len;
+
+    COPY_TIMER (vb->profile.read);
+
+    return start;
+}
+
+// PIZ: when starting to read a VB - have the prefetch thread read ahead this VB and the following ones, so that there is 
+// data for every VB the dispatcher may have in flight
+static void zfile_prefetch_vbs (const SectionListEntry *vb_header_sl)
+{
+    const SectionListEntry *sl    = vb_header_sl;
+    const SectionListEntry *after = AFTERENT (const SectionListEntry, z_file->section_list_buf);
+    
+    unsigned num_vbs = 0, max_vbs = global_max_vbs_in_flight + 1;
+    for (; sl < after && !section_type_is_dictionary (sl->section_type); sl++)
+        if (sl->section_type == SEC_VB_HEADER && ++num_vbs > max_vbs) break;
+
+    uint64_t end = (sl < after) ? sl->offset : z_file->disk_size;
+    file_prefetch (z_file, vb_header_sl->offset, end - vb_header_sl->offset);
+}
+
+// PIZ: have the prefetch thread read all dictionaries - they are consecutive in the file
+static void zfile_prefetch_dictionaries (void)
+{
+    ARRAY (const SectionListEntry, sl, z_file->section_list_buf);
+
+    uint64_t start=0, end=0;
+    for (uint32_t i=0; i < z_file->section_list_buf.len; i++) {
+        if (section_type_is_dictionary (sl[i].section_type)) {
+            if (!start) start = sl[i].offset;
+            end = (i < z_file->section_list_buf.len-1) ? sl[i+1].offset : z_file->disk_size;
+        }
+        else if (start) break;
+    }
+
+    if (start) file_prefetch (z_file, start, end - start);
+}
+
 // read section header - called from the I/O thread, but for a specific VB
 // returns offset of header within data, EOF if end of file
 int32_t zfile_read_section (VBlock *vb, 
@@ -375,24 +498,34 @@ int32_t zfile_read_section (VBlock *vb,
     bool is_encrypted = (expected_sec_type != SEC_GENOZIP_HEADER) &&
                          crypt_get_encrypted_len (&header_size, NULL); // update header size if encrypted
     
-    unsigned header_offset = data->len;
-    buf_alloc (vb, data, header_offset + header_size, 2, buf_name, 1);
+    bool is_mmap = !!z_file->mmap_data;
+    if (!is_mmap) buf_alloc (vb, data, data->len + header_size, 2, buf_name, 1);
     
     // move the cursor to the section. file_seek is smart not to cause any overhead if no moving is needed
     if (sl) file_seek (z_file, sl->offset, SEEK_SET, false);
 
-    SectionHeader *header = zfile_read_from_disk (vb, data, header_size, false); // note: header in file can be shorter than header_size if its an earlier version
+    if (sl && expected_sec_type == SEC_VB_HEADER) zfile_prefetch_vbs (sl);
+
+    // note: header in file can be shorter than header_size if its an earlier version
+    SectionHeader *header = is_mmap ? zfile_read_from_mmap (vb, data, buf_name, header_size) 
+                                    : zfile_read_from_disk (vb, data, header_size, false); 
+
+    // case: we're done! no more concatenated files
+    if (!header && expected_sec_type == SEC_TXT_HEADER) return EOF; 
+
+    // note: with a mapped file, the header might not be at the end of the previous data, if sections were skipped
+    unsigned header_offset = header ? (char *)header - data->data : 0;
 
     // case: this is a v5+ genozip header - read the extra field
-    if (header->section_type == SEC_GENOZIP_HEADER &&
+    if (header && header->section_type == SEC_GENOZIP_HEADER &&
         ((v2v3v4_SectionHeaderGenozipHeader *)header)->genozip_version >= 5) {
-        zfile_read_from_disk (vb, data, sizeof (SectionHeaderGenozipHeader) - sizeof (v2v3v4_SectionHeaderGenozipHeader), false);
+        unsigned extra_len = sizeof (SectionHeaderGenozipHeader) - sizeof (v2v3v4_SectionHeaderGenozipHeader);
+        if (is_mmap) zfile_read_from_mmap (vb, data, buf_name, extra_len);
+        else         zfile_read_from_disk (vb, data, extra_len, false);
         header_size += sizeof (Md5Hash);
+        header = (SectionHeader *)&data->data[header_offset]; // update in case data was copied to a new memory
     }
 
-    // case: we're done! no more concatenated files
-    if (!header && expected_sec_type == SEC_TXT_HEADER) return EOF; 
-
     ASSERT (header, "Error in zfile_read_section: Failed to read data from file %s while expecting section type %s: %s", 
             z_name, st_name(expected_sec_type), strerror (errno));
     
@@ -429,44 +562,87 @@ int32_t zfile_read_section (VBlock *vb,
             "Error: invalid header - expecting compressed_offset to be %u but found %u. section_type=%s", 
             header_size, compressed_offset, st_name(header->section_type));
 
-    // allocate more memory for the rest of the header + data (note: after this realloc, header pointer is no longer valid)
-    buf_alloc (vb, data, header_offset + compressed_offset + data_len, 2, "zfile_read_section", 2);
-    header = (SectionHeader *)&data->data[header_offset]; // update after realloc
-
     // read section data
     if (data_len) {
-        ASSERT (zfile_read_from_disk (vb, data, data_len, false), 
-                "Error: failed to read section data, section_type=%s: %s", st_name(header->section_type), strerror (errno));
+        // allocate more memory for the rest of the header + data (note: after this realloc, header pointer is no longer valid)
+        if (!is_mmap) buf_alloc (vb, data, header_offset + compressed_offset + data_len, 2, "zfile_read_section", 2);
+
+        ASSERT (is_mmap ? zfile_read_from_mmap (vb, data, buf_name, data_len) : zfile_read_from_disk (vb, data, data_len, false), 
+                "Error: failed to read section data, section_type=%s: %s", st_name(expected_sec_type), strerror (errno));
     }
 
     return header_offset;
 }
 
-void zfile_read_all_dictionaries (uint32_t last_vb_i /* 0 means all VBs */, ReadChromeType read_chrom)
+#define MAX_DICT_FRAGS_READ_AHEAD (512 << 20)
+
+static Buffer frag_offsets = EMPTY_BUFFER; // offsets of the dictionary sections' headers within evb->z_data
+
+// update dictionaries in z_file->contexts with the dictionary fragments read into evb->z_data
+static void zfile_integrate_dictionary_fragments (bool vbs_in_flight)
+{
+    if (!frag_offsets.len) return;
+
+    mtf_integrate_dictionary_fragments (&evb->z_data, &frag_offsets, vbs_in_flight);
+
+    buf_free (&evb->z_data);
+    frag_offsets.len = 0;
+}
+
+// we read fragments into z_data first, and then integrate them. returns the number of words in the fragment.
+static uint32_t zfile_read_dictionary_fragment (const SectionListEntry *sl_ent)
+{
+    uint64_t z_data_len = evb->z_data.len;
+    int32_t offset = zfile_read_section (evb, sl_ent->vblock_i, NO_SB_I, &evb->z_data, "z_data", sizeof(SectionHeaderDictionary), sl_ent->section_type, sl_ent);    
+    if (evb->z_data.len == z_data_len) return 0; // section skipped
+
+    buf_alloc (evb, &frag_offsets, (frag_offsets.len + 1) * sizeof (uint32_t), 2, "frag_offsets", 0);
+    NEXTENT (uint32_t, frag_offsets) = (uint32_t)offset;
+
+    return BGEN32 (((SectionHeaderDictionary *)&evb->z_data.data[offset])->num_snips);
+}
+
+void zfile_read_all_dictionaries (ReadChromeType read_chrom)
 {
     SectionListEntry *sl_ent = NULL; // NULL -> first call to this sections_get_next_dictionary() will reset cursor 
 
     mtf_initialize_primary_field_ctxs (z_file->contexts, z_file->data_type, z_file->dict_id_to_did_i_map, &z_file->num_dict_ids);
 
-    while (sections_get_next_dictionary (&sl_ent)) {
+    if (read_chrom == DICTREAD_ALL || read_chrom == DICTREAD_EXCEPT_CHROM) zfile_prefetch_dictionaries();
 
-        if (last_vb_i && sl_ent->vblock_i > last_vb_i) break;
+    // note: we can't stop at the last VB included in --regions: VBs merge their new words in the order they complete, 
+    // so a fragment of a later VB may contain words used by an earlier one
+    while (sections_get_next_dictionary (&sl_ent)) {
 
         // cases where we can skip reading these dictionaries because we don't be using them
         bool is_chrom = (sl_ent->dict_id.num == dict_id_fields[DTFZ(chrom)]);
         if (read_chrom == DICTREAD_CHROM_ONLY  && !is_chrom) continue;
         if (read_chrom == DICTREAD_EXCEPT_CHROM && is_chrom) continue;
+        if (read_chrom == DICTREAD_LAZY && is_chrom && flag_regions) continue; // already read with DICTREAD_CHROM_ONLY
 
         if (piz_is_skip_sectionz (sl_ent->section_type, sl_ent->dict_id)) continue;
-        
-        zfile_read_section (evb, sl_ent->vblock_i, NO_SB_I, &evb->z_data, "z_data", sizeof(SectionHeaderDictionary), sl_ent->section_type, sl_ent);    
 
-        // update dictionaries in z_file->contexts with dictionary data 
-        mtf_integrate_dictionary_fragment (evb, evb->z_data.data);
+        // lazy: create the context now, so that did_i's are the same as if we read all dictionaries, but read its 
+        // fragments only when the first VB that needs it is read (see zfile_read_lazy_dictionaries)
+        if (read_chrom == DICTREAD_LAZY) {
+            MtfContext *zf_ctx = mtf_get_ctx_do (z_file->contexts, z_file->data_type, z_file->dict_id_to_did_i_map, &z_file->num_dict_ids, sl_ent->dict_id);
+            if (!zf_ctx->dict_pending) {
+                zf_ctx->dict_pending   = true;
+                zf_ctx->next_dict_sl_i = sl_ent - FIRSTENT (SectionListEntry, z_file->section_list_buf); // its first fragment
+            }
+            continue;
+        }
+
+        zfile_read_dictionary_fragment (sl_ent);
 
-        buf_free (&evb->z_data);
+        // limit the memory consumption of a non-mmap-ed file with huge dictionaries
+        if (evb->z_data.len > MAX_DICT_FRAGS_READ_AHEAD) 
+            zfile_integrate_dictionary_fragments (false);
     }
 
+    zfile_integrate_dictionary_fragments (false);
+    buf_free (&frag_offsets);
+
     // output the dictionaries if we're asked to
     if (flag_show_dict || dict_id_show_one_dict.num) {
         for (uint32_t did_i=0; did_i < z_file->num_dict_ids; did_i++) {
@@ -487,6 +663,98 @@ void zfile_read_all_dictionaries (uint32_t last_vb_i /* 0 means all VBs */, Read
     }
 }
 
+static inline void zfile_set_lazy_needed (uint32_t *num_words, unsigned *num_needed, uint8_t did_i, uint32_t n)
+{
+    MtfContext *zf_ctx = &z_file->contexts[did_i];
+
+    if (zf_ctx->dict_pending && n > zf_ctx->word_list.len && !num_words[did_i]) {
+        num_words[did_i] = n;
+        (*num_needed)++;
+    }
+}
+
+// PIZ I/O thread: with DICTREAD_LAZY, read the dictionary fragments needed by this VB that were not read yet.
+// If the file has a dictionary index (SEC_DICT_INDEX), we read only up to the highest word each context's b250 (or VCF GT data) 
+// uses in this VB, otherwise we read all fragments of the contexts of this VB.
+// Called before the VB's sections are read, as they are overlaid to the VB in mtf_overlay_dictionaries_to_vb. 
+// Note: VBs already dispatched don't use the words we add, so integrating them doesn't affect the compute threads
+void zfile_read_lazy_dictionaries (uint32_t vblock_i, const SectionListEntry *vb_sl)
+{
+    uint32_t num_words[MAX_DICTS] = {}; // number of words needed by this VB, in contexts with dict_pending
+    unsigned num_needed = 0;
+
+    uint32_t num_entries;
+    const DictIndexEntry *dict_index = random_access_get_dict_index (vblock_i, &num_entries);
+
+    if (dict_index) 
+        for (uint32_t i=0; i < num_entries; i++) {
+            uint8_t did_i = mtf_get_existing_did_i_from_z_file (dict_index[i].dict_id);
+            if (did_i != DID_I_NONE) zfile_set_lazy_needed (num_words, &num_needed, did_i, dict_index[i].num_words);
+        }
+
+    else {
+        const SectionListEntry *after = AFTERENT (const SectionListEntry, z_file->section_list_buf);
+    
+        for (const SectionListEntry *sl = vb_sl; sl < after && sl->vblock_i == vblock_i; sl++) {
+
+            // VCF FORMAT subfields have no b250 - their word indices are in the GT data of the VB
+            if (sl->section_type == SEC_VCF_GT_DATA) {
+                for (unsigned did_i=0; did_i < z_file->num_dict_ids; did_i++)
+                    if (dict_id_is_vcf_format_sf (z_file->contexts[did_i].dict_id)) zfile_set_lazy_needed (num_words, &num_needed, did_i, 0xffffffff);
+                continue;
+            }
+
+            if (!section_type_is_b250 (sl->section_type) && sl->section_type != SEC_LOCAL) continue;
+            
+            uint8_t did_i = mtf_get_existing_did_i_from_z_file (sl->dict_id);
+            if (did_i != DID_I_NONE) zfile_set_lazy_needed (num_words, &num_needed, did_i, 0xffffffff);
+        }
+    }
+
+    // vcf_piz_map_format_subfields maps the entire FORMAT dictionary
+    if (z_file->data_type == DT_VCF && num_words[VCF_FORMAT]) num_words[VCF_FORMAT] = 0xffffffff;
+
+    if (!num_needed) return;
+
+    // read the needed fragments, in the order of the file, starting from the first unread fragment of any needed context
+    uint32_t words_read[MAX_DICTS] = {}; // words read and not integrated yet
+    uint32_t sl_i = 0xffffffff;
+    for (unsigned did_i=0; did_i < z_file->num_dict_ids; did_i++)
+        if (num_words[did_i]) sl_i = MIN (sl_i, z_file->contexts[did_i].next_dict_sl_i);
+
+    ARRAY (const SectionListEntry, sl, z_file->section_list_buf);
+
+    for (; num_needed && sl_i < z_file->section_list_buf.len && section_type_is_dictionary (sl[sl_i].section_type); sl_i++) {
+
+        uint8_t did_i = mtf_get_existing_did_i_from_z_file (sl[sl_i].dict_id);
+        if (did_i == DID_I_NONE || !num_words[did_i]) continue;
+        
+        MtfContext *zf_ctx = &z_file->contexts[did_i];
+        if (sl_i < zf_ctx->next_dict_sl_i) continue; // already read
+
+        words_read[did_i] += zfile_read_dictionary_fragment (&sl[sl_i]);
+        zf_ctx->next_dict_sl_i = sl_i + 1;
+
+        if (zf_ctx->word_list.len + words_read[did_i] >= num_words[did_i]) {
+            num_words[did_i] = 0; // done with this context
+            num_needed--;
+        }
+
+        // limit the memory consumption of a non-mmap-ed file with huge dictionaries
+        if (evb->z_data.len > MAX_DICT_FRAGS_READ_AHEAD) {
+            zfile_integrate_dictionary_fragments (true);
+            memset (words_read, 0, sizeof (words_read));
+        }
+    }
+
+    zfile_integrate_dictionary_fragments (true);
+    buf_free (&frag_offsets);
+
+    // contexts still needing words have no more fragments to read
+    for (unsigned did_i=0; did_i < z_file->num_dict_ids; did_i++)
+        if (num_words[did_i]) z_file->contexts[did_i].dict_pending = false;
+}
+
 // returns the read data IF this is an invalid v2+ file, and hence might be v1
 int16_t zfile_read_genozip_header (Md5Hash *digest) // out
 {
@@ -494,7 +762,7 @@ int16_t zfile_read_genozip_header (Md5Hash *digest) // out
     file_seek (z_file, -sizeof(SectionFooterGenozipHeader), SEEK_END, false);
 
     SectionFooterGenozipHeader footer;
-    int ret = fread (&footer, sizeof (footer), 1, (FILE *)z_file->file);
+    int ret = (file_read (z_file, &footer, sizeof (footer)) == sizeof (footer));
     ASSERTW (ret == 1, "Skipping empty file %s", z_name);
     if (!ret) return DT_NONE;
     
@@ -502,6 +770,7 @@ int16_t zfile_read_genozip_header (Md5Hash *digest) // out
     if (BGEN32 (footer.magic) != GENOZIP_MAGIC) {
         is_v2_or_above = is_v3_or_above = is_v4_or_above = is_v5_or_above = false;
         file_seek (z_file, 0, SEEK_SET, false);
+        file_unmap (z_file); // v1 files are read with fread
         return DT_VCF_V1;
     }
 
@@ -564,8 +833,12 @@ int16_t zfile_read_genozip_header (Md5Hash *digest) // out
         if (exe_type == EXE_GENOCAT) exit(0); // in genocat, exit after showing the requested data
     }
 
+    bool is_encrypted = (header->encryption_type != ENCRYPTION_TYPE_NONE);
     buf_free (&evb->z_data);
 
+    // encrypted sections are decrypted in place, so they need to be read into memory of their own
+    if (is_encrypted) file_unmap (z_file);
+
     return data_type;
 }
 
@@ -660,13 +933,14 @@ bool zfile_get_genozip_header (uint64_t *uncompressed_data_size,
         return false;
 
     SectionFooterGenozipHeader footer;
-    int ret = fread (&footer, sizeof (footer), 1, (FILE *)z_file->file);
+    int ret = (file_read (z_file, &footer, sizeof (footer)) == sizeof (footer));
     ASSERTW (ret == 1, "Skipping empty file %s", z_name);    
     if (!ret) return false; // empty file / cannot read
     
     // case: this is not a valid genozip v2+ file... maybe its v1?
     if (BGEN32 (footer.magic) != GENOZIP_MAGIC) {
         file_seek (z_file, 0, SEEK_SET, false);
+        file_unmap (z_file); // v1 files are read with fread
         return vcf_v1_header_get_vcf_header (uncompressed_data_size, num_samples, num_items_concat, 
                                              md5_hash_concat, created, created_len);
     }
@@ -677,7 +951,7 @@ bool zfile_get_genozip_header (uint64_t *uncompressed_data_size,
         return false;
 
     SectionHeaderGenozipHeader header;
-    int bytes = fread ((char*)&header, 1, sizeof(SectionHeaderGenozipHeader), (FILE *)z_file->file);
+    int bytes = file_read (z_file, &header, sizeof(SectionHeaderGenozipHeader));
     if (bytes < sizeof(SectionHeaderGenozipHeader)) return false;
 
     ASSERTW (BGEN32 (header.h.magic) == GENOZIP_MAGIC, "Error reading %s: corrupt data", z_name);
@@ -24,11 +24,15 @@ extern void zfile_compress_section_data_alg (VBlockP vb, SectionType section_typ
 #define zfile_compress_section_data(vb, section_type, section_data) \
     zfile_compress_section_data_alg ((vb), (section_type), (section_data), NULL, 0, COMP_BZ2)
 
-typedef enum {DICTREAD_ALL, DICTREAD_CHROM_ONLY, DICTREAD_EXCEPT_CHROM} ReadChromeType;
-extern void zfile_read_all_dictionaries (uint32_t last_vb_i /* 0 means all VBs */, ReadChromeType read_chrom);
+typedef enum {DICTREAD_ALL, DICTREAD_CHROM_ONLY, DICTREAD_EXCEPT_CHROM, DICTREAD_LAZY /* on demand */} ReadChromeType;
+extern void zfile_read_all_dictionaries (ReadChromeType read_chrom);
+extern void zfile_read_lazy_dictionaries (uint32_t vblock_i, ConstSectionListEntryP vb_sl);
 
 extern void zfile_compress_dictionary_data (VBlockP vb, MtfContextP ctx, 
-                                            uint32_t num_words, const char *data, uint32_t num_chars);
+                                            uint32_t num_words, const char *data, uint32_t num_chars,
+                                            SectionHeaderP header /* out */);
+extern void zfile_append_dictionary_data (VBlockP vb, MtfContextP ctx, SectionHeaderP header,
+                                          uint32_t num_words, const char *data, uint32_t num_chars);
 extern void zfile_compress_b250_data  (VBlockP vb, MtfContextP ctx, CompressionAlg comp_alg);
 extern void zfile_compress_local_data (VBlockP vb, MtfContextP ctx);
 
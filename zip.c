@@ -11,6 +11,7 @@
 #include "file.h"
 #include "zfile.h"
 #include "txtfile.h"
+#include "bgzf.h"
 #include "vblock.h"
 #include "dispatcher.h"
 #include "move_to_front.h"
@@ -83,6 +84,7 @@ static void zip_handle_unique_words_ctxs (VBlock *vb)
         if ((ctx->flags & CTX_FL_NO_STONS) || ctx->ltype != CTX_LT_TEXT) continue; // NO_STONS is implicit if ctx isn't text
 
         buf_move (vb, &ctx->local, vb, &ctx->dict);
+        random_access_seek_points_unique_words (vb, ctx);
         buf_free (&ctx->mtf);
         buf_free (&ctx->mtf_i);
     }
@@ -99,6 +101,7 @@ void zip_generate_and_compress_ctxs (VBlock *vb)
             (vb->data_type != DT_VCF || !dict_id_is_vcf_format_sf (ctx->dict_id))) { // skip VCF FORMAT subfields, as they get compressed into SEC_GT_DATA instead
             
             zip_generate_b250_section (vb, ctx);
+            random_access_seek_points_b250 (vb, ctx);
             zfile_compress_b250_data (vb, ctx, COMP_BZ2);
         }
 
@@ -135,6 +138,8 @@ void zip_generate_b250_section (VBlock *vb, MtfContext *ctx)
             uint32_t n            = node->word_index.n;
             unsigned num_numerals = base250_len (node->word_index.encoded.numerals);
             uint8_t *numerals     = node->word_index.encoded.numerals;
+
+            if (n >= ctx->num_words_used) ctx->num_words_used = n + 1;
             
             bool one_up = (n == prev + 1) && (ctx->dict_id.num != dict_id_fields[VCF_GT]) && (i > 0);
 
@@ -221,6 +226,8 @@ static void zip_write_global_area (const Md5Hash *single_component_md5)
     // if this data has random access (i.e. it has chrom and pos), compress all random access records into evb->z_data
     if (DTPZ(has_random_access)) {
 
+        random_access_sort_by_vb(); // VBs merged in the order they completed
+
         if (flag_show_index) random_access_show_index(true);
         
         BGEN_random_access(); // make ra_buf into big endian
@@ -228,6 +235,12 @@ static void zip_write_global_area (const Md5Hash *single_component_md5)
         z_file->ra_buf.len *= random_access_sizeof_entry(); // change len to count bytes
 
         zfile_compress_section_data_alg (evb, SEC_RANDOM_ACCESS, &z_file->ra_buf, 0,0, COMP_LZMA); // ra data compresses better with LZMA than BZLIB
+
+        // dictionary index - already big endian
+        z_file->dict_index_buf.len *= sizeof (DictIndexEntry); // change len to count bytes
+        
+        if (z_file->dict_index_buf.len)
+            zfile_compress_section_data_alg (evb, SEC_DICT_INDEX, &z_file->dict_index_buf, 0,0, COMP_LZMA);
     }
 
     // compress genozip header (including its payload sectionlist and footer) into evb->z_data
@@ -242,9 +255,9 @@ static void zip_compress_one_vb (VBlock *vb)
 {
     START_TIMER; 
 
-    // if we're vb_i=1 lock, and unlock only when we're done merging. all other vbs need  
-    // to wait for our merge. that is because our dictionaries are sorted 
-    if (vb->vblock_i == 1) mtf_vb_1_lock(vb); 
+    // if the txt file is BGZF, the I/O thread left most of its blocks for us to uncompress (BAM and BCF: all of them)
+    if (txt_file->comp_alg == COMP_BGZ || file_has_bgzf_records (txt_file)) 
+        txtfile_bgzf_uncompress_vb (vb);
 
     // allocate memory for the final compressed data of this vb. allocate 20% of the
     // vb size on the original file - this is normally enough. if not, we will realloc downstream
@@ -259,18 +272,6 @@ static void zip_compress_one_vb (VBlock *vb)
     // identify dictionaries that contain almost only unique words (eg a unique id) and move the data from dict to local
     zip_handle_unique_words_ctxs (vb);
 
-    // for the first vb only - sort dictionaries so that the most frequent entries get single digit
-    // base-250 indices. This can be done only before any dictionary is written to disk, but likely
-    // beneficial to all vbs as they are likely to more-or-less have the same frequent entries
-    if (vb->vblock_i == 1) {
-        mtf_sort_dictionaries_vb_1(vb);
-
-        // for a file that's compressed (and hence we don't know the size of content a-priori) AND we know the
-        // compressed file size (eg a local gz/bz2 file or a compressed file on a ftp server) - we now estimate the 
-        // txt_data_size_single that will be used for the global_hash and the progress indicator
-        txtfile_estimate_txt_data_size (vb);
-    }
-
     if (vb->data_type == DT_VCF)
         vcf_zip_generate_ht_gt_compress_vb_header (vb);
     else
@@ -295,6 +296,9 @@ static void zip_compress_one_vb (VBlock *vb)
     // generate & compress b250 and local data for all ctxs 
     zip_generate_and_compress_ctxs (vb);
 
+    // compress the state of the ctxs at each seek point, now that we know their b250 and local offsets (--seek-points)
+    random_access_compress_seek_points (vb);
+
     // compress data-type specific sections
     if (DTP(compress)) DTP(compress)(vb);
 
@@ -339,25 +343,27 @@ void zip_dispatcher (const char *txt_basename, unsigned max_threads, bool is_las
 
     if (z_file->data_type == DT_VCF) vcf_zip_initialize();
 
+    seg_verify_num_shards (z_file->data_type);
+
     uint32_t max_lines_per_vb=0;
 
     // this is the dispatcher loop. In each iteration, it can do one of 3 things, in this order of priority:
-    // 1. In there is a new variant block avaialble, and a compute thread available to take it - dispatch it
+    // 1. In there is a new variant block avaialble, and a free slot in the dispatcher to take it - dispatch it
     // 2. If there is no new variant block available, but input is not exhausted yet - read one
     // 3. Wait for the first thread (by sequential order) to complete the compute and output the results
     VBlock *next_vb;
     do {
         next_vb = dispatcher_get_next_vb (dispatcher);
         bool has_vb_ready_to_compute = next_vb && next_vb->ready_to_dispatch;
-        bool has_free_thread = dispatcher_has_free_thread (dispatcher);
+        bool has_free_slot = dispatcher_has_free_slot (dispatcher);
 
-        // PRIORITY 1: is there a block available and a compute thread available? in that case dispatch it
-        if (has_vb_ready_to_compute && has_free_thread) 
+        // PRIORITY 1: is there a block available and a free slot? in that case dispatch it
+        if (has_vb_ready_to_compute && has_free_slot) 
             dispatcher_compute (dispatcher, zip_compress_one_vb);
         
         // PRIORITY 2: output completed vbs, so they can be released and re-used
         else if (dispatcher_has_processed_vb (dispatcher, NULL) ||  // case 1: there is a VB who's compute processing is completed
-                 (has_vb_ready_to_compute && !has_free_thread)) {   // case 2: a VB ready to dispatch but all compute threads are occupied. wait here for one to complete
+                 (has_vb_ready_to_compute && !has_free_slot)) {     // case 2: a VB ready to dispatch but the dispatcher is full. wait here for the oldest VB to complete
            
             VBlock *processed_vb = dispatcher_get_processed_vb (dispatcher, NULL); // this will block until one is available
             if (!processed_vb) continue; // no running compute threads 
@@ -365,6 +371,10 @@ void zip_dispatcher (const char *txt_basename, unsigned max_threads, bool is_las
             // update z_data in memory (its not written to disk yet)
             DTPZ(update_header)(processed_vb, txt_line_i); 
 
+            // index the dictionary words used by this VB - IF random access is used
+            if (DTPZ(has_random_access)) 
+                random_access_dict_index_merge_in_vb (processed_vb);
+
             max_lines_per_vb = MAX (max_lines_per_vb, processed_vb->lines.len);
             txt_line_i += (uint32_t)processed_vb->lines.len;
 
@@ -384,20 +394,27 @@ void zip_dispatcher (const char *txt_basename, unsigned max_threads, bool is_las
 
             if (flag_show_threads) dispatcher_show_time ("Read input data done", -1, next_vb->vblock_i);
 
-            if (next_vb->txt_data.len)  // we found some data 
+            if (next_vb->txt_data.len || next_vb->bgzf_blocks.len) { // we found some data (BAM and BCF: the compute thread generates txt_data from the blocks)
+                // estimate txt_data_size_single before dispatching VB 1, as it is used for sizing the global hash tables, and any VB 
+                // might be the first to merge. this is the only place it is set until all VBs are done, so compute threads can read it freely
+                if (next_vb->vblock_i == 1) txtfile_estimate_txt_data_size (next_vb);
+
                 next_vb->ready_to_dispatch = true;
+            }
             else {
                 // this vb has no data
                 dispatcher_input_exhausted (dispatcher);
-                
-                // update to the conclusive size. it might have been 0 (eg STDIN if HTTP) or an estimate (if compressed)
-                txt_file->txt_data_size_single = txt_file->txt_data_so_far_single; 
-
                 dispatcher_finalize_one_vb (dispatcher); 
             }
         }
     } while (!dispatcher_is_done (dispatcher));
 
+    // update to the conclusive size. it might have been 0 (eg STDIN if HTTP) or an estimate (if compressed). 
+    // note: we do this after all VBs are processed, as BAM and BCF VBs update txt_data_so_far_single in their compute thread
+    txt_file->txt_data_size_single = txt_file->txt_data_so_far_single; 
+
+    if (file_has_bgzf_records (txt_file)) bgzf_records_finalize();
+
     // go back and update some fields in the txt header's section header and genozip header -
     // only if we can go back - i.e. is a normal file, not redirected
     Md5Hash single_component_md5;
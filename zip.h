@@ -19,9 +19,6 @@ extern void zip_generate_b250_section (VBlockP vb, MtfContextP ctx);
 #define COMPRESS_START(vblock_type) \
     START_TIMER; \
     vblock_type *vb = (vblock_type *)vb_; \
-    /* if we're vb_i=1 lock, and unlock only when we're done merging. all other vbs need  \
-       to wait for our merge. that is because our dictionaries are sorted */ \
-    if (vb->vblock_i == 1) mtf_vb_1_lock(vb_); \
     /* allocate memory for the final compressed data of this vb. allocate 20% of the  \
        vb size on the original file - this is normally enough. if not, we will realloc downstream */ \
     buf_alloc (vb, &vb->z_data, vb->vb_data_size / 5, 1.2, "z_data", 0); \